@@ -0,0 +1,77 @@
+/*
+ * Evolutionary K-means clustering (E-means) using Genetic Algorithms.
+ *
+ * Copyright (C) 2015, Jonathan Gillett
+ * All rights reserved.
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+#ifndef ASSIGN_H_
+#define ASSIGN_H_
+
+#include <stdio.h>
+#include <stdint.h>
+#include <gsl/gsl_matrix.h>
+
+// Rows of input read, assigned and written at a time
+#define ASSIGN_CHUNK 65536
+
+// Maximum characters of each line of CSV output
+#define ASSIGN_WIDTH 32
+
+/**
+ * @struct assign_config
+ * @brief How the input is streamed through nearest_centroids()
+ */
+typedef struct
+{
+    int64_t binary_in;      /**< Non-zero if the input is rows of raw doubles, else CSV */
+    int64_t binary_out;     /**< Non-zero to write each label as a raw uint32_t followed
+                                 by the distance as a raw double, else CSV */
+    int64_t distances;      /**< Non-zero to write the distance of each row to its centroid */
+    int64_t threads;        /**< Threads to parse and assign, 0 for the OpenMP default */
+} assign_config;
+
+/**
+ * @struct assign_stats
+ * @brief The rows streamed and the seconds spent in each stage
+ */
+typedef struct
+{
+    uint64_t rows;          /**< The rows assigned */
+    double read_time;       /**< Seconds reading and parsing the input */
+    double assign_time;     /**< Seconds in nearest_centroids() */
+    double write_time;      /**< Seconds formatting and writing the output */
+} assign_stats;
+
+
+/**
+ * Streams the input in chunks of ASSIGN_CHUNK rows, assigning each row to the
+ * nearest centroid and writing its label, and optionally its distance, in the
+ * order of the input. CSV input is parsed by all of the threads.
+ *
+ * @param centroids Pointer to matrix containing the centroids, the input has
+ *                  the same number of columns
+ * @param in        The input stream
+ * @param out       The output stream
+ * @param config    Pointer to the configuration
+ * @param stats     Pointer to the stats, populated by function
+ *
+ * @return          The status code, 0 for SUCCESS, 1 for ERROR
+ */
+extern int assign_stream(gsl_matrix *centroids, FILE *in, FILE *out, const assign_config *config,
+                         assign_stats *stats);
+
+
+#endif /* ASSIGN_H_ */
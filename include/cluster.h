@@ -20,22 +20,120 @@
 #ifndef CLUSTER_H_
 #define CLUSTER_H_
 
+#include <stdint.h>
+#include <stdbool.h>
 #include <gsl/gsl_matrix.h>
 #include "pcg_basic.h"
+#include "kdtree.h"
+
+// Rows sampled from each stream of the PRNG in a round of k-means||
+#define KMEANS_PARALLEL_BLOCK 4096
+
+// Iterations of Lloyd's algorithm when the budget does not cap them
+#define LLOYD_MAX_ITER 10000
+
+// Dimensions summed between checks of the partial distance against the best
+#define PDS_BLOCK 8
+
+// Centroids from which nearest_centroids() sums the distances in SIMD lanes
+// across the centroids rather than with the fixed dimension kernels
+#define NEAREST_MIN_CLUSTERS 8
+
+/**
+ * @struct lloyd_budget
+ * @brief When Lloyd's algorithm stops before the centroids converge exactly
+ */
+typedef struct
+{
+    uint32_t max_iter;          /**< Maximum iterations, 0 for LLOYD_MAX_ITER */
+    double shift_tol;           /**< Stop once the summed squared distance the
+                                     centroids moved is at most this */
+    double min_changed;         /**< Stop once the fraction of rows that changed
+                                     cluster is at most this, 0 to disable */
+} lloyd_budget;
+
+/**
+ * @struct match_pair
+ * @brief A centroid, a reference centroid and their squared distance
+ */
+typedef struct
+{
+    double dist;                /**< The squared distance between the centroids */
+    uint32_t a;                 /**< The row of the centroid */
+    uint32_t b;                 /**< The row of the reference centroid */
+} match_pair;
+
+/**
+ * @struct match_scratch
+ * @brief The memory used to match the centroids of two clusterings, allocated
+ *        once for the maximum number of clusters and reused by every match
+ */
+typedef struct
+{
+    uint32_t n_clusters;        /**< The maximum number of clusters */
+    match_pair *pairs;          /**< Every pair of centroids, n_clusters x n_clusters */
+    uint32_t *map;              /**< A map of n_clusters rows for the caller */
+    bool *matched;              /**< True once the centroid is matched */
+    bool *used;                 /**< True once the reference centroid is matched */
+} match_scratch;
 
 /**
- * Performs Lloyd's algorithm using random initial centroids.
+ * @enum trials_select
+ * @brief How the final clustering is chosen from the trials of Lloyd's
+ *        algorithm with random initial centroids
+ */
+typedef enum
+{
+    TRIALS_SSE          = 0,    /**< The trial with the lowest sum of squared errors */
+    TRIALS_FITNESS      = 1,    /**< The trial with the highest Dunn Index */
+    TRIALS_CONSENSUS    = 2     /**< The majority cluster of each row over all trials,
+                                     with the labels aligned to the lowest SSE trial */
+} trials_select;
+
+/**
+ * @enum init_method
+ * @brief How the centroids of each chromosome in the initial population
+ *        are generated
+ */
+typedef enum
+{
+    INIT_RANDOM         = 0,    /**< Uniform within the bounds of each dimension */
+    INIT_KMEANSPP       = 1,    /**< k-means++, rows drawn by squared distance */
+    INIT_KMEANS_PARALLEL = 2    /**< k-means||, oversampled rounds reclustered with k-means++ */
+} init_method;
+
+/**
+ * @enum mutate_method
+ * @brief How a chromosome is mutated
+ */
+typedef enum
+{
+    MUTATE_RANDOM       = 0,    /**< A random value within the bounds of a dimension */
+    MUTATE_RESAMPLE     = 1     /**< A centroid replaced by a row drawn by squared distance */
+} mutate_method;
+
+
+/**
+ * Performs Lloyd's algorithm using random initial centroids, the trials are
+ * executed in parallel and each draws from a separate stream of the PRNG.
  *
  * @param trials     Number of trials to perform
  * @param data       Pointer to matrix containing the data
  * @param n_clusters The number of clusters
- * @param clusters   Pointer to array of matrices containing data in clusters
+ * @param select     How the final clustering is chosen, see trials_select
+ * @param threads    The number of threads to use
+ * @param centroids  Pointer to matrix for the final centroids, may be NULL
+ * @param clusters   Pointer to array of matrices containing data in clusters, each
+ *                   must be NULL or a matrix from a previous call which is freed,
+ *                   may be NULL
  * @param rng        Pointer to the random number generator
+ * @param weights    The number of rows each row of data stands for, NULL for 1
  * 
  * @return      The status code, 0 for SUCCESS, 1 for ERROR
  */
-extern int lloyd_random(int trials, gsl_matrix *data, int n_clusters,
-                        gsl_matrix **clusters, pcg32_random_t *rng);
+extern int lloyd_random(int trials, gsl_matrix *data, int n_clusters, int select, int threads,
+                        gsl_matrix *centroids, gsl_matrix **clusters, pcg32_random_t *rng,
+                        const uint32_t *weights);
 
 
 /**
@@ -45,12 +143,143 @@ extern int lloyd_random(int trials, gsl_matrix *data, int n_clusters,
  * @param centroids  Pointer to matrix containing the centroids
  * @param data       Pointer to matrix containing the data
  * @param n_clusters The number of clusters
- * @param clusters   Pointer to array of matrices containing data in clusters
+ * @param clusters   Pointer to array of matrices containing data in clusters, each
+ *                   must be NULL or a matrix from a previous call which is freed
+ * @param budget     When to stop before the centroids converge, NULL to run
+ *                   until convergence or LLOYD_MAX_ITER iterations
+ * @param tree       The kd-tree of the data to assign the rows by filtering the
+ *                   centroids, NULL to compare every row with every centroid
+ * @param weights    The number of rows each row of data stands for, NULL for 1,
+ *                   the kd-tree must be built with the same weights
  * 
  * @return      The status code, 0 for SUCCESS, 1 for ERROR
  */
 extern int lloyd_defined(int trials, gsl_matrix *centroids, gsl_matrix *data, 
-                         int n_clusters, gsl_matrix **clusters);
+                         int n_clusters, gsl_matrix **clusters, const lloyd_budget *budget,
+                         const kd_tree *tree, const uint32_t *weights);
+
+
+/**
+ * Assigns each data point to the cluster with the nearest centroid, this is
+ * the assignment pass of each iteration of Lloyd's algorithm.
+ *
+ * @param data      Pointer to matrix containing the data
+ * @param centroids Pointer to matrix containing the centroids
+ * @param labels    Cluster assignment for each row of data, populated by function
+ * @param counts    Number of rows assigned to each cluster, populated by function
+ */
+extern void assign_clusters(gsl_matrix *data, gsl_matrix *centroids, uint32_t *labels,
+                            uint32_t *counts);
+
+
+/**
+ * Assigns each row of new data to the nearest of a trained set of centroids.
+ * The rows are split over the threads and the centroids are transposed so the
+ * squared distances from a row to every centroid are summed in SIMD lanes,
+ * ties go to the last centroid as in assign_clusters().
+ *
+ * @param data      Pointer to matrix containing the data
+ * @param centroids Pointer to matrix containing the centroids
+ * @param labels    The nearest centroid of each row of data, populated by function
+ * @param distances The Euclidean distance from each row of data to its nearest
+ *                  centroid, populated by function, may be NULL
+ * @param threads   The number of threads, 0 for the OpenMP default
+ *
+ * @return          The status code, 0 for SUCCESS, 1 for ERROR
+ */
+extern int nearest_centroids(gsl_matrix *data, gsl_matrix *centroids, uint32_t *labels,
+                             double *distances, int threads);
+
+
+/**
+ * Performs Lloyd's algorithm for every chromosome of a population at once,
+ * each block of rows is streamed through the cache once per iteration and
+ * evaluated against the centroids of all active chromosomes. Chromosomes
+ * drop out of the batch as they converge or spend their budget.
+ *
+ * @param data       Pointer to matrix containing the data
+ * @param population The population, each chromosome is n_clusters x cols
+ *                   centroids, updated in place
+ * @param stride     The number of doubles between chromosomes in the population
+ * @param size       The size of the population
+ * @param n_clusters The number of clusters
+ * @param block_rows The number of rows in each block
+ * @param threads    The number of threads to use
+ * @param skip       True for each chromosome that is already evaluated and is
+ *                   left unchanged, may be NULL
+ * @param budget     When to stop before the centroids converge, may be NULL
+ * @param caps       The maximum iterations of each chromosome, NULL for the
+ *                   maximum of the budget
+ * @param ks         The number of clusters of each chromosome, at most n_clusters,
+ *                   NULL for n_clusters
+ * @param tree       The kd-tree of the data to assign the rows by filtering the
+ *                   centroids of each chromosome instead of streaming blocks,
+ *                   may be NULL
+ * @param order      The dimensions by decreasing variance from calc_dim_order()
+ *                   to sum the distances in, abandoning each centroid once the
+ *                   partial distance exceeds the nearest so far, NULL to sum
+ *                   every dimension of every distance
+ * @param weights    The number of rows each row of data stands for, NULL for 1,
+ *                   the kd-tree must be built with the same weights
+ *
+ * @return           The status code, 0 for SUCCESS, 1 for ERROR
+ */
+extern int lloyd_population(gsl_matrix *data, double *population, size_t stride, int size,
+                            int n_clusters, uint32_t block_rows, int threads, 
+                            const bool *skip, const lloyd_budget *budget,
+                            const uint32_t *caps, const uint32_t *ks, const kd_tree *tree,
+                            const uint32_t *order, const uint32_t *weights);
+
+
+/**
+ * Assigns the data to the nearest of the centroids and copies it into the
+ * clusters without updating the centroids.
+ *
+ * @param centroids  Pointer to matrix containing the centroids
+ * @param data       Pointer to matrix containing the data
+ * @param n_clusters The number of clusters
+ * @param clusters   Pointer to array of matrices containing data in clusters, each
+ *                   must be NULL or a matrix from a previous call which is freed
+ *
+ * @return           The status code, 0 for SUCCESS, 1 for ERROR
+ */
+extern int build_clusters(gsl_matrix *centroids, gsl_matrix *data, int n_clusters,
+                          gsl_matrix **clusters);
+
+
+/**
+ * Allocates the memory to match the centroids of two clusterings.
+ *
+ * @param n_clusters The maximum number of clusters to match
+ *
+ * @return           The scratch memory, NULL on ERROR
+ */
+extern match_scratch *match_alloc(uint32_t n_clusters);
+
+
+/**
+ * Frees the memory to match centroids.
+ *
+ * @param scratch The scratch memory, may be NULL
+ */
+extern void match_free(match_scratch *scratch);
+
+
+/**
+ * Matches each centroid with a centroid of the reference by greedily pairing
+ * the closest remaining centroids, since the order of the centroids of each
+ * clustering is an arbitrary permutation of the clusters. Every pair is
+ * sorted by distance once, ties by row, and then taken in order if neither
+ * centroid is matched, O(k^2 log k) for k clusters.
+ *
+ * @param centroids Pointer to matrix containing the centroids to match
+ * @param reference Pointer to matrix containing the reference centroids
+ * @param map       The matching reference row for each row of the centroids,
+ *                  populated by function
+ * @param scratch   The scratch memory for at least the rows of the centroids
+ */
+extern void match_centroids(gsl_matrix *centroids, gsl_matrix *reference, uint32_t *map,
+                            match_scratch *scratch);
 
 
 /**
@@ -78,6 +307,19 @@ extern int calc_centroids(gsl_matrix *centroids, gsl_matrix *data, int n_cluster
 extern int calc_bounds(gsl_matrix *data, gsl_matrix *bounds);
 
 
+/**
+ * Orders the dimensions of the data by decreasing variance, so the partial
+ * distances grow fastest when summed in this order.
+ *
+ * @param  data  Point to matrix containing the data
+ * @param  order The index of each dimension by decreasing variance, populated
+ *               by function
+ *
+ * @return       The status code, 0 for SUCCESS, 1 for ERROR
+ */
+extern int calc_dim_order(gsl_matrix *data, uint32_t *order);
+
+
 /**
  * Generates random centroids within the bounds for each dimension.
  *
@@ -91,4 +333,53 @@ extern int random_centroids(gsl_matrix *centroids, gsl_matrix *bounds,
                             pcg32_random_t *rng);
 
 
+/**
+ * Generates the centroids with k-means++, the first centroid is a random row
+ * of data and each of the rest is a row drawn with probability proportional
+ * to its squared distance from the nearest centroid so far.
+ *
+ * @param  centroids Pointer to matrix containing centroids to be updated
+ * @param  data      Pointer to matrix containing the data
+ * @param  threads   The number of threads to update the distances with
+ * @param  rng       Pointer to the random number generator
+ *
+ * @return           The status code, 0 for SUCCESS, 1 for ERROR
+ */
+extern int kmeanspp_centroids(gsl_matrix *centroids, gsl_matrix *data, int threads,
+                              pcg32_random_t *rng);
+
+
+/**
+ * Generates the centroids with k-means||, each round samples every row
+ * independently with probability proportional to its squared distance,
+ * oversampling by twice the number of clusters. The candidates are then
+ * weighted by the rows nearest to them and reclustered with k-means++.
+ *
+ * @param  centroids Pointer to matrix containing centroids to be updated
+ * @param  data      Pointer to matrix containing the data
+ * @param  rounds    The number of sampling rounds
+ * @param  threads   The number of threads to sample with
+ * @param  rng       Pointer to the random number generator
+ *
+ * @return           The status code, 0 for SUCCESS, 1 for ERROR
+ */
+extern int kmeans_parallel_centroids(gsl_matrix *centroids, gsl_matrix *data, int rounds,
+                                     int threads, pcg32_random_t *rng);
+
+
+/**
+ * Replaces a centroid with a row of data drawn with probability proportional
+ * to its squared distance from the nearest of the other centroids.
+ *
+ * @param  centroids Pointer to matrix containing centroids to be updated
+ * @param  row       The centroid to replace
+ * @param  data      Pointer to matrix containing the data
+ * @param  rng       Pointer to the random number generator
+ *
+ * @return           The status code, 0 for SUCCESS, 1 for ERROR
+ */
+extern int resample_centroid(gsl_matrix *centroids, uint32_t row, gsl_matrix *data,
+                             pcg32_random_t *rng);
+
+
 #endif /* CLUSTER_H_ */
\ No newline at end of file
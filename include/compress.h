@@ -0,0 +1,46 @@
+/*
+ * Evolutionary K-means clustering (E-means) using Genetic Algorithms.
+ *
+ * Copyright (C) 2015, Jonathan Gillett
+ * All rights reserved.
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+#ifndef COMPRESS_H_
+#define COMPRESS_H_
+
+#include <stdint.h>
+#include <gsl/gsl_matrix.h>
+
+
+/**
+ * Collapses the rows of data that are exact duplicates, or that fall in the
+ * same cell of a grid, into weighted representatives. The representative of
+ * exact duplicates is the row itself and of a grid cell the mean of its rows,
+ * in the order of the first row of each.
+ *
+ * @param data    Pointer to matrix containing the data
+ * @param cell    The width of the cells of the grid in every dimension, 0 to
+ *                only collapse exact duplicates
+ * @param rep     The representative of each row of data, populated by function
+ * @param weights The number of rows each representative stands for, allocated
+ *                by function and freed by the caller
+ *
+ * @return        The representatives, NULL on ERROR
+ */
+extern gsl_matrix *compress_data(gsl_matrix *data, double cell, uint32_t *rep,
+                                 uint32_t **weights);
+
+
+#endif /* COMPRESS_H_ */
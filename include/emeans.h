@@ -0,0 +1,231 @@
+/*
+ * Evolutionary K-means clustering (E-means) using Genetic Algorithms.
+ *
+ * Copyright (C) 2015, Jonathan Gillett
+ * All rights reserved.
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+#ifndef EMEANS_H_
+#define EMEANS_H_
+
+#include <stdint.h>
+#include <stdbool.h>
+#include <gsl/gsl_matrix.h>
+
+/**
+ * @struct emeans_config
+ * @brief The parameters of the E-means genetic algorithm
+ */
+typedef struct
+{
+    int64_t n_clusters;     /**< The number of clusters, at least 2 */
+    int64_t k_min;          /**< The minimum number of clusters of each chromosome */
+    int64_t k_max;          /**< The maximum number of clusters of each chromosome, 0 for
+                                 n_clusters for every chromosome */
+    int64_t trials;         /**< Trials of Lloyd's algorithm from random centroids used to
+                                 seed the initial population, 1 for none */
+    int64_t trials_select;  /**< How the result of the trials is chosen, see trials_select */
+    int64_t init_method;    /**< How the initial population is generated, see init_method */
+    int64_t init_rounds;    /**< Sampling rounds for k-means|| initialization */
+    int64_t mutate_method;  /**< How chromosomes are mutated, see mutate_method */
+    int64_t crossover_method; /**< How parents are crossed over, see crossover_method */
+    int64_t size;           /**< The size of the population, must be even */
+    int64_t max_iter;       /**< Maximum number of generations for emeans_run() */
+    int64_t seed;           /**< Seed for the PRNG, 0 to seed from the current time */
+    int64_t threads;        /**< Threads to evaluate the population, 0 for the OpenMP default */
+    int64_t batch_kb;       /**< KiB of rows per block when evaluating the whole population
+                                 in one pass over the data, 0 to evaluate each chromosome
+                                 separately */
+    int64_t kdtree;         /**< Non-zero to assign the rows with the filtering algorithm over
+                                 a kd-tree of the data, suited to low-dimensional data */
+    int64_t pds;            /**< Non-zero to assign each block of rows with a partial distance
+                                 search over the dimensions by decreasing variance */
+    int64_t steady_state;   /**< Non-zero for a steady-state GA, each step then performs a
+                                 population size worth of evaluations without barriers */
+    int64_t selection;      /**< How parents are selected, see select_method */
+    int64_t tournament;     /**< Tournament size for tournament selection and the
+                                 steady-state GA */
+    int64_t elitism;        /**< The fittest chromosomes carried over unchanged to the next
+                                 generation with their fitness */
+    double  dup_tol;        /**< Squared distance between the sorted centroids of two
+                                 chromosomes, relative to the bounds, within which an
+                                 offspring is replaced as a duplicate, negative to disable */
+    int64_t plateau;        /**< Generations without a new best before terminating, 0 to
+                                 disable */
+    double  min_diversity;  /**< Population diversity, relative to the bounds, below which
+                                 the population has collapsed and E-means terminates, 0 to
+                                 disable */
+    double  target_fitness; /**< Fitness at which E-means terminates, 0 to disable */
+    double  time_limit;     /**< Seconds after the job started to terminate, checked between
+                                 generations, 0 to disable */
+    int64_t lloyd_max_iter; /**< Maximum Lloyd's iterations per evaluation, 0 for no cap */
+    int64_t lloyd_min_iter; /**< Lloyd's iterations of new chromosomes with lloyd_adaptive */
+    int64_t lloyd_adaptive; /**< Non-zero to cap the Lloyd's iterations of each offspring
+                                 between lloyd_min_iter and lloyd_max_iter by the fitness
+                                 rank of its parents */
+    double  lloyd_tol;      /**< Stop Lloyd's once the squared distance the centroids move,
+                                 relative to the total variance of the data, is at most this */
+    double  lloyd_min_changed; /**< Stop Lloyd's once the fraction of rows changing cluster
+                                    is at most this, 0 to disable */
+    double  m_rate;         /**< Mutation rate */
+    double  c_rate;         /**< Crossover rate */
+    double  k_rate;         /**< Rate of adding or removing a centroid of an offspring */
+} emeans_config;
+
+/**
+ * @enum emeans_term
+ * @brief Why E-means terminated
+ */
+typedef enum
+{
+    EMEANS_RUNNING      = 0,    /**< No termination policy has been met */
+    EMEANS_MAX_ITER     = 1,    /**< The maximum number of generations was reached */
+    EMEANS_PLATEAU      = 2,    /**< No new best for the plateau number of generations */
+    EMEANS_COLLAPSED    = 3,    /**< The population diversity fell below the minimum */
+    EMEANS_TARGET       = 4,    /**< The target fitness was reached */
+    EMEANS_DEADLINE     = 5,    /**< The time limit was reached */
+    EMEANS_STOPPED      = 6     /**< emeans_stop() was called */
+} emeans_term;
+
+/**
+ * @struct emeans_result
+ * @brief The best solution found by E-means, the centroids and labels are
+ *        owned by the context and valid until it is reset or freed
+ */
+typedef struct
+{
+    double fitness;         /**< The fitness of the best chromosome */
+    gsl_matrix *centroids;  /**< The centroids of the best chromosome */
+    uint32_t *labels;       /**< The cluster of each row of data for the best chromosome */
+    int64_t generations;    /**< The number of generations executed, fewer than max_iter
+                                 if another termination policy was met */
+    double run_time;        /**< Seconds spent executing generations, excluding the
+                                 creation of the context and the initial population */
+    bool improved;          /**< True if the last generation found a new best */
+    emeans_term term;       /**< Why E-means terminated, set by emeans_done() */
+} emeans_result;
+
+/**
+ * The opaque E-means context, holds the configuration, a reference to the
+ * preloaded data and the population, which repeated jobs on the same data
+ * reuse. The clusters of each evaluation are still allocated by Lloyd's
+ * algorithm, and the counters of stats.h and the trace are process-wide, so
+ * contexts running at the same time share them.
+ */
+typedef struct emeans_ctx emeans_ctx;
+
+
+/**
+ * Populates the configuration with the default parameters.
+ *
+ * @param config Pointer to the configuration to populate
+ */
+extern void emeans_defaults(emeans_config *config);
+
+
+/**
+ * Creates an E-means context for the data and generates the initial population.
+ *
+ * @param config  Pointer to the configuration, copied into the context
+ * @param data    Pointer to matrix containing the data, must outlive the context
+ * @param weights The number of rows each row of data stands for, NULL for 1,
+ *                must outlive the context
+ *
+ * @return        The context, NULL on ERROR
+ */
+extern emeans_ctx *emeans_create(emeans_config *config, gsl_matrix *data,
+                                 const uint32_t *weights);
+
+
+/**
+ * Starts a new job on the same data, the memory of the context is reused
+ * unless the number of clusters or the size of the population has changed.
+ *
+ * @param ctx    Pointer to the context
+ * @param config Pointer to the configuration for the new job
+ *
+ * @return       The status code, 0 for SUCCESS, 1 for ERROR
+ */
+extern int emeans_reset(emeans_ctx *ctx, emeans_config *config);
+
+
+/**
+ * Executes a single generation, evaluating the population and then breeding
+ * the next generation with selection, crossover and mutation. In the
+ * steady-state mode a generation is a population size worth of evaluations
+ * of single offspring.
+ *
+ * @param ctx    Pointer to the context
+ * @param result Pointer to the best result so far, populated by function
+ *
+ * @return       The status code, 0 for SUCCESS, 1 for ERROR
+ */
+extern int emeans_step(emeans_ctx *ctx, emeans_result *result);
+
+
+/**
+ * Checks each of the termination policies of the configuration.
+ *
+ * @param ctx    Pointer to the context
+ * @param result Pointer to the result, the reason for termination is set
+ *
+ * @return       True if E-means should terminate
+ */
+extern bool emeans_done(emeans_ctx *ctx, emeans_result *result);
+
+
+/**
+ * Requests that E-means terminates, the current generation is completed and
+ * emeans_done() then returns true. The steady-state mode stops starting new
+ * evaluations. Only sets a flag, so it is safe to call from a signal handler.
+ *
+ * @param ctx Pointer to the context
+ */
+extern void emeans_stop(emeans_ctx *ctx);
+
+
+/**
+ * Executes generations until a termination policy is met.
+ *
+ * @param ctx    Pointer to the context
+ * @param result Pointer to the best result found, populated by function
+ *
+ * @return       The status code, 0 for SUCCESS, 1 for ERROR
+ */
+extern int emeans_run(emeans_ctx *ctx, emeans_result *result);
+
+
+/**
+ * Permutes the rows of the data in place between generations, along with the
+ * labels of the best chromosome and the kd-tree of the data. The weights of
+ * the rows must already be permuted.
+ *
+ * @param ctx  Pointer to the context
+ * @param perm The row of data that is moved to each row, see reorder.h
+ *
+ * @return     The status code, 0 for SUCCESS, 1 for ERROR
+ */
+extern int emeans_permute(emeans_ctx *ctx, const uint32_t *perm);
+
+
+/**
+ * Frees the context and all of the memory it owns, the data is not freed.
+ *
+ * @param ctx Pointer to the context
+ */
+extern void emeans_free(emeans_ctx *ctx);
+
+
+#endif /* EMEANS_H_ */
@@ -21,6 +21,7 @@
 #define IO_H_
 
 #include <gsl/gsl_matrix.h>
+#include "emeans.h"
 
 
 /**
@@ -35,21 +36,33 @@ extern int load_data(char *input, gsl_matrix *data);
 
 
 /**
- * Save the chromosome and fitness value if they are better than previous.
- *
- * @param output     Path to save the optimal fitness value
- * @param output2    Path to save the optimal fitness centroids
- * @param output3    Path to save the optimal cluster results
- * @param size       Size of the populations
- * @param fitness    Pointer to array of fitness values for the population
- * @param population Population of all chromosomes
- * @param n_clusters The number of clusters
- * @param clusters   The clusters for each chromosome in the population
+ * Loads the centroids saved by save_results(), the number of centroids and
+ * columns is found from the file. Nothing is printed to stdout so the labels
+ * may be streamed to stdout.
+ *
+ * @param input The centroids file to load
+ *
+ * @return      Pointer to matrix containing the centroids, NULL on ERROR
+ */
+extern gsl_matrix *load_centroids(char *input);
+
+
+/**
+ * Save the best chromosome, its fitness value and the clustering of the data.
+ *
+ * @param output  Path to save the optimal fitness value
+ * @param output2 Path to save the optimal fitness centroids
+ * @param output3 Path to save the optimal cluster results
+ * @param result  Pointer to the best result found by E-means
+ * @param data    Pointer to matrix containing the data
+ * @param index   The row of the data file of each row of data when the data
+ *                is reordered, the clustering is saved in the order of the
+ *                data file, NULL if the data is not reordered
  * 
- * @return           The status code, 0 for SUCCESS, 1 for ERROR
+ * @return        The status code, 0 for SUCCESS, 1 for ERROR
  */
-extern int save_results(char *output, char *output2, char *output3, int size, double fitness[size], 
-                        gsl_matrix **population, int n_clusters, gsl_matrix ***clusters);
+extern int save_results(char *output, char *output2, char *output3, emeans_result *result,
+                        gsl_matrix *data, const uint32_t *index);
 
 
 #endif /* IO_H_ */
\ No newline at end of file
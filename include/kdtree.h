@@ -0,0 +1,107 @@
+/*
+ * Evolutionary K-means clustering (E-means) using Genetic Algorithms.
+ *
+ * Copyright (C) 2015, Jonathan Gillett
+ * All rights reserved.
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+#ifndef KDTREE_H_
+#define KDTREE_H_
+
+#include <stdint.h>
+#include <gsl/gsl_matrix.h>
+
+// The maximum number of rows in a leaf of the kd-tree
+#define KD_LEAF_SIZE 16
+
+/**
+ * @struct kd_node
+ * @brief A cell of the kd-tree, the rows of the cell are a contiguous range
+ *        of the index of the tree
+ */
+typedef struct
+{
+    uint32_t lo;            /**< The first row of the cell in the index */
+    uint32_t hi;            /**< One past the last row of the cell in the index */
+    int32_t left;           /**< The left child, -1 for a leaf */
+    int32_t right;          /**< The right child, -1 for a leaf */
+    uint32_t count;         /**< The number of rows the cell stands for */
+} kd_node;
+
+/**
+ * @struct kd_tree
+ * @brief A kd-tree over the rows of the data with the bounding box and the
+ *        sum of the rows of each cell, built once and shared read only by
+ *        every chromosome
+ */
+typedef struct
+{
+    kd_node *nodes;         /**< The cells, the root is the first */
+    uint32_t n_nodes;       /**< The number of cells */
+    uint32_t cols;          /**< The number of columns of the data */
+    uint32_t *index;        /**< The rows of the data in the order of the cells */
+    double *bounds;         /**< The min and max of each column of each cell,
+                                 n_nodes x 2 x cols */
+    double *sums;           /**< The sum of the rows of each cell, n_nodes x cols */
+    const uint32_t *weights; /**< The number of rows each row of data stands for,
+                                 NULL for 1 */
+} kd_tree;
+
+
+/**
+ * Builds a kd-tree over the rows of the data, each cell is split at the
+ * median of its widest column until it has at most KD_LEAF_SIZE rows.
+ *
+ * @param data    Pointer to matrix containing the data
+ * @param weights The number of rows each row of data stands for, NULL for 1,
+ *                kept by the tree and not copied
+ *
+ * @return        The kd-tree, NULL on ERROR
+ */
+extern kd_tree *kd_build(gsl_matrix *data, const uint32_t *weights);
+
+
+/**
+ * Frees the kd-tree.
+ *
+ * @param tree The kd-tree, may be NULL
+ */
+extern void kd_free(kd_tree *tree);
+
+
+/**
+ * Performs the assignment pass of Lloyd's algorithm with the filtering
+ * algorithm of Kanungo et al. The candidate centroids are filtered on the
+ * way down the tree, a candidate is pruned from a cell once it is farther
+ * than the candidate nearest the midpoint of the cell from every point of
+ * the cell, and a cell with a single candidate adds its cached sum and count
+ * without visiting its rows. Safe to call from any number of threads.
+ *
+ * @param tree      The kd-tree of the data
+ * @param data      Pointer to matrix containing the data
+ * @param centroids Pointer to matrix containing the centroids
+ * @param sums      The n_clusters x cols sums of the rows in each cluster,
+ *                  populated by function
+ * @param counts    The number of rows in each cluster, populated by function
+ * @param labels    The cluster of each row of data from the previous pass,
+ *                  updated by function, may be NULL
+ *
+ * @return          The number of rows that changed cluster, 0 if labels is NULL
+ */
+extern uint32_t kd_assign(const kd_tree *tree, gsl_matrix *data, gsl_matrix *centroids,
+                          double *sums, uint32_t *counts, uint32_t *labels);
+
+
+#endif /* KDTREE_H_ */
@@ -0,0 +1,97 @@
+/*
+ * Evolutionary K-means clustering (E-means) using Genetic Algorithms.
+ *
+ * Copyright (C) 2015, Jonathan Gillett
+ * All rights reserved.
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+#ifndef ONLINE_H_
+#define ONLINE_H_
+
+#include <stdint.h>
+#include <gsl/gsl_matrix.h>
+#include "pcg_basic.h"
+
+/**
+ * @struct online_model
+ * @brief The centroids updated by sequential k-means one row at a time and a
+ *        uniform reservoir sample of every row seen
+ */
+typedef struct
+{
+    gsl_matrix *centroids;  /**< The current centroids, n_clusters x cols */
+    double *counts;         /**< The decayed number of rows of each centroid */
+    double decay;           /**< The factor each count decays by before its centroid is
+                                 updated, 1 for the plain running mean */
+    uint32_t n_init;        /**< The centroids initialized from the first distinct rows */
+    gsl_matrix *reservoir;  /**< The reservoir sample of the rows */
+    uint32_t filled;        /**< The rows of the reservoir filled */
+    uint64_t seen;          /**< The rows seen */
+    pcg32_random_t rng;     /**< The random number generator of the reservoir */
+} online_model;
+
+
+/**
+ * Creates an online model, the centroids are initialized from the first
+ * distinct rows seen.
+ *
+ * @param n_clusters The number of clusters
+ * @param cols       The number of columns of the rows
+ * @param decay      The factor each count decays by before its centroid is updated
+ * @param reservoir  The number of rows of the reservoir sample
+ * @param seed       Seed for the random number generator of the reservoir
+ *
+ * @return           The model, NULL on ERROR
+ */
+extern online_model *online_create(uint32_t n_clusters, uint32_t cols, double decay,
+                                   uint32_t reservoir, uint64_t seed);
+
+
+/**
+ * Updates the model with a row, the nearest centroid moves towards the row by
+ * the inverse of its decayed count and the row is offered to the reservoir
+ * by Algorithm R. The learning rate never falls below 1 - decay, so the
+ * centroids track data that drifts.
+ *
+ * @param model Pointer to the model
+ * @param row   The row, the same number of columns as the centroids
+ *
+ * @return      The nearest centroid of the row, before the update
+ */
+extern uint32_t online_update(online_model *model, const double *row);
+
+
+/**
+ * Replaces the centroids of the model, such as with a clustering of the
+ * reservoir found by E-means. The number of clusters may differ.
+ *
+ * @param model     Pointer to the model
+ * @param centroids Pointer to matrix containing the new centroids
+ * @param counts    The initial count of each new centroid
+ *
+ * @return          The status code, 0 for SUCCESS, 1 for ERROR
+ */
+extern int online_replace(online_model *model, gsl_matrix *centroids, const double *counts);
+
+
+/**
+ * Frees the model.
+ *
+ * @param model Pointer to the model
+ */
+extern void online_free(online_model *model);
+
+
+#endif /* ONLINE_H_ */
@@ -20,8 +20,21 @@
 #ifndef OPERATORS_H_
 #define OPERATORS_H_
 
+#include <stdint.h>
 #include <gsl/gsl_matrix.h>
 #include "pcg_basic.h"
+#include "cluster.h"
+
+/**
+ * @enum crossover_method
+ * @brief How the centroids of two parents are exchanged
+ */
+typedef enum
+{
+    CROSSOVER_CUT       = 0,    /**< Swap the rows on one side of a random cut */
+    CROSSOVER_ALIGNED   = 1,    /**< Align the centroids, then swap around a random cut */
+    CROSSOVER_UNIFORM   = 2     /**< Align the centroids, then swap each with even odds */
+} crossover_method;
 
 /**
  * Performs chromosome crossover by randomly selecting a crossover point and
@@ -35,6 +48,59 @@
 extern void crossover(gsl_matrix *parent1, gsl_matrix *parent2, pcg32_random_t *rng);
 
 
+/**
+ * Reorders the centroids of the second parent so that each row is matched
+ * with the nearest centroid in the same row of the first parent.
+ *
+ * @param  parent1 The first parent chromosome
+ * @param  parent2 The second parent chromosome, reordered by function
+ * @param  scratch The scratch memory to match the centroids, see match_alloc()
+ */
+extern void align_centroids(gsl_matrix *parent1, gsl_matrix *parent2, match_scratch *scratch);
+
+
+/**
+ * Performs chromosome crossover after aligning the centroids of the parents,
+ * so that the crossover exchanges corresponding clusters.
+ *
+ * @param  parent1 The first parent chromosome
+ * @param  parent2 The second parent chromosome
+ * @param  scratch The scratch memory to match the centroids, see match_alloc()
+ * @param  rng     Pointer to the random number generator
+ */
+extern void crossover_aligned(gsl_matrix *parent1, gsl_matrix *parent2, match_scratch *scratch,
+                              pcg32_random_t *rng);
+
+
+/**
+ * Performs uniform crossover after aligning the centroids of the parents,
+ * each pair of matched centroids is swapped with even odds.
+ *
+ * @param  parent1 The first parent chromosome
+ * @param  parent2 The second parent chromosome
+ * @param  scratch The scratch memory to match the centroids, see match_alloc()
+ * @param  rng     Pointer to the random number generator
+ */
+extern void crossover_uniform(gsl_matrix *parent1, gsl_matrix *parent2, match_scratch *scratch,
+                              pcg32_random_t *rng);
+
+
+/**
+ * Performs two point crossover of parents with a different number of
+ * centroids, the rows after a random cut in each parent are exchanged so the
+ * number of centroids of the children lies within the range. The rows of
+ * each parent must be allocated for k_max centroids.
+ *
+ * @param  parent1 The first parent chromosome, resized by function
+ * @param  parent2 The second parent chromosome, resized by function
+ * @param  k_min   The minimum number of centroids
+ * @param  k_max   The maximum number of centroids
+ * @param  rng     Pointer to the random number generator
+ */
+extern void crossover_variable(gsl_matrix *parent1, gsl_matrix *parent2, uint32_t k_min,
+                               uint32_t k_max, pcg32_random_t *rng);
+
+
 /**
  * Performs mutation, selects a random row and column in the chromosome and
  * mutates it to a random value within the min/max bounds.
@@ -46,4 +112,32 @@ extern void crossover(gsl_matrix *parent1, gsl_matrix *parent2, pcg32_random_t *
 extern void mutate(gsl_matrix *chromosome, gsl_matrix *bounds, pcg32_random_t *rng);
 
 
+/**
+ * Performs mutation by resampling, selects a random centroid in the chromosome
+ * and replaces it with a row of data drawn by its squared distance from the
+ * other centroids, as in k-means++.
+ *
+ * @param  chromosome The chromosome
+ * @param  data       Pointer to matrix containing the data
+ * @param  rng        Pointer to the random number generator
+ */
+extern void mutate_resample(gsl_matrix *chromosome, gsl_matrix *data, pcg32_random_t *rng);
+
+
+/**
+ * Performs mutation of the number of centroids, with even odds either adds a
+ * centroid drawn from the data by its squared distance from the others or
+ * removes a random centroid, keeping the number of centroids within the
+ * range. The rows of the chromosome must be allocated for k_max centroids.
+ *
+ * @param  chromosome The chromosome, resized by function
+ * @param  data       Pointer to matrix containing the data
+ * @param  k_min      The minimum number of centroids
+ * @param  k_max      The maximum number of centroids
+ * @param  rng        Pointer to the random number generator
+ */
+extern void mutate_k(gsl_matrix *chromosome, gsl_matrix *data, uint32_t k_min, uint32_t k_max,
+                     pcg32_random_t *rng);
+
+
 #endif /* OPERATORS_H_ */
\ No newline at end of file
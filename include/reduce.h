@@ -0,0 +1,93 @@
+/*
+ * Evolutionary K-means clustering (E-means) using Genetic Algorithms.
+ *
+ * Copyright (C) 2015, Jonathan Gillett
+ * All rights reserved.
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+#ifndef REDUCE_H_
+#define REDUCE_H_
+
+#include <stdint.h>
+#include <gsl/gsl_matrix.h>
+#include "pcg_basic.h"
+
+// Rows of data centred and projected at a time by PCA
+#define REDUCE_BLOCK 1024
+
+/**
+ * @enum reduce_kind
+ * @brief How the data is projected to fewer dimensions before clustering
+ */
+typedef enum
+{
+    REDUCE_NONE         = 0,    /**< Cluster the data in the full space */
+    REDUCE_RANDOM       = 1,    /**< Sparse random projection, Johnson-Lindenstrauss */
+    REDUCE_PCA          = 2     /**< Truncated principal component analysis */
+} reduce_kind;
+
+
+/**
+ * Projects the data to fewer dimensions with a sparse random projection, each
+ * entry of the projection is sqrt(3 / dims) times +1 or -1 with probability
+ * 1/6 each and 0 otherwise, which preserves the pairwise distances within a
+ * small factor with high probability.
+ *
+ * @param data    Pointer to matrix containing the data
+ * @param reduced Pointer to matrix for the projected data, rows x dims
+ * @param threads The number of threads, 0 for the OpenMP default
+ * @param rng     Pointer to the random number generator
+ *
+ * @return        The status code, 0 for SUCCESS, 1 for ERROR
+ */
+extern int random_projection(gsl_matrix *data, gsl_matrix *reduced, int threads,
+                             pcg32_random_t *rng);
+
+
+/**
+ * Projects the centred data onto its leading principal components, the
+ * eigenvectors of the covariance matrix with the largest eigenvalues found
+ * with the LAPACK routine dsyevr.
+ *
+ * @param data    Pointer to matrix containing the data
+ * @param reduced Pointer to matrix for the projected data, rows x dims
+ *
+ * @return        The status code, 0 for SUCCESS, 1 for ERROR
+ */
+extern int pca_projection(gsl_matrix *data, gsl_matrix *reduced);
+
+
+/**
+ * Refines a clustering found in a reduced space in the full space of the
+ * data, the centroids start as the means of the rows of each cluster, empty
+ * clusters start at a random row, and are then updated with Lloyd's algorithm.
+ *
+ * @param data      Pointer to matrix containing the data
+ * @param labels    The cluster of each row of data in the reduced space
+ * @param centroids Pointer to matrix for the full space centroids, n_clusters x cols
+ * @param refined   The cluster of each row of data in the full space, populated
+ *                  by function
+ * @param fitness   The fitness of the refined clustering, populated by function
+ * @param rng       Pointer to the random number generator
+ * @param weights   The number of rows each row of data stands for, NULL for 1
+ *
+ * @return          The status code, 0 for SUCCESS, 1 for ERROR
+ */
+extern int refine_clustering(gsl_matrix *data, const uint32_t *labels, gsl_matrix *centroids,
+                             uint32_t *refined, double *fitness, pcg32_random_t *rng,
+                             const uint32_t *weights);
+
+
+#endif /* REDUCE_H_ */
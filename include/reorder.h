@@ -0,0 +1,105 @@
+/*
+ * Evolutionary K-means clustering (E-means) using Genetic Algorithms.
+ *
+ * Copyright (C) 2015, Jonathan Gillett
+ * All rights reserved.
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+#ifndef REORDER_H_
+#define REORDER_H_
+
+#include <stdint.h>
+#include <gsl/gsl_matrix.h>
+
+// Bits of each dimension interleaved into the Morton code of a row
+#define MORTON_MAX_BITS 16
+
+/**
+ * @enum reorder_kind
+ * @brief How the rows of data are reordered so rows that cluster together
+ *        are close together in memory
+ */
+typedef enum
+{
+    REORDER_NONE        = 0,    /**< Keep the order of the data file */
+    REORDER_MORTON      = 1,    /**< Sort by the Morton code of each row at load time */
+    REORDER_CLUSTER     = 2     /**< Sort by the best clustering of the first generation */
+} reorder_kind;
+
+
+/**
+ * Orders the rows of data along the Morton (Z-order) curve, the bits of the
+ * dimensions with the largest variance are interleaved first into a 64 bit
+ * code and the rows are sorted by their codes.
+ *
+ * @param data Pointer to matrix containing the data
+ * @param perm The row of data that is moved to each row, populated by function
+ *
+ * @return     The status code, 0 for SUCCESS, 1 for ERROR
+ */
+extern int morton_order(gsl_matrix *data, uint32_t *perm);
+
+
+/**
+ * Orders the rows of data by cluster, keeping the order of the rows within
+ * each cluster.
+ *
+ * @param labels The cluster of each row of data
+ * @param rows   The number of rows of data
+ * @param perm   The row of data that is moved to each row, populated by function
+ *
+ * @return       The status code, 0 for SUCCESS, 1 for ERROR
+ */
+extern int cluster_order(const uint32_t *labels, uint32_t rows, uint32_t *perm);
+
+
+/**
+ * Permutes the rows of a matrix in place, row i becomes the former row perm[i].
+ *
+ * @param data Pointer to matrix to permute
+ * @param perm The row that is moved to each row
+ *
+ * @return     The status code, 0 for SUCCESS, 1 for ERROR
+ */
+extern int permute_rows(gsl_matrix *data, const uint32_t *perm);
+
+
+/**
+ * Permutes an array in place, element i becomes the former element perm[i].
+ *
+ * @param values The array to permute
+ * @param perm   The element that is moved to each element
+ * @param n      The number of elements
+ *
+ * @return       The status code, 0 for SUCCESS, 1 for ERROR
+ */
+extern int permute_index(uint32_t *values, const uint32_t *perm, uint32_t n);
+
+
+/**
+ * Replaces each value, a row before the rows are permuted, with the row it is
+ * moved to by the permutation.
+ *
+ * @param values The array of rows to update
+ * @param n      The number of elements
+ * @param perm   The row that is moved to each row
+ * @param rows   The number of rows
+ *
+ * @return       The status code, 0 for SUCCESS, 1 for ERROR
+ */
+extern int relabel_index(uint32_t *values, uint32_t n, const uint32_t *perm, uint32_t rows);
+
+
+#endif /* REORDER_H_ */
@@ -22,6 +22,32 @@
 
 #include "pcg_basic.h"
 
+/**
+ * @enum select_method
+ * @brief How the parents are selected from the population
+ */
+typedef enum
+{
+    SELECT_ROULETTE     = 0,    /**< Roulette wheel, binary search of the probabilities */
+    SELECT_ALIAS        = 1,    /**< Roulette wheel, O(1) draws from an alias table */
+    SELECT_SUS          = 2,    /**< Stochastic universal sampling */
+    SELECT_TOURNAMENT   = 3,    /**< Fittest of a tournament of random chromosomes */
+    SELECT_RANK         = 4     /**< Linear ranking, O(1) draws from an alias table */
+} select_method;
+
+
+/**
+ * Generates the selection weight of each chromosome in proportion to its
+ * fitness, the weights sum to one. If any fitness is negative the fitness is
+ * shifted so that the least fit has no weight, non-finite fitness has no
+ * weight and the weights are uniform if no chromosome has any weight.
+ *
+ * @param size    The size of the population
+ * @param fitness Pointer to an array of fitness values for population
+ * @param weight  Pointer to the weights, populated by function
+ */
+extern void gen_weights(int size, double fitness[size], double weight[size]);
+
 /**
  * Perform the roulette wheel probability selection, an array is populated with
  * the index of the chromosome to select with a frequency based on the fitness value.
@@ -32,6 +58,31 @@
  */
 extern void gen_probability(int size, double fitness[size], double probability[size]);
 
+/**
+ * Generates the selection weight of each chromosome in proportion to its rank
+ * by fitness, the weights sum to one and the least fit has the lowest weight.
+ *
+ * @param size    The size of the population
+ * @param fitness Pointer to an array of fitness values for population
+ * @param weight  Pointer to the weights, populated by function
+ *
+ * @return        The status code, 0 for SUCCESS, 1 for ERROR
+ */
+extern int gen_rank(int size, double fitness[size], double weight[size]);
+
+/**
+ * Builds an alias table with Vose's method, each column is accepted with its
+ * acceptance probability and otherwise the alias is selected.
+ *
+ * @param size   The size of the population
+ * @param weight The weights of the population, must sum to one
+ * @param accept Pointer to the acceptance probabilities, populated by function
+ * @param alias  Pointer to the aliases, populated by function
+ *
+ * @return       The status code, 0 for SUCCESS, 1 for ERROR
+ */
+extern int gen_alias(int size, double weight[size], double accept[size], int alias[size]);
+
 /**
  * Selects a parent from the population at random with a probability of being
  * selected based on the proabilities provided.
@@ -43,5 +94,43 @@ extern void gen_probability(int size, double fitness[size], double probability[s
  */
 extern int select_parent(int size, double probability[size], pcg32_random_t *rng);
 
+/**
+ * Selects a parent from the population in constant time with an alias table.
+ *
+ * @param  size   The size of the population
+ * @param  accept The acceptance probabilities of the alias table
+ * @param  alias  The aliases of the alias table
+ * @param  rng    Pointer to the random number generator
+ * @return        The index of the parent in the population to select
+ */
+extern int select_alias(int size, double accept[size], int alias[size], pcg32_random_t *rng);
+
+/**
+ * Selects all of the parents at once with stochastic universal sampling, the
+ * parents are selected by evenly spaced pointers from a single draw and then
+ * shuffled.
+ *
+ * @param  size        The size of the population
+ * @param  probability Probabilities of each chromosome in population being selected
+ * @param  n           The number of parents to select
+ * @param  selected    The index of each parent selected, populated by function
+ * @param  rng         Pointer to the random number generator
+ */
+extern void select_sus(int size, double probability[size], int n, int selected[n],
+                       pcg32_random_t *rng);
+
+/**
+ * Selects a parent from the population with a tournament, the fittest of
+ * the randomly drawn chromosomes is selected.
+ *
+ * @param  size       The size of the population
+ * @param  fitness    Pointer to an array of fitness values for population
+ * @param  tournament The number of chromosomes drawn for the tournament
+ * @param  rng        Pointer to the random number generator
+ * @return            The index of the parent in the population to select
+ */
+extern int select_tournament(int size, double fitness[size], int tournament,
+                             pcg32_random_t *rng);
+
 
 #endif /* SELECTION_H_ */
@@ -0,0 +1,60 @@
+/*
+ * Evolutionary K-means clustering (E-means) using Genetic Algorithms.
+ *
+ * Copyright (C) 2015, Jonathan Gillett
+ * All rights reserved.
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+#ifndef SERVER_H_
+#define SERVER_H_
+
+/*
+ * The protocol between the E-means server and its clients over a Unix domain
+ * socket, each connection sends a single request line and the server replies
+ * with lines until it closes the connection. Fields are separated by spaces.
+ *
+ * Requests:
+ *   LIST                                  The datasets and the queue
+ *   JOB <dataset> [<key>=<value> ...]     Cluster a preloaded dataset, the keys
+ *                                         are those of emeans.conf that configure
+ *                                         the genetic algorithm, priority and labels
+ *
+ * Replies:
+ *   DATASET <name> <rows> <cols> <mmap>   A preloaded dataset, for LIST
+ *   QUEUE <queued> <running>              The jobs queued and running, for LIST
+ *   QUEUED <id> <position>                The job is queued behind position jobs
+ *   RUNNING <id>                          A worker has started the job
+ *   PROGRESS <id> <generation> <fitness>  A new best solution was found
+ *   RESULT <id> <fitness> <generations> <term>
+ *                                         The job terminated, term is the reason
+ *   CENTROID <value>,<value>,...          A centroid of the best solution
+ *   LABEL <cluster>                       The cluster of each row, if labels=1
+ *   DONE <id>                             The last line of a successful request
+ *   ERROR <message>                       The last line of a failed request
+ */
+
+// The maximum length of a request line
+#define SERVER_MAX_REQUEST 4096
+
+// Seconds to wait for the request line of a new connection
+#define SERVER_TIMEOUT 5
+
+// The most connections waiting for their request line at once
+#define SERVER_MAX_PENDING 64
+
+// The default path of the socket
+#define SERVER_SOCKET "./emeans.sock"
+
+#endif /* SERVER_H_ */
@@ -0,0 +1,151 @@
+/*
+ * Evolutionary K-means clustering (E-means) using Genetic Algorithms.
+ *
+ * Copyright (C) 2015, Jonathan Gillett
+ * All rights reserved.
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+#ifndef STATS_H_
+#define STATS_H_
+
+#include <stdint.h>
+
+/**
+ * @enum phase_code
+ * @brief The phases of E-means that are timed, phases executed in parallel
+ *        are summed over all of the threads
+ */
+typedef enum
+{
+    PHASE_LOAD          = 0,    /**< Loading the data and calculating bounds */
+    PHASE_LLOYD         = 1,    /**< Lloyd's algorithm for each chromosome */
+    PHASE_FITNESS       = 2,    /**< Fitness evaluation of each chromosome */
+    PHASE_OPERATORS     = 3,    /**< Selection, crossover and mutation */
+    PHASE_IO            = 4,    /**< Saving the results */
+    N_PHASES            = 5
+} phase_code;
+
+/**
+ * @enum stat_code
+ * @brief The event counters that are recorded
+ */
+typedef enum
+{
+    STAT_GENERATIONS    = 0,    /**< Generations completed */
+    STAT_EVALUATIONS    = 1,    /**< Chromosomes evaluated */
+    STAT_LLOYD_ITERS    = 2,    /**< Iterations of Lloyd's algorithm */
+    STAT_DISTANCES      = 3,    /**< Distance evaluations */
+    STAT_EMPTY_CLUSTERS = 4,    /**< Empty clusters after Lloyd's algorithm */
+    STAT_ALLOCATIONS    = 5,    /**< Matrix and vector allocations */
+    STAT_DUPLICATES     = 6,    /**< Duplicate offspring replaced before evaluation */
+    STAT_PDS_DISTANCES  = 7,    /**< Distances evaluated with a partial distance search */
+    STAT_PDS_DIMS       = 8,    /**< Dimensions summed by the partial distance search */
+    N_STATS             = 9
+} stat_code;
+
+/**
+ * @enum lloyd_stop
+ * @brief Why Lloyd's algorithm stopped for a chromosome
+ */
+typedef enum
+{
+    LLOYD_RUNNING       = -1,   /**< Not stopped yet */
+    LLOYD_CONVERGED     = 0,    /**< The centroids did not change */
+    LLOYD_TOLERANCE     = 1,    /**< The centroids moved less than the tolerance */
+    LLOYD_CHANGED       = 2,    /**< Too few rows changed cluster */
+    LLOYD_CAPPED        = 3,    /**< The iteration cap was reached */
+    N_LLOYD_STOPS       = 4
+} lloyd_stop;
+
+
+/**
+ * Resets all of the counters and timers and starts the wall clock. The
+ * counters are process-wide, every E-means context adds to the same counters.
+ */
+extern void stats_reset(void);
+
+
+/**
+ * The current time of the monotonic clock.
+ *
+ * @return The current time in seconds
+ */
+extern double stats_now(void);
+
+
+/**
+ * Adds the time elapsed since start to a phase, safe to call from any thread.
+ *
+ * @param phase The phase to add the time to
+ * @param start The start time of the phase from stats_now()
+ */
+extern void stats_time(phase_code phase, double start);
+
+
+/**
+ * Adds to an event counter, safe to call from any thread.
+ *
+ * @param stat  The counter to add to
+ * @param value The value to add
+ */
+extern void stats_add(stat_code stat, uint64_t value);
+
+
+/**
+ * Records the number of Lloyd's iterations for one chromosome in the
+ * iteration histogram of the reason it stopped, safe to call from any thread.
+ *
+ * @param iters The number of iterations until Lloyd's algorithm stopped
+ * @param stop  Why Lloyd's algorithm stopped, see lloyd_stop
+ */
+extern void stats_lloyd(uint64_t iters, lloyd_stop stop);
+
+
+/**
+ * Records the time spent executing generations, excluding loading the data
+ * and creating the initial population, the rates of the summary are per
+ * second of this time once it is recorded.
+ *
+ * @param seconds The seconds spent executing generations, see emeans_result
+ */
+extern void stats_run_time(double seconds);
+
+
+/**
+ * Records the best fitness found so far.
+ *
+ * @param fitness The best fitness
+ */
+extern void stats_fitness(double fitness);
+
+
+/**
+ * Writes the counters in the Prometheus text exposition format, the file is
+ * replaced atomically so a scraper never reads a partial file.
+ *
+ * @param output Path to the stats file
+ *
+ * @return       The status code, 0 for SUCCESS, 1 for ERROR
+ */
+extern int stats_write(char *output);
+
+
+/**
+ * Prints a summary table of the phase timings and counters.
+ */
+extern void stats_summary(void);
+
+
+#endif /* STATS_H_ */
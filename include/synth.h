@@ -0,0 +1,60 @@
+/*
+ * Evolutionary K-means clustering (E-means) using Genetic Algorithms.
+ *
+ * Copyright (C) 2015, Jonathan Gillett
+ * All rights reserved.
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+#ifndef SYNTH_H_
+#define SYNTH_H_
+
+#include <stdint.h>
+#include <gsl/gsl_matrix.h>
+
+/**
+ * Generates a synthetic dataset of isotropic Gaussian blobs and writes it as
+ * a CSV file in the same format that is read by load_data(). The blob centres
+ * are drawn uniformly from [-separation, separation] in each dimension and each
+ * blob has unit variance, rows are streamed so that the dataset never needs to
+ * fit in memory.
+ *
+ * @param output     Path to the CSV data file to be created
+ * @param rows       The number of rows (data points) to generate
+ * @param cols       The number of columns (dimensions) of each data point
+ * @param k          The number of Gaussian blobs
+ * @param separation The spread of the blob centres in units of standard deviation
+ * @param seed       The seed for the random number generator
+ *
+ * @return           The status code, 0 for SUCCESS, 1 for ERROR
+ */
+extern int synth_blobs(char *output, uint64_t rows, uint32_t cols, uint32_t k,
+                       double separation, uint64_t seed);
+
+
+/**
+ * Fills a matrix with a synthetic dataset of isotropic Gaussian blobs, this
+ * draws the same dataset as synth_blobs() for the same parameters and seed.
+ *
+ * @param data       Pointer to the GSL matrix to be populated
+ * @param k          The number of Gaussian blobs
+ * @param separation The spread of the blob centres in units of standard deviation
+ * @param seed       The seed for the random number generator
+ *
+ * @return           The status code, 0 for SUCCESS, 1 for ERROR
+ */
+extern int synth_fill(gsl_matrix *data, uint32_t k, double separation, uint64_t seed);
+
+
+#endif /* SYNTH_H_ */
@@ -0,0 +1,74 @@
+/*
+ * Evolutionary K-means clustering (E-means) using Genetic Algorithms.
+ *
+ * Copyright (C) 2015, Jonathan Gillett
+ * All rights reserved.
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+#ifndef TRACE_H_
+#define TRACE_H_
+
+#include <stdint.h>
+
+// Number of Lloyd's iterations recorded as a single trace event
+#define TRACE_LLOYD_BATCH 16
+
+
+/**
+ * Enables tracing. Each thread that records an event is given the next id
+ * and its own event buffer on its first event, each buffer is only written
+ * by its own thread so recording an event takes no locks. Threads of nested
+ * teams and of other pthreads each have their own buffer.
+ *
+ * @param threads The number of threads expected to record events, the table
+ *                of buffers grows for any further threads
+ *
+ * @return        The status code, 0 for SUCCESS, 1 for ERROR
+ */
+extern int trace_init(int threads);
+
+
+/**
+ * Records the beginning of an event on the calling thread, does nothing if
+ * tracing is not enabled.
+ *
+ * @param name The name of the event, must be a string literal
+ * @param id   The generation, chromosome or iteration the event belongs to
+ */
+extern void trace_begin(const char *name, int64_t id);
+
+
+/**
+ * Records the end of an event on the calling thread, does nothing if
+ * tracing is not enabled.
+ *
+ * @param name The name of the event, must be a string literal
+ * @param id   The generation, chromosome or iteration the event belongs to
+ */
+extern void trace_end(const char *name, int64_t id);
+
+
+/**
+ * Writes all of the recorded events in the Chrome trace event JSON format,
+ * which can be loaded in chrome://tracing or Perfetto, and disables tracing.
+ *
+ * @param output Path to the trace file
+ *
+ * @return       The status code, 0 for SUCCESS, 1 for ERROR
+ */
+extern int trace_write(char *output);
+
+
+#endif /* TRACE_H_ */
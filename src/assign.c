@@ -0,0 +1,251 @@
+/*
+ * Evolutionary K-means clustering (E-means) using Genetic Algorithms.
+ *
+ * Copyright (C) 2015, Jonathan Gillett
+ * All rights reserved.
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+#define _DEFAULT_SOURCE
+#include <stdio.h>
+#include <stdlib.h>
+#include <stdint.h>
+#include <stdbool.h>
+#include <string.h>
+#include <ctype.h>
+#include <omp.h>
+#include <gsl/gsl_matrix.h>
+#include "utility.h"
+#include "cluster.h"
+#include "stats.h"
+#include "assign.h"
+
+/**
+ * @struct chunk_buffers
+ * @brief The buffers reused for each chunk of the stream
+ */
+typedef struct
+{
+    char *line;             /**< The line read by getline() */
+    size_t line_size;       /**< The size of line */
+    char *text;             /**< The lines of the chunk of CSV input */
+    size_t text_size;       /**< The size of text */
+    size_t *offsets;        /**< The offset of each line of the chunk in text */
+    char *output;           /**< The formatted output of each row */
+    uint8_t *lengths;       /**< The length of the output of each row */
+} chunk_buffers;
+
+
+/**
+ * Reads the lines of a chunk of CSV input and then parses them in parallel.
+ *
+ * @param in      The input stream
+ * @param chunk   Pointer to matrix for the rows, resized to the rows read
+ * @param buf     Pointer to the buffers
+ * @param threads The number of threads
+ * @param first   The row of the input of the first row of the chunk
+ *
+ * @return        The status code, 0 for SUCCESS, 1 for ERROR
+ */
+static int read_csv(FILE *in, gsl_matrix *chunk, chunk_buffers *buf, int threads, uint64_t first)
+{
+    uint32_t rows = 0,
+             cols = chunk->size2;
+    size_t used = 0;
+    ssize_t len = 0;
+    int64_t bad = -1;
+
+    while (rows < ASSIGN_CHUNK && (len = getline(&buf->line, &buf->line_size, in)) > 0)
+    {
+        if (strspn(buf->line, " \t\r\n") == (size_t)len)
+            continue;
+        if (used + len + 1 > buf->text_size)
+        {
+            char *text = (char *)realloc(buf->text, 2 * (used + len + 1));
+            if (text == NULL)
+            {
+                fprintf(stderr, RED "Unable to allocate the input buffer!\n" RESET);
+                return ERROR;
+            }
+            buf->text = text;
+            buf->text_size = 2 * (used + len + 1);
+        }
+        memcpy(buf->text + used, buf->line, len + 1);
+        buf->offsets[rows++] = used;
+        used += len + 1;
+    }
+    chunk->size1 = rows;
+
+    // Parse the rows in parallel, recording the first malformed row
+    #pragma omp parallel for schedule(static) num_threads(threads)
+    for (uint32_t i = 0; i < rows; ++i)
+    {
+        char *pos = buf->text + buf->offsets[i],
+             *end = NULL;
+        double *row = gsl_matrix_ptr(chunk, i, 0);
+
+        for (uint32_t j = 0; j < cols; ++j)
+        {
+            row[j] = strtod(pos, &end);
+            if (end == pos)
+            {
+                #pragma omp critical (assign_bad_row)
+                bad = bad < 0 || (int64_t)i < bad ? (int64_t)i : bad;
+                break;
+            }
+            for (pos = end; isspace((unsigned char)*pos) && *pos != '\n'; ++pos);
+            if (*pos == ',')
+                ++pos;
+        }
+    }
+    if (bad >= 0)
+    {
+        fprintf(stderr, RED "Row %lu of the input does not have %u columns!\n" RESET,
+                (unsigned long)(first + bad + 1), cols);
+        return ERROR;
+    }
+    return SUCCESS;
+}
+
+
+/**
+ * Reads a chunk of binary input of rows of raw doubles.
+ *
+ * @param in    The input stream
+ * @param chunk Pointer to matrix for the rows, resized to the rows read
+ *
+ * @return      The status code, 0 for SUCCESS, 1 for ERROR
+ */
+static int read_binary(FILE *in, gsl_matrix *chunk)
+{
+    size_t cols = chunk->size2,
+           got = fread(chunk->data, sizeof(double), ASSIGN_CHUNK * cols, in);
+
+    chunk->size1 = got / cols;
+    if (got % cols != 0)
+    {
+        fprintf(stderr, RED "The binary input ends within a row!\n" RESET);
+        return ERROR;
+    }
+    return SUCCESS;
+}
+
+
+/**
+ * Writes the labels, and optionally the distances, of a chunk.
+ *
+ * @param out       The output stream
+ * @param rows      The number of rows in the chunk
+ * @param labels    The label of each row
+ * @param distances The distance of each row, NULL to only write the labels
+ * @param buf       Pointer to the buffers
+ * @param config    Pointer to the configuration
+ * @param threads   The number of threads
+ *
+ * @return          The status code, 0 for SUCCESS, 1 for ERROR
+ */
+static int write_chunk(FILE *out, uint32_t rows, const uint32_t *labels, const double *distances,
+                       chunk_buffers *buf, const assign_config *config, int threads)
+{
+    if (config->binary_out)
+    {
+        for (uint32_t i = 0; i < rows; ++i)
+        {
+            fwrite(&labels[i], sizeof(uint32_t), 1, out);
+            if (distances != NULL)
+                fwrite(&distances[i], sizeof(double), 1, out);
+        }
+        return ferror(out) ? ERROR : SUCCESS;
+    }
+
+    // Format the lines in parallel into fixed width slots, then write in order
+    #pragma omp parallel for schedule(static) num_threads(threads)
+    for (uint32_t i = 0; i < rows; ++i)
+    {
+        char *line = buf->output + (size_t)i * ASSIGN_WIDTH;
+        int len = distances != NULL
+                  ? snprintf(line, ASSIGN_WIDTH, "%u,%.9g\n", labels[i], distances[i])
+                  : snprintf(line, ASSIGN_WIDTH, "%u\n", labels[i]);
+        buf->lengths[i] = (uint8_t)(len < ASSIGN_WIDTH ? len : ASSIGN_WIDTH - 1);
+    }
+    for (uint32_t i = 0; i < rows; ++i)
+        fwrite(buf->output + (size_t)i * ASSIGN_WIDTH, 1, buf->lengths[i], out);
+    return ferror(out) ? ERROR : SUCCESS;
+}
+
+
+int assign_stream(gsl_matrix *centroids, FILE *in, FILE *out, const assign_config *config,
+                  assign_stats *stats)
+{
+    int status = SUCCESS,
+        threads = config->threads > 0 ? (int)config->threads : omp_get_max_threads();
+    double start = 0;
+    gsl_matrix *chunk = gsl_matrix_alloc(ASSIGN_CHUNK, centroids->size2);
+    uint32_t *labels = (uint32_t *)malloc(ASSIGN_CHUNK * sizeof(uint32_t));
+    double *distances = config->distances ? (double *)malloc(ASSIGN_CHUNK * sizeof(double)) : NULL;
+    chunk_buffers buf;
+
+    memset(stats, 0, sizeof(assign_stats));
+    memset(&buf, 0, sizeof(buf));
+    buf.offsets = (size_t *)malloc(ASSIGN_CHUNK * sizeof(size_t));
+    buf.output = (char *)malloc((size_t)ASSIGN_CHUNK * ASSIGN_WIDTH);
+    buf.lengths = (uint8_t *)malloc(ASSIGN_CHUNK * sizeof(uint8_t));
+    if (chunk == NULL || labels == NULL || (config->distances && distances == NULL)
+        || buf.offsets == NULL || buf.output == NULL || buf.lengths == NULL)
+    {
+        fprintf(stderr, RED "Unable to allocate the assignment buffers!\n" RESET);
+        status = ERROR;
+        goto free;
+    }
+
+    while (true)
+    {
+        start = stats_now();
+        status = config->binary_in ? read_binary(in, chunk) 
+                                   : read_csv(in, chunk, &buf, threads, stats->rows);
+        stats->read_time += stats_now() - start;
+        if (status != SUCCESS || chunk->size1 == 0)
+            break;
+
+        start = stats_now();
+        status = nearest_centroids(chunk, centroids, labels, distances, threads);
+        stats->assign_time += stats_now() - start;
+        if (status != SUCCESS)
+            break;
+
+        start = stats_now();
+        status = write_chunk(out, chunk->size1, labels, distances, &buf, config, threads);
+        stats->write_time += stats_now() - start;
+        if (status != SUCCESS)
+        {
+            fprintf(stderr, RED "Unable to write the labels!\n" RESET);
+            break;
+        }
+        stats->rows += chunk->size1;
+    }
+
+free:
+    if (chunk != NULL)
+        chunk->size1 = ASSIGN_CHUNK;
+    gsl_matrix_free(chunk);
+    free(labels);
+    free(distances);
+    free(buf.line);
+    free(buf.text);
+    free(buf.offsets);
+    free(buf.output);
+    free(buf.lengths);
+
+    return status;
+}
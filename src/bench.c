@@ -0,0 +1,390 @@
+/*
+ * Evolutionary K-means clustering (E-means) using Genetic Algorithms.
+ *
+ * Copyright (C) 2015, Jonathan Gillett
+ * All rights reserved.
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+#define _DEFAULT_SOURCE
+#include <stdio.h>
+#include <stdlib.h>
+#include <stdint.h>
+#include <stdbool.h>
+#include <string.h>
+#include <math.h>
+#include <time.h>
+#include <fcntl.h>
+#include <unistd.h>
+#include <confuse.h>
+#include <sys/types.h>
+#include <sys/time.h>
+#include <sys/resource.h>
+#include <sys/wait.h>
+#include <sys/utsname.h>
+#include "utility.h"
+#include "synth.h"
+
+
+int DEBUG, VERBOSE;
+
+// Define the configuration parameters
+int64_t size = 10,
+        max_iter = 10,
+        trials = 1,
+        seed = 42,
+        max_cells = 100000000;
+double  separation = 5.0;
+char    *emeans_exe = NULL,
+        *work_dir = NULL,
+        *bench_file = NULL;
+
+// The configuration file parsing mappings, lists define the benchmark matrix
+cfg_opt_t opts[] = {
+    CFG_INT_LIST("rows", "{1000, 10000}", CFGF_NONE),
+    CFG_INT_LIST("cols", "{2, 16, 128}", CFGF_NONE),
+    CFG_INT_LIST("n_clusters", "{2, 8, 32}", CFGF_NONE),
+    CFG_INT_LIST("threads", "{1}", CFGF_NONE),
+    CFG_SIMPLE_INT("size", &size),
+    CFG_SIMPLE_INT("max_iter", &max_iter),
+    CFG_SIMPLE_INT("trials", &trials),
+    CFG_SIMPLE_INT("seed", &seed),
+    CFG_SIMPLE_INT("max_cells", &max_cells),
+    CFG_SIMPLE_FLOAT("separation", &separation),
+    CFG_SIMPLE_STR("emeans_exe", &emeans_exe),
+    CFG_SIMPLE_STR("work_dir", &work_dir),
+    CFG_SIMPLE_STR("bench_file", &bench_file),
+    CFG_END()
+};
+cfg_t *cfg;
+
+
+/**
+ * @struct bench_result
+ * @brief The measurements from a single E-means benchmark run
+ */
+typedef struct
+{
+    double wall_time;   /**< Wall clock time of the run in seconds */
+    double run_time;    /**< Seconds spent executing generations, NAN if unknown */
+    double generations; /**< Generations executed, NAN if unknown */
+    long   peak_rss;    /**< Peak resident set size of the run in KiB */
+    double fitness;     /**< Best fitness found, NAN if none was saved */
+    int    status;      /**< Exit status of the E-means executable */
+} bench_result;
+
+
+/**
+ * Reads the best fitness from the fitness file, the file is only appended to
+ * when a new best solution is found so the last line is the final fitness.
+ *
+ * @param  path Path to the fitness file
+ *
+ * @return      The final fitness, NAN if the file is missing or empty
+ */
+static double read_fitness(char *path)
+{
+    FILE *ifp;
+    double val = 0,
+           fitness = NAN;
+
+    if ((ifp = fopen(path, "r")) == NULL)
+    {
+        return NAN;
+    }
+    while (fscanf(ifp, "%lf\n", &val) == 1)
+    {
+        fitness = val;
+    }
+    fclose(ifp);
+
+    return fitness;
+}
+
+
+/**
+ * Reads a sample from the stats file of E-means.
+ *
+ * @param  path   Path to the stats file
+ * @param  metric The name of the metric, without labels
+ *
+ * @return        The value of the metric, NAN if the file or metric is missing
+ */
+static double read_metric(char *path, const char *metric)
+{
+    FILE *ifp;
+    char line[512];
+    size_t len = strlen(metric);
+    double value = NAN;
+
+    if ((ifp = fopen(path, "r")) == NULL)
+    {
+        return NAN;
+    }
+    while (fgets(line, sizeof(line), ifp) != NULL)
+    {
+        if (strncmp(line, metric, len) == 0 && line[len] == ' ')
+        {
+            value = strtod(line + len, NULL);
+            break;
+        }
+    }
+    fclose(ifp);
+
+    return value;
+}
+
+
+/**
+ * Executes E-means as a child process on the given dataset and measures it,
+ * running in a separate process isolates the peak RSS of each configuration.
+ *
+ * @param  data   Path to the CSV data file
+ * @param  rows   The number of rows in the data file
+ * @param  cols   The number of columns in the data file
+ * @param  k      The number of clusters
+ * @param  thread The number of threads to execute with
+ * @param  result Pointer to the results, populated by function
+ *
+ * @return        The status code, 0 for SUCCESS, 1 for ERROR
+ */
+static int run_emeans(char *data, int64_t rows, int64_t cols, int64_t k,
+                      int64_t threads, bench_result *result)
+{
+    char conf_file[512],
+         fitness_file[512],
+         stats_file[512],
+         threads_env[32];
+    FILE *ofp;
+    pid_t pid;
+    int wstatus = 0;
+    struct rusage usage;
+    struct timespec start, end;
+
+    snprintf(conf_file, sizeof(conf_file), "%s/bench_emeans.conf", work_dir);
+    snprintf(fitness_file, sizeof(fitness_file), "%s/bench_fitness.csv", work_dir);
+    snprintf(stats_file, sizeof(stats_file), "%s/bench_stats.prom", work_dir);
+    remove(fitness_file);
+    remove(stats_file);
+
+    // Write the E-means configuration for this benchmark point
+    if ((ofp = fopen(conf_file, "w")) == NULL)
+    {
+        fprintf(stderr, RED "Can't open output file %s!\n" RESET, conf_file);
+        return ERROR;
+    }
+    fprintf(ofp, "n_clusters = %ld\n", (long)k);
+    fprintf(ofp, "trials = %ld\n", (long)trials);
+    fprintf(ofp, "size = %ld\n", (long)size);
+    fprintf(ofp, "max_iter = %ld\n", (long)max_iter);
+    fprintf(ofp, "seed = %ld\n", (long)seed);
+    fprintf(ofp, "data_rows = %ld\n", (long)rows);
+    fprintf(ofp, "data_cols = %ld\n", (long)cols);
+    fprintf(ofp, "data_file = \"%s\"\n", data);
+    fprintf(ofp, "centroids_file = \"%s/bench_centroids.csv\"\n", work_dir);
+    fprintf(ofp, "fitness_file = \"%s\"\n", fitness_file);
+    fprintf(ofp, "stats_file = \"%s\"\n", stats_file);
+    fprintf(ofp, "cluster_file = \"%s/bench_clusters.csv\"\n", work_dir);
+    fclose(ofp);
+
+    snprintf(threads_env, sizeof(threads_env), "%ld", (long)threads);
+    clock_gettime(CLOCK_MONOTONIC, &start);
+
+    if ((pid = fork()) < 0)
+    {
+        fprintf(stderr, RED "Unable to fork %s!\n" RESET, emeans_exe);
+        return ERROR;
+    }
+    else if (pid == 0)
+    {
+        // Silence the progress output of E-means, only the measurements matter
+        int fd = open("/dev/null", O_WRONLY);
+        dup2(fd, STDOUT_FILENO);
+        close(fd);
+        setenv("OMP_NUM_THREADS", threads_env, 1);
+        execl(emeans_exe, emeans_exe, "0", "0", conf_file, (char *)NULL);
+        _exit(127);
+    }
+
+    if (wait4(pid, &wstatus, 0, &usage) < 0)
+    {
+        fprintf(stderr, RED "Unable to wait for %s!\n" RESET, emeans_exe);
+        return ERROR;
+    }
+    clock_gettime(CLOCK_MONOTONIC, &end);
+
+    result->wall_time = (end.tv_sec - start.tv_sec) + (end.tv_nsec - start.tv_nsec) * 1e-9;
+    result->peak_rss = usage.ru_maxrss;
+    result->fitness = read_fitness(fitness_file);
+    result->generations = read_metric(stats_file, "emeans_generations_total");
+    result->run_time = read_metric(stats_file, "emeans_run_seconds");
+    result->status = WIFEXITED(wstatus) ? WEXITSTATUS(wstatus) : ERROR;
+
+    return SUCCESS;
+}
+
+
+/**
+ * Runs the benchmark matrix of dataset sizes, clusters and thread counts and
+ * writes the measurements as JSON.
+ *
+ * @return Status code, 0 for SUCCESS, 1 for ERROR
+ */
+int bench(void)
+{
+    int status = SUCCESS;
+    char data[512];
+    bool first = true;
+    FILE *ofp;
+    struct utsname host;
+
+    if ((ofp = fopen(bench_file, "w")) == NULL)
+    {
+        fprintf(stderr, RED "Can't open output file %s!\n" RESET, bench_file);
+        return ERROR;
+    }
+    uname(&host);
+
+    fprintf(ofp, "{\n");
+    fprintf(ofp, "  \"host\": \"%s\",\n", host.nodename);
+    fprintf(ofp, "  \"machine\": \"%s\",\n", host.machine);
+    fprintf(ofp, "  \"cpus\": %ld,\n", sysconf(_SC_NPROCESSORS_ONLN));
+    fprintf(ofp, "  \"timestamp\": %ld,\n", (long)time(NULL));
+    fprintf(ofp, "  \"population\": %ld,\n", (long)size);
+    fprintf(ofp, "  \"max_iter\": %ld,\n", (long)max_iter);
+    fprintf(ofp, "  \"separation\": %f,\n", separation);
+    fprintf(ofp, "  \"seed\": %ld,\n", (long)seed);
+    fprintf(ofp, "  \"results\": [");
+
+    for (unsigned int r = 0; r < cfg_size(cfg, "rows"); ++r)
+    {
+        for (unsigned int c = 0; c < cfg_size(cfg, "cols"); ++c)
+        {
+            for (unsigned int n = 0; n < cfg_size(cfg, "n_clusters"); ++n)
+            {
+                int64_t rows = cfg_getnint(cfg, "rows", r),
+                        cols = cfg_getnint(cfg, "cols", c),
+                        k = cfg_getnint(cfg, "n_clusters", n);
+
+                // Skip the points of the matrix that are degenerate or too large
+                if (k < 2 || k >= rows || rows * cols > max_cells)
+                {
+                    printf(YELLOW "Skipping rows: %ld, cols: %ld, k: %ld\n" RESET,
+                           (long)rows, (long)cols, (long)k);
+                    continue;
+                }
+
+                printf(CYAN "Generating dataset rows: %ld, cols: %ld, k: %ld\n" RESET,
+                       (long)rows, (long)cols, (long)k);
+                snprintf(data, sizeof(data), "%s/bench_data.csv", work_dir);
+                if (synth_blobs(data, rows, cols, k, separation, seed) != SUCCESS)
+                {
+                    status = ERROR;
+                    goto free;
+                }
+
+                for (unsigned int t = 0; t < cfg_size(cfg, "threads"); ++t)
+                {
+                    int64_t threads = cfg_getnint(cfg, "threads", t);
+                    bench_result result;
+
+                    if (run_emeans(data, rows, cols, k, threads, &result) != SUCCESS)
+                    {
+                        status = ERROR;
+                        goto free;
+                    }
+                    printf(GREEN "rows: %ld, cols: %ld, k: %ld, threads: %ld, "
+                           "time: %10.6f s, rss: %ld KiB, fitness: %10.6f\n" RESET,
+                           (long)rows, (long)cols, (long)k, (long)threads,
+                           result.wall_time, result.peak_rss, result.fitness);
+
+                    fprintf(ofp, "%s\n    {\"rows\": %ld, \"cols\": %ld, \"n_clusters\": %ld, "
+                            "\"threads\": %ld, \"status\": %d, \"wall_time_s\": %.6f, "
+                            "\"peak_rss_kb\": %ld, ",
+                            first ? "" : ",", (long)rows, (long)cols, (long)k,
+                            (long)threads, result.status, result.wall_time, result.peak_rss);
+
+                    // The rate over the generations actually executed, excluding loading
+                    if (isnan(result.generations) || isnan(result.run_time) || result.run_time <= 0)
+                        fprintf(ofp, "\"generations\": null, \"run_time_s\": null, "
+                                "\"generations_per_sec\": null, ");
+                    else
+                        fprintf(ofp, "\"generations\": %ld, \"run_time_s\": %.6f, "
+                                "\"generations_per_sec\": %.6f, ", (long)result.generations,
+                                result.run_time, result.generations / result.run_time);
+                    if (isnan(result.fitness))
+                        fprintf(ofp, "\"final_fitness\": null}");
+                    else
+                        fprintf(ofp, "\"final_fitness\": %.6f}", result.fitness);
+                    first = false;
+                    fflush(ofp);
+                }
+                remove(data);
+            }
+        }
+    }
+
+free:
+    fprintf(ofp, "\n  ]\n}\n");
+    fclose(ofp);
+    printf(GREEN "Benchmark results saved to %s\n" RESET, bench_file);
+
+    return status;
+}
+
+
+int main(int argc, char *argv[])
+{
+    int status = SUCCESS;
+    char conf_file[100] = "./conf/bench.conf";
+
+    if (argc > 2)
+    {
+        fprintf(stderr, RED "Incorrect parameters!\n" RESET);
+        fprintf(stderr, RED "Correct usage:\n" RESET);
+        fprintf(stderr, RED "%s <CONFIG> (DEFAULT ./conf/bench.conf)\n\n" RESET, argv[0]);
+        exit(ERROR);
+    }
+    if (argc > 1)
+    {
+        strcpy(conf_file, argv[1]);
+    }
+
+    cfg = cfg_init(opts, 0);
+    if (cfg_parse(cfg, conf_file) != CFG_SUCCESS)
+    {
+        fprintf(stderr, RED "Unable to parse file %s\n" RESET, conf_file);
+        status = ERROR;
+        goto free;
+    }
+
+    // Fall back to the default paths for any that are not configured
+    if (emeans_exe == NULL)
+        emeans_exe = strdup("./emeans.exe");
+    if (work_dir == NULL)
+        work_dir = strdup("/tmp");
+    if (bench_file == NULL)
+        bench_file = strdup("./results/bench.json");
+
+    status = bench();
+
+// Free memory and exit
+free:
+    cfg_free(cfg);
+    free(emeans_exe);
+    free(work_dir);
+    free(bench_file);
+
+    exit(status);
+}
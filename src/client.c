@@ -0,0 +1,149 @@
+/*
+ * Evolutionary K-means clustering (E-means) using Genetic Algorithms.
+ *
+ * Copyright (C) 2015, Jonathan Gillett
+ * All rights reserved.
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+#define _DEFAULT_SOURCE
+#include <stdio.h>
+#include <stdlib.h>
+#include <stdint.h>
+#include <string.h>
+#include <errno.h>
+#include <unistd.h>
+#include <sys/types.h>
+#include <sys/socket.h>
+#include <sys/un.h>
+#include "utility.h"
+#include "server.h"
+
+
+int DEBUG, VERBOSE;
+
+
+/**
+ * Builds the request line from the command line, the centroids key is kept
+ * by the client as the file to save the centroids to.
+ *
+ * @param argc      The number of arguments
+ * @param argv      The arguments, the dataset followed by key=value pairs
+ * @param request   Buffer for the request, SERVER_MAX_REQUEST bytes
+ * @param centroids Set to the path to save the centroids to, NULL if not given
+ *
+ * @return          The status code, 0 for SUCCESS, 1 for ERROR
+ */
+static int build_request(int argc, char *argv[], char *request, char **centroids)
+{
+    size_t len = 0;
+
+    if (strcmp(argv[0], "LIST") == 0)
+    {
+        strcpy(request, "LIST\n");
+        return SUCCESS;
+    }
+    len = snprintf(request, SERVER_MAX_REQUEST, "JOB %s", argv[0]);
+    for (int i = 1; i < argc && len < SERVER_MAX_REQUEST; ++i)
+    {
+        if (strncmp(argv[i], "centroids=", 10) == 0)
+            *centroids = argv[i] + 10;
+        else
+            len += snprintf(request + len, SERVER_MAX_REQUEST - len, " %s", argv[i]);
+    }
+    if (len + 1 >= SERVER_MAX_REQUEST)
+    {
+        fprintf(stderr, RED "The request is longer than %d characters!\n" RESET, SERVER_MAX_REQUEST);
+        return ERROR;
+    }
+    strcat(request, "\n");
+
+    return SUCCESS;
+}
+
+
+int main(int argc, char *argv[])
+{
+    int status = ERROR,
+        fd = -1;
+    char request[SERVER_MAX_REQUEST],
+         *centroids = NULL,
+         *line = NULL;
+    size_t size = 0;
+    struct sockaddr_un addr;
+    FILE *in = NULL,
+         *ofp = NULL;
+
+    if (argc < 3)
+    {
+        fprintf(stderr, RED "Incorrect parameters!\n" RESET);
+        fprintf(stderr, RED "Correct usage:\n" RESET);
+        fprintf(stderr, RED "%s <SOCKET> LIST\n" RESET, argv[0]);
+        fprintf(stderr, RED "%s <SOCKET> <DATASET> [priority=N] [labels=1] [centroids=FILE] [KEY=VALUE ...]\n\n" RESET, argv[0]);
+        exit(ERROR);
+    }
+    if (build_request(argc - 2, argv + 2, request, &centroids) != SUCCESS)
+    {
+        exit(ERROR);
+    }
+
+    memset(&addr, 0, sizeof(addr));
+    addr.sun_family = AF_UNIX;
+    strncpy(addr.sun_path, argv[1], sizeof(addr.sun_path) - 1);
+    if ((fd = socket(AF_UNIX, SOCK_STREAM, 0)) < 0
+        || connect(fd, (struct sockaddr *)&addr, sizeof(addr)) != 0)
+    {
+        fprintf(stderr, RED "Unable to connect to %s: %s\n" RESET, argv[1], strerror(errno));
+        goto free;
+    }
+    if (write(fd, request, strlen(request)) != (ssize_t)strlen(request) || (in = fdopen(fd, "r")) == NULL)
+    {
+        fprintf(stderr, RED "Unable to send the request!\n" RESET);
+        goto free;
+    }
+    fd = -1;
+    if (centroids != NULL && (ofp = fopen(centroids, "w")) == NULL)
+    {
+        fprintf(stderr, RED "Can't open output file %s!\n" RESET, centroids);
+        goto free;
+    }
+
+    // Print each reply as it is streamed, the last line is DONE or ERROR
+    while (getline(&line, &size, in) > 0)
+    {
+        line[strcspn(line, "\n")] = '\0';
+        if (strncmp(line, "DONE", 4) == 0)
+            status = SUCCESS;
+        if (strncmp(line, "ERROR", 5) == 0)
+            fprintf(stderr, RED "%s\n" RESET, line);
+        else if (strncmp(line, "RESULT", 6) == 0 || strncmp(line, "PROGRESS", 8) == 0)
+            printf(GREEN "%s\n" RESET, line);
+        else
+            printf("%s\n", line);
+        fflush(stdout);
+        if (ofp != NULL && strncmp(line, "CENTROID ", 9) == 0)
+            fprintf(ofp, "%s\n", line + 9);
+    }
+
+free:
+    if (fd >= 0)
+        close(fd);
+    if (in != NULL)
+        fclose(in);
+    if (ofp != NULL)
+        fclose(ofp);
+    free(line);
+
+    exit(status);
+}
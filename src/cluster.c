@@ -23,143 +23,473 @@
 #include <float.h>
 #include <stdint.h>
 #include <string.h>
+#include <stdbool.h>
+#include <omp.h>
 #include <gsl/gsl_matrix.h>
 #include <gsl/gsl_blas.h>
+#include <gsl/gsl_sort.h>
 #include <gsl/gsl_statistics.h>
 #include "utility.h"
 #include "pcg_basic.h"
 #include "cluster.h"
+#include "fitness.h"
+#include "stats.h"
+#include "trace.h"
 
-int lloyd_random(int trials, gsl_matrix *data, int n_clusters,
-                 gsl_matrix **clusters, pcg32_random_t *rng)
+// Forces the generic kernels to be inlined into each fixed dimension kernel,
+// so the number of columns is a constant and the loops over it are unrolled
+#if defined(__GNUC__)
+#define FORCE_INLINE inline __attribute__((always_inline))
+#else
+#define FORCE_INLINE inline
+#endif
+
+// The signature of assign_block() and of each of its fixed dimension kernels
+typedef uint32_t (*assign_fn)(const double *restrict data, size_t tda, uint32_t rows, 
+                              uint32_t cols, const double *restrict centroids, int n_clusters,
+                              double *restrict sums, uint32_t *restrict counts, 
+                              uint32_t *restrict labels, const uint32_t *restrict weights);
+
+static assign_fn assign_kernel(uint32_t cols);
+
+
+/**
+ * Frees the previous clusters then allocates and copies the data to each
+ * cluster for the given assignment, empty clusters are set to NULL.
+ *
+ * @param data       Pointer to matrix containing the data
+ * @param labels     Cluster assignment for each row of data
+ * @param counts     Number of rows assigned to each cluster
+ * @param n_clusters The number of clusters
+ * @param clusters   Pointer to array of matrices containing data in clusters
+ */
+static void fill_clusters(gsl_matrix *data, uint32_t *labels, uint32_t *counts,
+                          int n_clusters, gsl_matrix **clusters)
 {
     uint32_t rows = data->size1,
              cols = data->size2;
-    uint32_t counts[n_clusters];
-    memset(counts, 0, n_clusters * sizeof(int));
+    uint32_t filled[n_clusters];
+
+    // Allocate the clusters
+    for (int n = 0; n < n_clusters; ++n)
+    {
+        gsl_matrix_free(clusters[n]);
+        filled[n] = 0;
+
+        if (counts[n] < 1)
+        {
+            clusters[n] = NULL;
+        }
+        else
+        {
+            clusters[n] = gsl_matrix_alloc(counts[n], cols);
+            stats_add(STAT_ALLOCATIONS, 1);
+        }
+    }
+
+    // Assign the data to the cluster
+    for (uint32_t i = 0, k = 0; i < rows; ++i)
+    {
+        k = labels[i];
+        gsl_vector_view data_row = gsl_matrix_row(data, i);
+        gsl_vector_view clust_row = gsl_matrix_row(clusters[k], filled[k]);
+        gsl_vector_memcpy(&clust_row.vector, &data_row.vector);
+        filled[k] += 1;
+    }
+}
+
+
+/**
+ * Updates each centroid to the mean of the rows assigned to its cluster,
+ * empty clusters keep their previous centroid.
+ *
+ * @param data      Pointer to matrix containing the data
+ * @param labels    Cluster assignment for each row of data
+ * @param counts    Number of rows assigned to each cluster
+ * @param centroids Pointer to matrix containing centroids to be updated
+ * @param weights   The number of rows each row of data stands for, NULL for 1
+ */
+static void mean_centroids(gsl_matrix *data, uint32_t *labels, uint32_t *counts,
+                           gsl_matrix *centroids, const uint32_t *weights)
+{
+    uint32_t rows = data->size1,
+             n_clusters = centroids->size1;
+    double mass[n_clusters];
+
+    for (uint32_t n = 0; n < n_clusters; ++n)
+    {
+        mass[n] = 0;
+        if (counts[n] > 0)
+        {
+            gsl_vector_view cent_row = gsl_matrix_row(centroids, n);
+            gsl_vector_set_zero(&cent_row.vector);
+        }
+    }
+    for (uint32_t i = 0; i < rows; ++i)
+    {
+        double w = weights != NULL ? weights[i] : 1;
+        gsl_vector_view data_row = gsl_matrix_row(data, i);
+        gsl_vector_view cent_row = gsl_matrix_row(centroids, labels[i]);
+        gsl_blas_daxpy(w, &data_row.vector, &cent_row.vector);
+        mass[labels[i]] += w;
+    }
+    for (uint32_t n = 0; n < n_clusters; ++n)
+    {
+        if (counts[n] > 0)
+        {
+            gsl_vector_view cent_row = gsl_matrix_row(centroids, n);
+            gsl_vector_scale(&cent_row.vector, 1.0 / mass[n]);
+        }
+    }
+}
+
+
+/**
+ * Decides whether Lloyd's algorithm continues after an iteration in which the
+ * centroids moved.
+ *
+ * @param budget  The stopping criteria, may be NULL
+ * @param shift   The summed squared distance the centroids moved
+ * @param changed The number of rows that changed cluster
+ * @param rows    The number of rows of data
+ * @param iters   The number of iterations so far
+ * @param cap     The maximum number of iterations
+ *
+ * @return        Why Lloyd's algorithm stops, LLOYD_RUNNING to continue
+ */
+static lloyd_stop lloyd_continue(const lloyd_budget *budget, double shift, uint32_t changed,
+                                 uint32_t rows, uint32_t iters, uint32_t cap)
+{
+    if (budget != NULL && shift <= budget->shift_tol)
+        return LLOYD_TOLERANCE;
+
+    if (budget != NULL && budget->min_changed > 0 && changed <= budget->min_changed * rows)
+        return LLOYD_CHANGED;
+
+    if (iters >= cap)
+        return LLOYD_CAPPED;
+
+    return LLOYD_RUNNING;
+}
+
 
-    gsl_vector *sub = gsl_vector_alloc(cols);
-    gsl_matrix *clust_stats = gsl_matrix_alloc(trials, rows);
-    gsl_matrix *centroids = gsl_matrix_alloc(n_clusters, cols);
+/**
+ * Performs a single trial of Lloyd's algorithm from the initial centroids,
+ * the centroids are updated in place to the mean of each cluster and empty
+ * clusters keep their previous centroid.
+ *
+ * @param data      Pointer to matrix containing the data
+ * @param centroids Pointer to matrix containing the initial centroids
+ * @param labels    Cluster assignment for each row of data, populated by function
+ * @param counts    Number of rows assigned to each cluster, populated by function
+ * @param weights   The number of rows each row of data stands for, NULL for 1
+ *
+ * @return          The sum of squared errors of the final assignment
+ */
+static double lloyd_trial(gsl_matrix *data, gsl_matrix *centroids, uint32_t *labels,
+                          uint32_t *counts, const uint32_t *weights)
+{
+    uint32_t rows = data->size1,
+             cols = data->size2,
+             n_clusters = centroids->size1,
+             iters = 0;
+    double sse = 0;
+    lloyd_stop stop = LLOYD_CAPPED;
     gsl_matrix *old_centroids = gsl_matrix_alloc(n_clusters, cols);
+    stats_add(STAT_ALLOCATIONS, 1);
 
-    for (int n = 0; n < n_clusters; ++n)
-        clusters[n] = NULL;
+    // Execute LLoyd's algorithm until convergance
+    for (int run = 0; run < LLOYD_MAX_ITER; ++run)
+    {
+        ++iters;
+        gsl_matrix_memcpy(old_centroids, centroids);
+        assign_clusters(data, centroids, labels, counts);
+
+        mean_centroids(data, labels, counts, centroids, weights);
+
+        // If centroids are the same then clustering has converged
+        if (gsl_matrix_equal(centroids, old_centroids))
+        {
+            stop = LLOYD_CONVERGED;
+            break;
+        }
+    }
+
+    // The assignment is final once the centroids have converged
+    for (uint32_t i = 0; i < rows; ++i)
+    {
+        double w = weights != NULL ? weights[i] : 1;
+        for (uint32_t j = 0; j < cols; ++j)
+        {
+            double diff = gsl_matrix_get(data, i, j) - gsl_matrix_get(centroids, labels[i], j);
+            sse += w * diff * diff;
+        }
+    }
+    stats_lloyd(iters, stop);
+    gsl_matrix_free(old_centroids);
+
+    return sse;
+}
+
+
+match_scratch *match_alloc(uint32_t n_clusters)
+{
+    match_scratch *scratch = (match_scratch *)calloc(1, sizeof(match_scratch));
+
+    if (scratch == NULL)
+    {
+        fprintf(stderr, RED "Unable to allocate the centroid matching!\n" RESET);
+        return NULL;
+    }
+    scratch->n_clusters = n_clusters;
+    scratch->pairs = (match_pair *)malloc((size_t)n_clusters * n_clusters * sizeof(match_pair));
+    scratch->map = (uint32_t *)malloc(n_clusters * sizeof(uint32_t));
+    scratch->matched = (bool *)malloc(n_clusters * sizeof(bool));
+    scratch->used = (bool *)malloc(n_clusters * sizeof(bool));
+    if (scratch->pairs == NULL || scratch->map == NULL || scratch->matched == NULL 
+        || scratch->used == NULL)
+    {
+        fprintf(stderr, RED "Unable to allocate the centroid matching!\n" RESET);
+        match_free(scratch);
+        return NULL;
+    }
+    stats_add(STAT_ALLOCATIONS, 4);
+
+    return scratch;
+}
+
+
+void match_free(match_scratch *scratch)
+{
+    if (scratch == NULL)
+    {
+        return;
+    }
+    free(scratch->pairs);
+    free(scratch->map);
+    free(scratch->matched);
+    free(scratch->used);
+    free(scratch);
+}
+
+
+/**
+ * Orders the pairs of centroids by distance, ties by the row of the centroid
+ * and then of the reference, for qsort.
+ */
+static int compare_pairs(const void *p1, const void *p2)
+{
+    const match_pair *x = (const match_pair *)p1,
+                     *y = (const match_pair *)p2;
+
+    if (x->dist != y->dist)
+        return x->dist < y->dist ? -1 : 1;
+    if (x->a != y->a)
+        return x->a < y->a ? -1 : 1;
+    return (x->b > y->b) - (x->b < y->b);
+}
+
+
+void match_centroids(gsl_matrix *centroids, gsl_matrix *reference, uint32_t *map,
+                     match_scratch *scratch)
+{
+    uint32_t n_clusters = centroids->size1,
+             cols = centroids->size2,
+             n_matched = 0;
+    match_pair *pairs = scratch->pairs;
+
+    for (uint32_t a = 0; a < n_clusters; ++a)
+    {
+        const double *x = gsl_matrix_const_ptr(centroids, a, 0);
+
+        scratch->matched[a] = scratch->used[a] = false;
+        for (uint32_t b = 0; b < n_clusters; ++b)
+        {
+            const double *y = gsl_matrix_const_ptr(reference, b, 0);
+            match_pair *pair = &pairs[(size_t)a * n_clusters + b];
+
+            pair->dist = 0;
+            pair->a = a;
+            pair->b = b;
+            for (uint32_t j = 0; j < cols; ++j)
+                pair->dist += (x[j] - y[j]) * (x[j] - y[j]);
+        }
+    }
+    qsort(pairs, (size_t)n_clusters * n_clusters, sizeof(match_pair), compare_pairs);
+
+    // Match the closest remaining pair until every cluster is matched
+    for (size_t p = 0; n_matched < n_clusters; ++p)
+    {
+        if (scratch->matched[pairs[p].a] || scratch->used[pairs[p].b])
+            continue;
+        map[pairs[p].a] = pairs[p].b;
+        scratch->matched[pairs[p].a] = scratch->used[pairs[p].b] = true;
+        ++n_matched;
+    }
+}
+
+
+int lloyd_random(int trials, gsl_matrix *data, int n_clusters, int select, int threads,
+                 gsl_matrix *centroids, gsl_matrix **clusters, pcg32_random_t *rng,
+                 const uint32_t *weights)
+{
+    uint32_t rows = data->size1,
+             cols = data->size2;
+    uint32_t counts[n_clusters];
+    uint64_t seed = 0;
+    int best = 0;
+    int status = SUCCESS;
+
+    if (trials < 1)
+    {
+        fprintf(stderr, RED "Require at least one trial for Lloyd's algorithm!\n" RESET);
+        return ERROR;
+    }
+    threads = threads > 0 ? threads : omp_get_max_threads();
+
+    // The assignment, counts, centroids and score of each trial, and the
+    // clusters scored by each thread
+    uint32_t *labels = (uint32_t *)malloc((size_t)trials * rows * sizeof(uint32_t)),
+             *all_counts = (uint32_t *)malloc((size_t)trials * n_clusters * sizeof(uint32_t));
+    gsl_matrix **trial_centroids = (gsl_matrix **)calloc(trials, sizeof(gsl_matrix *)),
+               **tables = (gsl_matrix **)calloc((size_t)threads * n_clusters, sizeof(gsl_matrix *));
+    double *score = (double *)malloc(trials * sizeof(double));
+    uint32_t (*map)[n_clusters] = NULL;
+    uint32_t *votes = NULL;
+    match_scratch *scratch = NULL;
 
+    if (labels == NULL || all_counts == NULL || trial_centroids == NULL || tables == NULL 
+        || score == NULL)
+    {
+        fprintf(stderr, RED "Unable to allocate memory for the trials!\n" RESET);
+        status = ERROR;
+        goto free;
+    }
+
+    // Each trial draws from its own stream so results do not depend on the threads
+    seed = ((uint64_t)pcg32_random_r(rng) << 32) | pcg32_random_r(rng);
+
+    #pragma omp parallel for schedule(dynamic, 1) num_threads(threads)
     for (int trial = 0; trial < trials; ++trial)
     {
+        pcg32_random_t trial_rng;
+        uint32_t *trial_counts = &all_counts[(size_t)trial * n_clusters],
+                 *trial_labels = &labels[(size_t)trial * rows];
+        gsl_matrix *cent = gsl_matrix_alloc(n_clusters, cols);
+        stats_add(STAT_ALLOCATIONS, 1);
+
+        trace_begin("trial", trial);
+        pcg32_srandom_r(&trial_rng, seed, (uint64_t)trial);
+
         // Initialize centroids as a random value from data
         for (int i = 0, r = 0; i < n_clusters; ++i)
         {
-            r = (int)pcg32_boundedrand_r(rng, (int)rows);
+            r = (int)pcg32_boundedrand_r(&trial_rng, rows);
             gsl_vector_view data_row = gsl_matrix_row(data, r);
-            gsl_vector_view cent_row = gsl_matrix_row(centroids, i);
-            gsl_vector_view cent_row2 = gsl_matrix_row(old_centroids, i);
+            gsl_vector_view cent_row = gsl_matrix_row(cent, i);
             gsl_vector_memcpy(&cent_row.vector, &data_row.vector);
-            gsl_vector_memcpy(&cent_row2.vector, &cent_row.vector);
         }
 
-        // Execute LLoyd's algorithm until convergance
-        for (int run = 0; run < 10000; ++run)
+        // Lower SSE is better, so negate it to share the comparison with the fitness
+        score[trial] = -lloyd_trial(data, cent, trial_labels, trial_counts, weights);
+
+        if (select == TRIALS_FITNESS)
         {
-            // Reset the counts, stats, and clusters
-            memset(counts, 0, n_clusters * sizeof(int));
-            gsl_matrix_set_zero(clust_stats);
+            gsl_matrix **trial_clusters = &tables[(size_t)omp_get_thread_num() * n_clusters];
 
-            for (int n = 0; n < n_clusters; ++n)
-                gsl_matrix_free(clusters[n]);
+            fill_clusters(data, trial_labels, trial_counts, n_clusters, trial_clusters);
+            score[trial] = dunn_index(cent, n_clusters, trial_clusters);
+        }
+        trial_centroids[trial] = cent;
+        trace_end("trial", trial);
+    }
 
-            // Determine the initial clustering assignment for each
-            for (uint32_t i = 0, k = 0; i < rows; ++i)
-            {
-                double min_norm = DBL_MAX, 
-                       norm = DBL_MAX;
-                gsl_vector_view data_row = gsl_matrix_row(data, i);
+    // Keep the best trial, ties are broken by the lowest trial
+    for (int trial = 1; trial < trials; ++trial)
+    {
+        if (score[trial] > score[best])
+            best = trial;
+    }
 
-                for (int n = 0; n < n_clusters; ++n)
-                {
-                    gsl_vector_view cent_row = gsl_matrix_row(centroids, n);
-                    gsl_vector_memcpy(sub, &data_row.vector);
-                    gsl_vector_sub(sub, &cent_row.vector);
-                    norm = gsl_blas_dnrm2(sub);
-                    
-                    // Assign to the cluster if norm is less than in all previous clusters
-                    if (norm <= min_norm)
-                    {
-                        min_norm = norm;
-                        k = n;
-                    }
-                }
-                gsl_matrix_set(clust_stats, trial, i, k);
-                counts[k] += 1;
+    if (DEBUG == DEBUG_CLUSTER)
+    {
+        printf(YELLOW "CLUSTERING TRIALS RESULTS\n" RESET);
+        for (int i = 0; i < trials; ++i)
+        {
+            printf(YELLOW "trial[%d] = %10.6f " RESET, i, score[i]);
+            for (uint32_t j = 0; j < rows; ++j)
+            {
+                printf(YELLOW "%d " RESET, labels[(size_t)i * rows + j]);
             }
+            printf("\n");
+        }
+    }
 
-            // Allocate the clusters
-            for (int n = 0; n < n_clusters; ++n)
+    if (select == TRIALS_CONSENSUS && trials > 1)
+    {
+        // Align the labels of every trial with the best trial
+        map = malloc(trials * sizeof(*map));
+        votes = (uint32_t *)malloc((size_t)threads * n_clusters * sizeof(uint32_t));
+        if (map == NULL || votes == NULL || (scratch = match_alloc(n_clusters)) == NULL)
+        {
+            fprintf(stderr, RED "Unable to allocate memory for the trials!\n" RESET);
+            status = ERROR;
+            goto free;
+        }
+        for (int trial = 0; trial < trials; ++trial)
+        {
+            match_centroids(trial_centroids[trial], trial_centroids[best], map[trial], scratch);
+        }
+
+        // Assign each row to the cluster it is placed in by the most trials
+        #pragma omp parallel num_threads(threads)
+        {
+            uint32_t *row_votes = &votes[(size_t)omp_get_thread_num() * n_clusters];
+
+            #pragma omp for
+            for (uint32_t i = 0; i < rows; ++i)
             {
-                if (counts[n] < 1)
+                uint32_t k = labels[(size_t)best * rows + i];
+                memset(row_votes, 0, n_clusters * sizeof(uint32_t));
+
+                for (int trial = 0; trial < trials; ++trial)
                 {
-                    clusters[n] = NULL;
+                    row_votes[map[trial][labels[(size_t)trial * rows + i]]] += 1;
                 }
-                else
+                for (int n = 0; n < n_clusters; ++n)
                 {
-                    clusters[n] = gsl_matrix_alloc(counts[n], cols);
-                    gsl_matrix_set_zero(clusters[n]);
+                    if (row_votes[n] > row_votes[k])
+                        k = n;
                 }
+                labels[(size_t)best * rows + i] = k;
             }
-            memset(counts, 0, n_clusters * sizeof(int));
-
-            // Assign the data to the cluster
-            for (uint32_t i = 0, k = 0; i < rows; ++i)
-            {
-                k = gsl_matrix_get(clust_stats, trial, i);
-                gsl_vector_view data_row = gsl_matrix_row(data, i);
-                gsl_vector_view clust_row = gsl_matrix_row(clusters[k], counts[k]);
-                gsl_vector_memcpy(&clust_row.vector, &data_row.vector);
-                counts[k] += 1;
-            }
-
-            // Calculate the new centroids
-            calc_centroids(centroids, data, n_clusters, clusters);
+        }
 
-            // If centroids are the same then clustering has converged
-            if (gsl_matrix_equal(centroids, old_centroids))
-            {
-                break;
-            }
-            gsl_matrix_memcpy(old_centroids, centroids);
+        // The consensus centroids are the mean of each consensus cluster
+        memset(counts, 0, n_clusters * sizeof(uint32_t));
+        for (uint32_t i = 0; i < rows; ++i)
+        {
+            counts[labels[(size_t)best * rows + i]] += 1;
         }
+        mean_centroids(data, &labels[(size_t)best * rows], counts, trial_centroids[best], weights);
     }
 
-    if (DEBUG == DEBUG_CLUSTER)
+    // Copy out the final centroids and clusters
+    if (centroids != NULL)
     {
-        printf(YELLOW "CLUSTERING TRIALS RESULTS\n" RESET);
-        for (int i = 0; i < trials; ++i)
+        gsl_matrix_memcpy(centroids, trial_centroids[best]);
+    }
+    if (clusters != NULL)
+    {
+        memset(counts, 0, n_clusters * sizeof(uint32_t));
+        for (uint32_t i = 0; i < rows; ++i)
         {
-            for (uint32_t j = 0; j < rows; ++j)
-            {
-                if (j == 0)
-                    printf(YELLOW "trial[%d] = %d " RESET, i, (int)gsl_matrix_get(clust_stats, i, j));
-                else
-                    printf(YELLOW "%d " RESET, (int)gsl_matrix_get(clust_stats, i, j));
-            }
-            printf("\n");
+            counts[labels[(size_t)best * rows + i]] += 1;
         }
+        fill_clusters(data, &labels[(size_t)best * rows], counts, n_clusters, clusters);
     }
 
-    // TODO Assign the final clusters based on the stats from the trials
-    /*memset(counts, 0, n_clusters * sizeof(int));
-    for (int i = 0, k = 0; i < rows; ++i)
-    {
-        gsl_vector_view data_row = gsl_matrix_row(data, i);
-        gsl_vector_view clust_stats_col = gsl_matrix_column(clust_stats, i);
-        k = (int)round(gsl_stats_mean(clust_stats_col.vector.data, 1, trials));
-        gsl_vector_view clust_row = gsl_matrix_row(clusters[k], counts[k]);
-        gsl_vector_memcpy(&clust_row.vector, &data_row.vector);
-        counts[k] += 1;
-    }*/
-
-    if (DEBUG == DEBUG_CLUSTER)
+    if (DEBUG == DEBUG_CLUSTER && clusters != NULL)
     {
         printf(YELLOW "FINAL RANDOM CLUSTERING RESULTS\n" RESET);
         for (int n = 0; n < n_clusters; ++n)
@@ -182,99 +512,154 @@ int lloyd_random(int trials, gsl_matrix *data, int n_clusters,
             }
         }
     }
-    gsl_vector_free(sub);
 
-    return SUCCESS;
+free:
+    if (trial_centroids != NULL)
+    {
+        for (int trial = 0; trial < trials; ++trial)
+            gsl_matrix_free(trial_centroids[trial]);
+    }
+    if (tables != NULL)
+    {
+        for (size_t n = 0; n < (size_t)threads * n_clusters; ++n)
+            gsl_matrix_free(tables[n]);
+    }
+    free(trial_centroids);
+    free(tables);
+    free(labels);
+    free(all_counts);
+    free(map);
+    free(votes);
+    match_free(scratch);
+    free(score);
+
+    return status;
 }
 
 
 int lloyd_defined(int trials, gsl_matrix *centroids, gsl_matrix *data, 
-                  int n_clusters, gsl_matrix **clusters)
+                  int n_clusters, gsl_matrix **clusters, const lloyd_budget *budget,
+                  const kd_tree *tree, const uint32_t *weights)
 {
     uint32_t rows = data->size1,
-             cols = data->size2;
-    uint32_t counts[n_clusters];
+             cols = data->size2,
+             max_iter = budget != NULL && budget->max_iter > 0 ? budget->max_iter : LLOYD_MAX_ITER;
+    uint32_t counts[n_clusters],
+             iters = 0,
+             empty = 0;
+    bool track = budget != NULL && budget->min_changed > 0;
+    lloyd_stop stop = LLOYD_RUNNING;
     memset(counts, 0, n_clusters * sizeof(int));
 
-    gsl_vector *sub = gsl_vector_alloc(cols);
-    gsl_matrix *clust_stats = gsl_matrix_alloc(1, rows);
+    uint32_t *labels = (uint32_t *)malloc(rows * sizeof(uint32_t)),
+             *old_labels = track ? (uint32_t *)malloc(rows * sizeof(uint32_t)) : NULL;
+    double *sums = tree != NULL ? (double *)malloc(n_clusters * cols * sizeof(double)) : NULL;
     gsl_matrix *old_centroids = gsl_matrix_alloc(n_clusters, cols);
     gsl_matrix_memcpy(old_centroids, centroids);
+
+    // The previous labels are only kept to count the rows that change cluster
+    if (track)
+        memset(old_labels, 0xff, rows * sizeof(uint32_t));
     
     for (int n = 0; n < n_clusters; ++n)
+    {
+        gsl_matrix_free(clusters[n]);
         clusters[n] = NULL;
+    }
 
-    // Execute LLoyd's algorithm until convergance
-    for (int run = 0; run < 10000; ++run)
+    // Execute LLoyd's algorithm until convergance or the budget is spent
+    while (stop == LLOYD_RUNNING)
     {
-        // Reset the counts, stats, and clusters
-        memset(counts, 0, n_clusters * sizeof(int));
-        gsl_matrix_set_zero(clust_stats);
-
-        for (int n = 0; n < n_clusters; ++n)
-            gsl_matrix_free(clusters[n]);
+        uint32_t changed = 0;
+        double shift = 0;
 
-        // Determine the initial clustering assignment for each
-        for (uint32_t i = 0, k = 0; i < rows; ++i)
+        // Trace the iterations in batches to bound the number of events
+        if (iters % TRACE_LLOYD_BATCH == 0)
         {
-            double min_norm = DBL_MAX, 
-                   norm = DBL_MAX;
-            gsl_vector_view data_row = gsl_matrix_row(data, i);
+            if (iters > 0)
+                trace_end("lloyd", iters - TRACE_LLOYD_BATCH);
+            trace_begin("lloyd", iters);
+        }
+        ++iters;
 
+        // Filter the centroids down the kd-tree, the clusters are only copied
+        // once Lloyd's has stopped
+        if (tree != NULL)
+        {
+            changed = kd_assign(tree, data, centroids, sums, counts, old_labels);
             for (int n = 0; n < n_clusters; ++n)
             {
-                gsl_vector_view cent_row = gsl_matrix_row(centroids, n);
-                gsl_vector_memcpy(sub, &data_row.vector);
-                gsl_vector_sub(sub, &cent_row.vector);
-                norm = gsl_blas_dnrm2(sub);
-                
-                // Assign to the cluster if norm is less than in all previous clusters
-                if (norm <= min_norm)
-                {
-                    min_norm = norm;
-                    k = n;
-                }
+                // Empty clusters keep their previous centroid
+                if (counts[n] == 0)
+                    continue;
+                for (uint32_t j = 0; j < cols; ++j)
+                    gsl_matrix_set(centroids, n, j, sums[n * cols + j] / counts[n]);
             }
-            gsl_matrix_set(clust_stats, 0, i, k);
-            counts[k] += 1;
         }
-
-        // Allocate the clusters
-        for (int n = 0; n < n_clusters; ++n)
+        else if (weights != NULL)
         {
-            if (counts[n] < 1)
-            {
-                clusters[n] = NULL;
-            }
-            else
-            {
-                clusters[n] = gsl_matrix_alloc(counts[n], cols);
-                gsl_matrix_set_zero(clusters[n]);
-            }
+            // The weighted means are calculated from the assignment, the
+            // clusters are only copied once Lloyd's has stopped
+            assign_clusters(data, centroids, labels, counts);
+            mean_centroids(data, labels, counts, centroids, weights);
         }
-        memset(counts, 0, n_clusters * sizeof(int));
-
-        // Assign the data to the cluster
-        for (uint32_t i = 0, k = 0; i < rows; ++i)
+        else
         {
-            k = gsl_matrix_get(clust_stats, 0, i);
-            gsl_vector_view data_row = gsl_matrix_row(data, i);
-            gsl_vector_view clust_row = gsl_matrix_row(clusters[k], counts[k]);
-            gsl_vector_memcpy(&clust_row.vector, &data_row.vector);
-            counts[k] += 1;
+            // Determine the clustering assignment and copy the data to the clusters
+            assign_clusters(data, centroids, labels, counts);
+            fill_clusters(data, labels, counts, n_clusters, clusters);
+
+            // Calculate the new centroids
+            calc_centroids(centroids, data, n_clusters, clusters);
         }
 
-        // Calculate the new centroids
-        calc_centroids(centroids, data, n_clusters, clusters);
+        if (track && tree == NULL)
+        {
+            uint32_t *swap = old_labels;
+            for (uint32_t i = 0; i < rows; ++i)
+            {
+                if (labels[i] != old_labels[i])
+                    ++changed;
+            }
+            old_labels = labels;
+            labels = swap;
+        }
 
         // If centroids are the same then clustering has converged
         if (gsl_matrix_equal(centroids, old_centroids))
         {
+            stop = LLOYD_CONVERGED;
             break;
         }
+        for (size_t i = 0; i < centroids->size1; ++i)
+        {
+            for (size_t j = 0; j < cols; ++j)
+            {
+                double diff = gsl_matrix_get(centroids, i, j) - gsl_matrix_get(old_centroids, i, j);
+                shift += diff * diff;
+            }
+        }
+        stop = lloyd_continue(budget, shift, changed, rows, iters, max_iter);
         gsl_matrix_memcpy(old_centroids, centroids);        
     }
 
+    trace_end("lloyd", (iters - 1) / TRACE_LLOYD_BATCH * TRACE_LLOYD_BATCH);
+
+    if (tree != NULL || weights != NULL)
+    {
+        assign_clusters(data, centroids, labels, counts);
+        fill_clusters(data, labels, counts, n_clusters, clusters);
+    }
+
+    // Record the iterations and the empty clusters at convergence
+    for (int n = 0; n < n_clusters; ++n)
+    {
+        if (clusters[n] == NULL)
+            ++empty;
+    }
+    stats_lloyd(iters, stop);
+    stats_add(STAT_EMPTY_CLUSTERS, empty);
+
     if (DEBUG == DEBUG_CLUSTER)
     {
         printf(YELLOW "FINAL CLUSTERING RESULTS\n" RESET);
@@ -298,17 +683,670 @@ int lloyd_defined(int trials, gsl_matrix *centroids, gsl_matrix *data,
             }
         }
     }
-    gsl_vector_free(sub);
+    free(labels);
+    free(old_labels);
+    free(sums);
+    gsl_matrix_free(old_centroids);
 
     return SUCCESS;
 }
 
 
-int calc_centroids(gsl_matrix *centroids, gsl_matrix *data, int n_clusters, 
-                   gsl_matrix **clusters)
+void assign_clusters(gsl_matrix *data, gsl_matrix *centroids, uint32_t *labels,
+                     uint32_t *counts)
 {
-    uint32_t rows = 0,
-             cols = data->size2;
+    uint32_t rows = data->size1,
+             cols = data->size2,
+             n_clusters = centroids->size1;
+    assign_fn kernel = assign_kernel(cols);
+    gsl_vector *sub = NULL;
+
+    memset(counts, 0, n_clusters * sizeof(uint32_t));
+
+    // Data with few columns is assigned by the fixed dimension kernel, which
+    // compares the squared distances in registers, only the labels and
+    // counts are needed so the rows are not summed
+    if (kernel != NULL && centroids->tda == cols)
+    {
+        memset(labels, 0xff, rows * sizeof(uint32_t));
+        kernel(data->data, data->tda, rows, cols, centroids->data, n_clusters, NULL, counts, labels,
+               NULL);
+        stats_add(STAT_DISTANCES, (uint64_t)rows * n_clusters);
+        return;
+    }
+    sub = gsl_vector_alloc(cols);
+
+    for (uint32_t i = 0, k = 0; i < rows; ++i)
+    {
+        double min_norm = DBL_MAX, 
+               norm = DBL_MAX;
+        gsl_vector_view data_row = gsl_matrix_row(data, i);
+
+        for (uint32_t n = 0; n < n_clusters; ++n)
+        {
+            gsl_vector_view cent_row = gsl_matrix_row(centroids, n);
+            gsl_vector_memcpy(sub, &data_row.vector);
+            gsl_vector_sub(sub, &cent_row.vector);
+            norm = gsl_blas_dnrm2(sub);
+            
+            // Assign to the cluster if norm is less than in all previous clusters
+            if (norm <= min_norm)
+            {
+                min_norm = norm;
+                k = n;
+            }
+        }
+        labels[i] = k;
+        counts[k] += 1;
+    }
+    gsl_vector_free(sub);
+    stats_add(STAT_DISTANCES, (uint64_t)rows * n_clusters);
+    stats_add(STAT_ALLOCATIONS, 1);
+}
+
+
+int nearest_centroids(gsl_matrix *data, gsl_matrix *centroids, uint32_t *labels,
+                      double *distances, int threads)
+{
+    uint32_t rows = data->size1,
+             cols = data->size2,
+             n_clusters = centroids->size1;
+    assign_fn kernel = assign_kernel(cols);
+    double *trans = NULL,
+           *scratch = NULL;
+    uint32_t *scratch_counts = NULL;
+
+    threads = threads > 0 ? threads : omp_get_max_threads();
+
+    // Too few centroids to fill the SIMD lanes, the fixed dimension kernel
+    // compares the centroids of each row in registers instead
+    if (kernel != NULL && centroids->tda == cols && n_clusters < NEAREST_MIN_CLUSTERS)
+    {
+        // The counts of each thread, allocated once for the team, the rows
+        // are not summed
+        scratch_counts = (uint32_t *)malloc((size_t)threads * n_clusters * sizeof(uint32_t));
+        if (scratch_counts == NULL)
+        {
+            fprintf(stderr, RED "Unable to allocate the assignment counts!\n" RESET);
+            return ERROR;
+        }
+
+        #pragma omp parallel num_threads(threads)
+        {
+            int t = omp_get_thread_num(),
+                n_threads = omp_get_num_threads();
+            uint32_t first = (uint64_t)rows * t / n_threads,
+                     last = (uint64_t)rows * (t + 1) / n_threads;
+            uint32_t *counts = scratch_counts + (size_t)t * n_clusters;
+
+            memset(counts, 0, n_clusters * sizeof(uint32_t));
+            memset(labels + first, 0xff, (last - first) * sizeof(uint32_t));
+            kernel(gsl_matrix_const_ptr(data, first, 0), data->tda, last - first, cols,
+                   centroids->data, n_clusters, NULL, counts, labels + first, NULL);
+            for (uint32_t i = first; distances != NULL && i < last; ++i)
+            {
+                const double *row = gsl_matrix_const_ptr(data, i, 0),
+                             *cent = gsl_matrix_const_ptr(centroids, labels[i], 0);
+                double dist = 0;
+                for (uint32_t j = 0; j < cols; ++j)
+                    dist += (row[j] - cent[j]) * (row[j] - cent[j]);
+                distances[i] = sqrt(dist);
+            }
+        }
+        free(scratch_counts);
+        stats_add(STAT_DISTANCES, (uint64_t)rows * n_clusters);
+        stats_add(STAT_ALLOCATIONS, 1);
+        return SUCCESS;
+    }
+
+    // The transposed centroids and the distances of each thread
+    trans = (double *)malloc((size_t)cols * n_clusters * sizeof(double));
+    scratch = (double *)malloc((size_t)threads * n_clusters * sizeof(double));
+    if (trans == NULL || scratch == NULL)
+    {
+        fprintf(stderr, RED "Unable to allocate the transposed centroids!\n" RESET);
+        free(trans);
+        free(scratch);
+        return ERROR;
+    }
+
+    // Each column of the transposed centroids is contiguous across the clusters
+    for (uint32_t n = 0; n < n_clusters; ++n)
+    {
+        for (uint32_t j = 0; j < cols; ++j)
+            trans[(size_t)j * n_clusters + n] = gsl_matrix_get(centroids, n, j);
+    }
+
+    #pragma omp parallel num_threads(threads)
+    {
+        double *dist = scratch + (size_t)omp_get_thread_num() * n_clusters;
+
+        #pragma omp for schedule(static)
+        for (uint32_t i = 0; i < rows; ++i)
+        {
+            const double *row = gsl_matrix_const_ptr(data, i, 0);
+            double min_dist = DBL_MAX;
+            uint32_t k = 0;
+
+            memset(dist, 0, n_clusters * sizeof(double));
+            for (uint32_t j = 0; j < cols; ++j)
+            {
+                const double x = row[j],
+                             *restrict cent = trans + (size_t)j * n_clusters;
+                #pragma omp simd
+                for (uint32_t n = 0; n < n_clusters; ++n)
+                {
+                    double diff = x - cent[n];
+                    dist[n] += diff * diff;
+                }
+            }
+            for (uint32_t n = 0; n < n_clusters; ++n)
+            {
+                if (dist[n] <= min_dist)
+                {
+                    min_dist = dist[n];
+                    k = n;
+                }
+            }
+            labels[i] = k;
+            if (distances != NULL)
+                distances[i] = sqrt(min_dist);
+        }
+    }
+    free(trans);
+    free(scratch);
+    stats_add(STAT_DISTANCES, (uint64_t)rows * n_clusters);
+    stats_add(STAT_ALLOCATIONS, 2);
+
+    return SUCCESS;
+}
+
+
+int build_clusters(gsl_matrix *centroids, gsl_matrix *data, int n_clusters,
+                   gsl_matrix **clusters)
+{
+    uint32_t counts[n_clusters];
+    uint32_t *labels = (uint32_t *)malloc(data->size1 * sizeof(uint32_t));
+
+    if (labels == NULL)
+    {
+        fprintf(stderr, RED "Unable to allocate cluster labels!\n" RESET);
+        return ERROR;
+    }
+    assign_clusters(data, centroids, labels, counts);
+    fill_clusters(data, labels, counts, n_clusters, clusters);
+    free(labels);
+
+    return SUCCESS;
+}
+
+
+/**
+ * Assigns a block of rows to the nearest centroid of a single chromosome and
+ * accumulates the rows into the sums and counts of each cluster.
+ *
+ * @param data       Pointer to the first row of the block
+ * @param tda        The number of doubles between rows of data
+ * @param rows       The number of rows in the block
+ * @param cols       The number of columns of data
+ * @param centroids  The n_clusters x cols centroids of the chromosome
+ * @param n_clusters The number of clusters
+ * @param sums       The n_clusters x cols sums of the rows in each cluster, NULL to
+ *                   only count the rows
+ * @param counts     The number of rows in each cluster
+ * @param labels     The cluster of each row of the block from the previous
+ *                   iteration, updated by function, may be NULL
+ * @param weights    The number of rows each row of the block stands for, NULL for 1
+ *
+ * @return           The number of rows that changed cluster, 0 if labels is NULL
+ */
+static FORCE_INLINE uint32_t assign_block(const double *restrict data, size_t tda, uint32_t rows, 
+                                          uint32_t cols, const double *restrict centroids,
+                                          int n_clusters, double *restrict sums,
+                                          uint32_t *restrict counts, uint32_t *restrict labels,
+                                          const uint32_t *restrict weights)
+{
+    uint32_t changed = 0;
+
+    for (uint32_t i = 0; i < rows; ++i)
+    {
+        const double *row = data + i * tda;
+        double min_dist = DBL_MAX;
+        int k = 0;
+
+        for (int n = 0; n < n_clusters; ++n)
+        {
+            const double *cent = centroids + n * cols;
+            double dist = 0;
+
+            for (uint32_t j = 0; j < cols; ++j)
+            {
+                double diff = row[j] - cent[j];
+                dist += diff * diff;
+            }
+
+            // Assign to the cluster if distance is less than in all previous clusters
+            if (dist <= min_dist)
+            {
+                min_dist = dist;
+                k = n;
+            }
+        }
+
+        if (weights != NULL)
+        {
+            for (uint32_t j = 0; sums != NULL && j < cols; ++j)
+                sums[k * cols + j] += weights[i] * row[j];
+            counts[k] += weights[i];
+        }
+        else
+        {
+            for (uint32_t j = 0; sums != NULL && j < cols; ++j)
+                sums[k * cols + j] += row[j];
+            counts[k] += 1;
+        }
+
+        if (labels != NULL && labels[i] != (uint32_t)k)
+        {
+            labels[i] = k;
+            ++changed;
+        }
+    }
+    return changed;
+}
+
+
+// Defines assign_block_D(), assign_block() inlined for exactly D columns
+#define ASSIGN_BLOCK_FIXED(D)                                                           \
+static uint32_t assign_block_##D(const double *restrict data, size_t tda, uint32_t rows,  \
+                                 uint32_t cols, const double *restrict centroids,         \
+                                 int n_clusters, double *restrict sums,                   \
+                                 uint32_t *restrict counts, uint32_t *restrict labels,    \
+                                 const uint32_t *restrict weights)                        \
+{                                                                                       \
+    (void)cols;                                                                         \
+    return assign_block(data, tda, rows, D, centroids, n_clusters, sums, counts, labels,  \
+                        weights);                                                       \
+}
+
+ASSIGN_BLOCK_FIXED(2)
+ASSIGN_BLOCK_FIXED(3)
+ASSIGN_BLOCK_FIXED(4)
+ASSIGN_BLOCK_FIXED(8)
+ASSIGN_BLOCK_FIXED(16)
+
+
+/**
+ * Selects the kernel that assigns blocks of rows with exactly the given
+ * number of columns.
+ *
+ * @param cols The number of columns of data
+ *
+ * @return     The fixed dimension kernel, NULL to use assign_block()
+ */
+static assign_fn assign_kernel(uint32_t cols)
+{
+    switch (cols)
+    {
+        case 2:
+            return assign_block_2;
+        case 3:
+            return assign_block_3;
+        case 4:
+            return assign_block_4;
+        case 8:
+            return assign_block_8;
+        case 16:
+            return assign_block_16;
+        default:
+            return NULL;
+    }
+}
+
+
+/**
+ * The squared distance between a row and a centroid summed in blocks of
+ * PDS_BLOCK dimensions, abandoned once the partial distance exceeds the bound.
+ *
+ * @param row   The row of data
+ * @param cent  The centroid
+ * @param cols  The number of columns of data
+ * @param bound The distance beyond which the sum is abandoned
+ * @param dims  The number of dimensions summed, incremented by function
+ *
+ * @return      The squared distance, or a partial distance above the bound
+ */
+static inline double pds_dist(const double *restrict row, const double *restrict cent,
+                              uint32_t cols, double bound, uint64_t *dims)
+{
+    uint32_t whole = cols - cols % PDS_BLOCK,
+             j = 0;
+    double dist = 0;
+
+    // Whole blocks have a constant trip count so they are vectorized
+    for (; j < whole && dist <= bound; j += PDS_BLOCK)
+    {
+        const double *r = row + j,
+                     *c = cent + j;
+        double part = 0;
+        #pragma omp simd reduction(+:part)
+        for (int d = 0; d < PDS_BLOCK; ++d)
+        {
+            double diff = r[d] - c[d];
+            part += diff * diff;
+        }
+        dist += part;
+    }
+    for (; j < cols && dist <= bound; ++j)
+    {
+        double diff = row[j] - cent[j];
+        dist += diff * diff;
+    }
+    *dims += j;
+
+    return dist;
+}
+
+
+/**
+ * Assigns a block of rows to the nearest centroid of a single chromosome with
+ * a partial distance search, the rows and centroids have their dimensions
+ * ordered by decreasing variance. The centroid of the previous iteration is
+ * measured first for a tight bound and every other centroid is abandoned as
+ * soon as its partial distance exceeds the nearest so far.
+ *
+ * @param data       Pointer to the first row of the block, in variance order
+ * @param rows       The number of rows in the block
+ * @param cols       The number of columns of data
+ * @param centroids  The n_clusters x cols centroids of the chromosome, in
+ *                   variance order
+ * @param n_clusters The number of clusters
+ * @param sums       The n_clusters x cols sums of the rows in each cluster, in
+ *                   variance order
+ * @param counts     The number of rows in each cluster
+ * @param labels     The cluster of each row of the block from the previous
+ *                   iteration, UINT32_MAX before the first, updated by function
+ * @param weights    The number of rows each row of the block stands for, NULL for 1
+ * @param examined   The number of dimensions summed, incremented by function
+ *
+ * @return           The number of rows that changed cluster
+ */
+static uint32_t assign_block_pds(const double *restrict data, uint32_t rows, uint32_t cols,
+                                 const double *restrict centroids, int n_clusters,
+                                 double *restrict sums, uint32_t *restrict counts, 
+                                 uint32_t *restrict labels, const uint32_t *restrict weights,
+                                 uint64_t *examined)
+{
+    uint32_t changed = 0;
+    uint64_t dims = 0;
+
+    for (uint32_t i = 0; i < rows; ++i)
+    {
+        const double *row = data + (size_t)i * cols;
+        double min_dist = DBL_MAX;
+        int k = 0,
+            prev = labels[i] < (uint32_t)n_clusters ? (int)labels[i] : -1;
+        uint32_t w = weights != NULL ? weights[i] : 1;
+
+        if (prev >= 0)
+        {
+            min_dist = pds_dist(row, centroids + prev * cols, cols, DBL_MAX, &dims);
+            k = prev;
+        }
+
+        for (int n = 0; n < n_clusters; ++n)
+        {
+            double dist = 0;
+            if (n == prev)
+                continue;
+            dist = pds_dist(row, centroids + n * cols, cols, min_dist, &dims);
+
+            // Ties go to the last of the clusters as when every distance is summed
+            if (dist < min_dist || (dist == min_dist && n > k))
+            {
+                min_dist = dist;
+                k = n;
+            }
+        }
+
+        for (uint32_t j = 0; j < cols; ++j)
+        {
+            sums[k * cols + j] += w * row[j];
+        }
+        counts[k] += w;
+
+        if (labels[i] != (uint32_t)k)
+        {
+            labels[i] = k;
+            ++changed;
+        }
+    }
+    *examined += dims;
+    return changed;
+}
+
+
+int lloyd_population(gsl_matrix *data, double *population, size_t stride, int size,
+                     int n_clusters, uint32_t block_rows, int threads, const bool *skip,
+                     const lloyd_budget *budget, const uint32_t *caps, const uint32_t *ks,
+                     const kd_tree *tree, const uint32_t *order, const uint32_t *weights)
+{
+    uint32_t rows = data->size1,
+             cols = data->size2,
+             max_iter = budget != NULL && budget->max_iter > 0 ? budget->max_iter : LLOYD_MAX_ITER;
+    size_t centroid_len = (size_t)n_clusters * cols;
+    bool track = budget != NULL && budget->min_changed > 0,
+         pds = order != NULL && tree == NULL;
+    assign_fn kernel = assign_kernel(cols) != NULL ? assign_kernel(cols) : assign_block;
+    int n_active = 0;
+    uint64_t distances = 0;
+    int *active = (int *)malloc(size * sizeof(int));
+    uint32_t *iters = (uint32_t *)calloc(size, sizeof(uint32_t)),
+             *changed = (uint32_t *)calloc(size, sizeof(uint32_t)),
+             *counts = (uint32_t *)malloc((size_t)size * n_clusters * sizeof(uint32_t)),
+             *labels = NULL;
+    double *sums = (double *)malloc((size_t)size * centroid_len * sizeof(double)),
+           *ordered = NULL,
+           *gather = NULL;
+
+    // The labels are only kept to count the rows that change cluster, or
+    // for the partial distance search to start from the previous cluster
+    if (track || pds)
+    {
+        labels = (uint32_t *)malloc((size_t)size * rows * sizeof(uint32_t));
+    }
+
+    // The partial distance search works on copies of the centroids and of each
+    // block of rows with the dimensions in variance order
+    if (pds)
+    {
+        ordered = (double *)malloc((size_t)size * centroid_len * sizeof(double));
+        gather = (double *)malloc((size_t)threads * block_rows * cols * sizeof(double));
+    }
+
+    if (active == NULL || iters == NULL || changed == NULL || counts == NULL || sums == NULL
+        || ((track || pds) && labels == NULL) || (pds && (ordered == NULL || gather == NULL)))
+    {
+        fprintf(stderr, RED "Unable to allocate population Lloyd's buffers!\n" RESET);
+        free(active);
+        free(iters);
+        free(changed);
+        free(counts);
+        free(labels);
+        free(sums);
+        free(ordered);
+        free(gather);
+        return ERROR;
+    }
+    stats_add(STAT_ALLOCATIONS, 5 + (track || pds) + 2 * pds);
+
+    for (int c = 0; c < size; ++c)
+    {
+        if (skip == NULL || !skip[c])
+            active[n_active++] = c;
+    }
+    if (track || pds)
+    {
+        memset(labels, 0xff, (size_t)size * rows * sizeof(uint32_t));
+    }
+
+    // Execute LLoyd's algorithm until every chromosome has converged or stopped
+    for (int run = 0; n_active > 0; ++run)
+    {
+        // Stream each block of rows once through all of the active chromosomes,
+        // each thread evaluates an equal share of the active chromosomes
+        #pragma omp parallel num_threads(threads)
+        {
+            int tid = omp_get_thread_num(),
+                n_threads = omp_get_num_threads(),
+                lo = (int)((int64_t)n_active * tid / n_threads),
+                hi = (int)((int64_t)n_active * (tid + 1) / n_threads);
+            double *buf = pds ? gather + (size_t)tid * block_rows * cols : NULL;
+            uint64_t examined = 0;
+
+            trace_begin("lloyd_batch", run);
+            for (int a = lo; a < hi; ++a)
+            {
+                int c = active[a];
+                memset(sums + c * centroid_len, 0, centroid_len * sizeof(double));
+                memset(counts + c * n_clusters, 0, n_clusters * sizeof(uint32_t));
+                changed[c] = 0;
+
+                for (size_t n = 0; pds && n < centroid_len; n += cols)
+                {
+                    for (uint32_t p = 0; p < cols; ++p)
+                        ordered[c * centroid_len + n + p] = population[c * stride + n + order[p]];
+                }
+            }
+
+            // Each chromosome filters its centroids down the shared kd-tree
+            for (int a = lo; tree != NULL && a < hi; ++a)
+            {
+                int c = active[a];
+                gsl_matrix_view cent = gsl_matrix_view_array(population + c * stride, 
+                                                             ks != NULL ? ks[c] : (uint32_t)n_clusters,
+                                                             cols);
+                changed[c] = kd_assign(tree, data, &cent.matrix, sums + c * centroid_len,
+                                       counts + c * n_clusters, 
+                                       track ? labels + (size_t)c * rows : NULL);
+            }
+
+            for (uint32_t r = 0; tree == NULL && r < rows; r += block_rows)
+            {
+                uint32_t len = rows - r < block_rows ? rows - r : block_rows;
+                const double *block = data->data + (size_t)r * data->tda;
+
+                // Gather the block once for all of the chromosomes of this thread
+                for (uint32_t i = 0; pds && lo < hi && i < len; ++i)
+                {
+                    for (uint32_t p = 0; p < cols; ++p)
+                        buf[(size_t)i * cols + p] = block[(size_t)i * data->tda + order[p]];
+                }
+
+                for (int a = lo; a < hi; ++a)
+                {
+                    int c = active[a];
+                    if (pds)
+                    {
+                        changed[c] += assign_block_pds(buf, len, cols, ordered + c * centroid_len,
+                                                       ks != NULL ? (int)ks[c] : n_clusters,
+                                                       sums + c * centroid_len, counts + c * n_clusters,
+                                                       labels + (size_t)c * rows + r,
+                                                       weights != NULL ? weights + r : NULL,
+                                                       &examined);
+                        continue;
+                    }
+                    changed[c] += kernel(block, data->tda, len, cols, population + c * stride,
+                                         ks != NULL ? (int)ks[c] : n_clusters,
+                                         sums + c * centroid_len, counts + c * n_clusters,
+                                         track ? labels + (size_t)c * rows + r : NULL,
+                                         weights != NULL ? weights + r : NULL);
+                }
+            }
+            if (pds)
+                stats_add(STAT_PDS_DIMS, examined);
+            trace_end("lloyd_batch", run);
+        }
+        if (tree == NULL)
+        {
+            distances = 0;
+            for (int a = 0; a < n_active; ++a)
+                distances += ks != NULL ? ks[active[a]] : (uint64_t)n_clusters;
+            stats_add(STAT_DISTANCES, distances * rows);
+            if (pds)
+                stats_add(STAT_PDS_DISTANCES, distances * rows);
+        }
+
+        // Calculate the new centroids and drop the chromosomes that have stopped
+        int n_next = 0;
+        for (int a = 0; a < n_active; ++a)
+        {
+            int c = active[a];
+            lloyd_stop stop = LLOYD_CONVERGED;
+            double shift = 0,
+                   *cent = population + c * stride,
+                   *sum = sums + c * centroid_len;
+            uint32_t *count = counts + c * n_clusters;
+            int k = ks != NULL ? (int)ks[c] : n_clusters;
+
+            for (int n = 0; n < k; ++n)
+            {
+                // Empty clusters keep their previous centroid
+                if (count[n] == 0)
+                    continue;
+
+                // The sums of the partial distance search are in variance order
+                for (uint32_t j = 0; j < cols; ++j)
+                {
+                    uint32_t d = pds ? order[j] : j;
+                    double mean = sum[n * cols + j] / count[n];
+                    shift += (mean - cent[n * cols + d]) * (mean - cent[n * cols + d]);
+                    cent[n * cols + d] = mean;
+                }
+            }
+            iters[c] += 1;
+
+            if (shift > 0)
+                stop = lloyd_continue(budget, shift, changed[c], rows, iters[c], 
+                                      caps != NULL ? caps[c] : max_iter);
+
+            if (stop != LLOYD_RUNNING)
+            {
+                uint32_t empty = 0;
+                for (int n = 0; n < k; ++n)
+                {
+                    if (count[n] == 0)
+                        ++empty;
+                }
+                stats_lloyd(iters[c], stop);
+                stats_add(STAT_EMPTY_CLUSTERS, empty);
+            }
+            else
+            {
+                active[n_next++] = c;
+            }
+        }
+        n_active = n_next;
+    }
+
+    free(active);
+    free(iters);
+    free(changed);
+    free(counts);
+    free(labels);
+    free(sums);
+    free(ordered);
+    free(gather);
+
+    return SUCCESS;
+}
+
+
+int calc_centroids(gsl_matrix *centroids, gsl_matrix *data, int n_clusters, 
+                   gsl_matrix **clusters)
+{
+    uint32_t rows = 0,
+             cols = data->size2;
 
     // Calculate the centroid for each cluster
     for (int n = 0; n < n_clusters; ++n)
@@ -323,7 +1361,7 @@ int calc_centroids(gsl_matrix *centroids, gsl_matrix *data, int n_clusters,
         for (uint32_t j = 0; j < cols; ++j)
         {
             gsl_vector_view col = gsl_matrix_column(clusters[n], j);
-            gsl_matrix_set(centroids, n, j, gsl_stats_mean(col.vector.data, 1, rows));
+            gsl_matrix_set(centroids, n, j, gsl_stats_mean(col.vector.data, col.vector.stride, rows));
         }
     }
 
@@ -359,6 +1397,37 @@ int calc_bounds(gsl_matrix *data, gsl_matrix *bounds)
 }
 
 
+int calc_dim_order(gsl_matrix *data, uint32_t *order)
+{
+    uint32_t cols = data->size2;
+    double *variance = (double *)calloc(cols, sizeof(double));
+    size_t *index = (size_t *)malloc(cols * sizeof(size_t));
+
+    if (variance == NULL || index == NULL)
+    {
+        fprintf(stderr, RED "Unable to allocate the dimension order!\n" RESET);
+        free(variance);
+        free(index);
+        return ERROR;
+    }
+
+    // Sort by the negated variance for the dimensions in decreasing order
+    for (uint32_t j = 0; j < cols; ++j)
+    {
+        gsl_vector_view col = gsl_matrix_column(data, j);
+        variance[j] = -gsl_stats_variance(col.vector.data, col.vector.stride, data->size1);
+    }
+    gsl_sort_index(index, variance, 1, cols);
+    for (uint32_t j = 0; j < cols; ++j)
+        order[j] = (uint32_t)index[j];
+
+    free(variance);
+    free(index);
+
+    return SUCCESS;
+}
+
+
 int random_centroids(gsl_matrix *centroids, gsl_matrix *bounds, pcg32_random_t *rng)
 {
     uint32_t rows = centroids->size1,
@@ -390,4 +1459,387 @@ int random_centroids(gsl_matrix *centroids, gsl_matrix *bounds, pcg32_random_t *
     }
 
     return SUCCESS;
-}
\ No newline at end of file
+}
+
+/**
+ * Calculates the squared euclidean distance between two points.
+ *
+ * @param a    The first point
+ * @param b    The second point
+ * @param cols The number of dimensions
+ *
+ * @return     The squared distance
+ */
+static inline double sq_dist(const double *a, const double *b, uint32_t cols)
+{
+    double sum = 0;
+
+    for (uint32_t j = 0; j < cols; ++j)
+    {
+        double diff = a[j] - b[j];
+        sum += diff * diff;
+    }
+    return sum;
+}
+
+
+/**
+ * Updates the squared distance from each row of data to its nearest centroid
+ * with a new centroid, the rows are split between the threads.
+ *
+ * @param data     Pointer to matrix containing the data
+ * @param centroid The new centroid
+ * @param dist     The squared distance from each row to the nearest centroid
+ * @param threads  The number of threads to use
+ */
+static void update_dist(gsl_matrix *data, const double *centroid, double *dist, int threads)
+{
+    uint32_t rows = data->size1,
+             cols = data->size2;
+
+    #pragma omp parallel for schedule(static) num_threads(threads)
+    for (uint32_t i = 0; i < rows; ++i)
+    {
+        double d = sq_dist(gsl_matrix_const_ptr(data, i, 0), centroid, cols);
+        if (d < dist[i])
+            dist[i] = d;
+    }
+    stats_add(STAT_DISTANCES, rows);
+}
+
+
+/**
+ * Draws an index with probability proportional to its weight, the weights
+ * are summed in order so that the draw does not depend on the threads.
+ *
+ * @param weight The weight of each index
+ * @param n      The number of indices
+ * @param rng    Pointer to the random number generator
+ *
+ * @return       The index drawn, uniform if all of the weights are zero
+ */
+static uint32_t weighted_draw(const double *weight, uint32_t n, pcg32_random_t *rng)
+{
+    double total = 0,
+           r = 0;
+
+    for (uint32_t i = 0; i < n; ++i)
+    {
+        total += weight[i];
+    }
+    if (total <= 0)
+    {
+        return pcg32_boundedrand_r(rng, n);
+    }
+
+    r = ldexp(pcg32_random_r(rng), -32) * total;
+    for (uint32_t i = 0; i < n; ++i)
+    {
+        if (r < weight[i] && weight[i] > 0)
+            return i;
+        r -= weight[i];
+    }
+
+    // Rounding may leave a remainder, return the last non-zero weight
+    for (uint32_t i = n; i-- > 0;)
+    {
+        if (weight[i] > 0)
+            return i;
+    }
+    return n - 1;
+}
+
+
+int kmeanspp_centroids(gsl_matrix *centroids, gsl_matrix *data, int threads,
+                       pcg32_random_t *rng)
+{
+    uint32_t rows = data->size1,
+             n_clusters = centroids->size1,
+             r = 0;
+    double *dist = (double *)malloc(rows * sizeof(double));
+
+    if (dist == NULL)
+    {
+        fprintf(stderr, RED "Unable to allocate memory for k-means++ seeding!\n" RESET);
+        return ERROR;
+    }
+    for (uint32_t i = 0; i < rows; ++i)
+    {
+        dist[i] = INFINITY;
+    }
+
+    // The first centroid is uniform, each of the rest is drawn by squared distance
+    r = pcg32_boundedrand_r(rng, rows);
+    for (uint32_t n = 0; n < n_clusters; ++n)
+    {
+        if (n > 0)
+            r = weighted_draw(dist, rows, rng);
+
+        gsl_vector_const_view data_row = gsl_matrix_const_row(data, r);
+        gsl_vector_view cent_row = gsl_matrix_row(centroids, n);
+        gsl_vector_memcpy(&cent_row.vector, &data_row.vector);
+
+        if (n + 1 < n_clusters)
+            update_dist(data, gsl_matrix_const_ptr(centroids, n, 0), dist, threads);
+    }
+
+    if (DEBUG == DEBUG_CENTROIDS)
+    {
+        printf(YELLOW "K-MEANS++ CENTROIDS\n" RESET);
+        for (uint32_t i = 0; i < n_clusters; ++i)
+        {
+            for (uint32_t j = 0; j < centroids->size2; ++j)
+            {
+                printf(YELLOW "%10.6f " RESET, gsl_matrix_get(centroids, i, j));
+            }
+            printf("\n");
+        }
+    }
+    free(dist);
+
+    return SUCCESS;
+}
+
+
+int kmeans_parallel_centroids(gsl_matrix *centroids, gsl_matrix *data, int rounds,
+                              int threads, pcg32_random_t *rng)
+{
+    uint32_t rows = data->size1,
+             cols = data->size2,
+             n_clusters = centroids->size1,
+             n_blocks = (rows + KMEANS_PARALLEL_BLOCK - 1) / KMEANS_PARALLEL_BLOCK,
+             n_cand = 0,
+             cap = 1 + (uint32_t)rounds * 2 * n_clusters;
+    double oversample = 2.0 * n_clusters;
+    int status = SUCCESS;
+
+    double *dist = (double *)malloc(rows * sizeof(double));
+    uint32_t *cand = (uint32_t *)malloc(cap * sizeof(uint32_t));
+    uint8_t *chosen = (uint8_t *)calloc(rows, sizeof(uint8_t));
+    double *weight = NULL,
+           *cand_dist = NULL,
+           *prob = NULL;
+
+    if (dist == NULL || cand == NULL || chosen == NULL)
+    {
+        fprintf(stderr, RED "Unable to allocate memory for k-means|| seeding!\n" RESET);
+        status = ERROR;
+        goto free;
+    }
+    for (uint32_t i = 0; i < rows; ++i)
+    {
+        dist[i] = INFINITY;
+    }
+
+    // The first candidate is uniform
+    cand[n_cand++] = pcg32_boundedrand_r(rng, rows);
+    chosen[cand[0]] = 1;
+    update_dist(data, gsl_matrix_const_ptr(data, cand[0], 0), dist, threads);
+
+    // Each round samples every row independently by its share of the cost
+    for (int round = 0; round < rounds; ++round)
+    {
+        uint64_t seed = ((uint64_t)pcg32_random_r(rng) << 32) | pcg32_random_r(rng);
+        uint32_t first = n_cand;
+        double cost = 0;
+
+        for (uint32_t i = 0; i < rows; ++i)
+        {
+            cost += dist[i];
+        }
+        if (cost <= 0)
+            break;
+
+        // Each block of rows draws from its own stream so the sample does not
+        // depend on the threads
+        #pragma omp parallel for schedule(static) num_threads(threads)
+        for (uint32_t b = 0; b < n_blocks; ++b)
+        {
+            pcg32_random_t block_rng;
+            uint32_t end = (b + 1) * KMEANS_PARALLEL_BLOCK < rows ?
+                           (b + 1) * KMEANS_PARALLEL_BLOCK : rows;
+
+            pcg32_srandom_r(&block_rng, seed, b);
+            for (uint32_t i = b * KMEANS_PARALLEL_BLOCK; i < end; ++i)
+            {
+                double r = ldexp(pcg32_random_r(&block_rng), -32);
+                if (!chosen[i] && r < oversample * dist[i] / cost)
+                    chosen[i] = 2;
+            }
+        }
+
+        // Gather the new candidates in order of the rows
+        for (uint32_t i = 0; i < rows; ++i)
+        {
+            if (chosen[i] != 2)
+                continue;
+
+            chosen[i] = 1;
+            if (n_cand == cap)
+            {
+                uint32_t *grown = (uint32_t *)realloc(cand, 2 * cap * sizeof(uint32_t));
+                if (grown == NULL)
+                {
+                    fprintf(stderr, RED "Unable to allocate memory for k-means|| seeding!\n" RESET);
+                    status = ERROR;
+                    goto free;
+                }
+                cand = grown;
+                cap *= 2;
+            }
+            cand[n_cand++] = i;
+        }
+
+        for (uint32_t c = first; c < n_cand; ++c)
+        {
+            update_dist(data, gsl_matrix_const_ptr(data, cand[c], 0), dist, threads);
+        }
+    }
+
+    // Weight each candidate by the number of rows nearest to it
+    weight = (double *)calloc(n_cand, sizeof(double));
+    cand_dist = (double *)malloc(n_cand * sizeof(double));
+    prob = (double *)malloc(n_cand * sizeof(double));
+    if (weight == NULL || cand_dist == NULL || prob == NULL)
+    {
+        fprintf(stderr, RED "Unable to allocate memory for k-means|| seeding!\n" RESET);
+        status = ERROR;
+        goto free;
+    }
+
+    #pragma omp parallel for schedule(static) num_threads(threads)
+    for (uint32_t i = 0; i < rows; ++i)
+    {
+        const double *row = gsl_matrix_const_ptr(data, i, 0);
+        double min_dist = INFINITY;
+        uint32_t nearest = 0;
+
+        for (uint32_t c = 0; c < n_cand; ++c)
+        {
+            double d = sq_dist(row, gsl_matrix_const_ptr(data, cand[c], 0), cols);
+            if (d < min_dist)
+            {
+                min_dist = d;
+                nearest = c;
+            }
+        }
+        #pragma omp atomic
+        weight[nearest] += 1;
+    }
+    stats_add(STAT_DISTANCES, (uint64_t)rows * n_cand);
+
+    // Recluster the weighted candidates into the centroids with k-means++
+    for (uint32_t c = 0; c < n_cand; ++c)
+    {
+        cand_dist[c] = INFINITY;
+        prob[c] = weight[c];
+    }
+    for (uint32_t n = 0; n < n_clusters; ++n)
+    {
+        uint32_t r = weighted_draw(prob, n_cand, rng);
+        const double *cent = NULL;
+
+        // Too few candidates, fill the remaining centroids with uniform rows
+        r = n < n_cand ? cand[r] : pcg32_boundedrand_r(rng, rows);
+
+        gsl_vector_const_view data_row = gsl_matrix_const_row(data, r);
+        gsl_vector_view cent_row = gsl_matrix_row(centroids, n);
+        gsl_vector_memcpy(&cent_row.vector, &data_row.vector);
+
+        cent = gsl_matrix_const_ptr(centroids, n, 0);
+        for (uint32_t c = 0; c < n_cand; ++c)
+        {
+            double d = sq_dist(gsl_matrix_const_ptr(data, cand[c], 0), cent, cols);
+            if (d < cand_dist[c])
+                cand_dist[c] = d;
+            prob[c] = weight[c] * cand_dist[c];
+        }
+    }
+
+    if (DEBUG == DEBUG_CENTROIDS)
+    {
+        printf(YELLOW "K-MEANS|| CENTROIDS, CANDIDATES: %d\n" RESET, n_cand);
+        for (uint32_t i = 0; i < n_clusters; ++i)
+        {
+            for (uint32_t j = 0; j < cols; ++j)
+            {
+                printf(YELLOW "%10.6f " RESET, gsl_matrix_get(centroids, i, j));
+            }
+            printf("\n");
+        }
+    }
+
+free:
+    free(dist);
+    free(cand);
+    free(chosen);
+    free(weight);
+    free(cand_dist);
+    free(prob);
+
+    return status;
+}
+
+
+int resample_centroid(gsl_matrix *centroids, uint32_t row, gsl_matrix *data,
+                      pcg32_random_t *rng)
+{
+    uint32_t rows = data->size1,
+             cols = data->size2,
+             n_clusters = centroids->size1,
+             pick = 0;
+    double total = 0,
+           r = 0;
+
+    // Two passes over the data avoid storing the distance of every row, the
+    // first sums the squared distances and the second finds the row drawn
+    for (int pass = 0; pass < 2; ++pass)
+    {
+        for (uint32_t i = 0; i < rows; ++i)
+        {
+            const double *point = gsl_matrix_const_ptr(data, i, 0);
+            double min_dist = INFINITY;
+
+            for (uint32_t n = 0; n < n_clusters; ++n)
+            {
+                double d = 0;
+                if (n == row)
+                    continue;
+                d = sq_dist(point, gsl_matrix_const_ptr(centroids, n, 0), cols);
+                if (d < min_dist)
+                    min_dist = d;
+            }
+
+            if (pass == 0)
+            {
+                total += min_dist;
+                continue;
+            }
+
+            // Rounding may leave a remainder, so fall back to the last candidate
+            if (min_dist > 0)
+                pick = i;
+            if (r < min_dist)
+                break;
+            r -= min_dist;
+        }
+        stats_add(STAT_DISTANCES, (uint64_t)rows * (n_clusters - 1));
+
+        if (pass == 0)
+        {
+            // All of the rows coincide with a centroid, draw a uniform row
+            if (!(total > 0 && isfinite(total)))
+            {
+                pick = pcg32_boundedrand_r(rng, rows);
+                break;
+            }
+            r = ldexp(pcg32_random_r(rng), -32) * total;
+        }
+    }
+
+    gsl_vector_const_view data_row = gsl_matrix_const_row(data, pick);
+    gsl_vector_view cent_row = gsl_matrix_row(centroids, row);
+    gsl_vector_memcpy(&cent_row.vector, &data_row.vector);
+
+    return SUCCESS;
+}
@@ -0,0 +1,173 @@
+/*
+ * Evolutionary K-means clustering (E-means) using Genetic Algorithms.
+ *
+ * Copyright (C) 2015, Jonathan Gillett
+ * All rights reserved.
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+#include <stdio.h>
+#include <stdlib.h>
+#include <stdint.h>
+#include <stdbool.h>
+#include <string.h>
+#include <math.h>
+#include <gsl/gsl_matrix.h>
+#include "utility.h"
+#include "compress.h"
+
+
+/**
+ * The key of a value in a row, the bits of the value for exact duplicates or
+ * the index of its cell of the grid.
+ *
+ * @param x    The value
+ * @param cell The width of the cells of the grid, 0 for exact duplicates
+ *
+ * @return     The key of the value
+ */
+static inline uint64_t value_key(double x, double cell)
+{
+    uint64_t bits = 0;
+
+    if (cell > 0)
+        return (uint64_t)(int64_t)floor(x / cell);
+
+    // Negative zero is a duplicate of zero
+    x = x == 0 ? 0 : x;
+    memcpy(&bits, &x, sizeof(bits));
+    return bits;
+}
+
+
+/**
+ * Hashes the keys of a row with FNV-1a.
+ *
+ * @param data Pointer to matrix containing the data
+ * @param row  The row of data
+ * @param cell The width of the cells of the grid, 0 for exact duplicates
+ *
+ * @return     The hash of the row
+ */
+static uint64_t hash_row(gsl_matrix *data, uint32_t row, double cell)
+{
+    uint64_t hash = 14695981039346656037ULL;
+
+    for (size_t j = 0; j < data->size2; ++j)
+    {
+        uint64_t key = value_key(gsl_matrix_get(data, row, j), cell);
+        for (int b = 0; b < 64; b += 8)
+        {
+            hash ^= (key >> b) & 0xff;
+            hash *= 1099511628211ULL;
+        }
+    }
+    return hash;
+}
+
+
+/**
+ * Compares the keys of two rows.
+ *
+ * @param data Pointer to matrix containing the data
+ * @param a    The first row of data
+ * @param b    The second row of data
+ * @param cell The width of the cells of the grid, 0 for exact duplicates
+ *
+ * @return     True if every key of the rows is equal
+ */
+static bool same_key(gsl_matrix *data, uint32_t a, uint32_t b, double cell)
+{
+    for (size_t j = 0; j < data->size2; ++j)
+    {
+        if (value_key(gsl_matrix_get(data, a, j), cell)
+            != value_key(gsl_matrix_get(data, b, j), cell))
+            return false;
+    }
+    return true;
+}
+
+
+gsl_matrix *compress_data(gsl_matrix *data, double cell, uint32_t *rep, uint32_t **weights)
+{
+    uint32_t rows = data->size1,
+             cols = data->size2,
+             n_reps = 0;
+    size_t slots = 1;
+    uint32_t *table = NULL,
+             *first = NULL,
+             *counts = NULL;
+    gsl_matrix *reps = NULL;
+
+    // Open addressing with at least twice as many slots as rows
+    while (slots < 2 * (size_t)rows)
+        slots <<= 1;
+    table = (uint32_t *)calloc(slots, sizeof(uint32_t));
+    first = (uint32_t *)malloc(rows * sizeof(uint32_t));
+    counts = (uint32_t *)calloc(rows, sizeof(uint32_t));
+    if (table == NULL || first == NULL || counts == NULL)
+    {
+        fprintf(stderr, RED "Unable to allocate the duplicate table!\n" RESET);
+        goto free;
+    }
+
+    // Each slot holds one plus the representative of a key, 0 if empty
+    for (uint32_t i = 0; i < rows; ++i)
+    {
+        size_t s = hash_row(data, i, cell) & (slots - 1);
+
+        while (table[s] != 0 && !same_key(data, first[table[s] - 1], i, cell))
+            s = (s + 1) & (slots - 1);
+        if (table[s] == 0)
+        {
+            first[n_reps] = i;
+            table[s] = ++n_reps;
+        }
+        rep[i] = table[s] - 1;
+        counts[rep[i]] += 1;
+    }
+
+    // The representative is the first row, or the mean of the rows of a cell
+    if ((reps = gsl_matrix_calloc(n_reps, cols)) == NULL)
+    {
+        fprintf(stderr, RED "Unable to allocate the compressed data!\n" RESET);
+        goto free;
+    }
+    for (uint32_t i = 0; i < rows; ++i)
+    {
+        if (cell <= 0 && first[rep[i]] != i)
+            continue;
+        for (uint32_t j = 0; j < cols; ++j)
+        {
+            double x = gsl_matrix_get(data, i, j);
+            *gsl_matrix_ptr(reps, rep[i], j) += cell > 0 ? x / counts[rep[i]] : x;
+        }
+    }
+    *weights = (uint32_t *)realloc(counts, n_reps * sizeof(uint32_t));
+    if (*weights == NULL)
+    {
+        fprintf(stderr, RED "Unable to allocate the weights!\n" RESET);
+        gsl_matrix_free(reps);
+        reps = NULL;
+        goto free;
+    }
+    counts = NULL;
+    printf(CYAN "Compressed %u rows to %u weighted rows\n" RESET, rows, n_reps);
+
+free:
+    free(table);
+    free(first);
+    free(counts);
+    return reps;
+}
@@ -17,290 +17,1335 @@
  * You should have received a copy of the GNU General Public License
  * along with this program.  If not, see <http://www.gnu.org/licenses/>.
  */
+#define _POSIX_C_SOURCE 200112L
 #include <stdio.h>
 #include <stdlib.h>
 #include <stdint.h>
 #include <stdbool.h>
 #include <string.h>
 #include <math.h>
-#include <unistd.h>
 #include <time.h>
-#include <confuse.h>
-#include <unistd.h>
+#include <signal.h>
+#include <omp.h>
 #include <gsl/gsl_matrix.h>
+#include <gsl/gsl_sort.h>
+#include <gsl/gsl_statistics.h>
 #include "utility.h"
 #include "pcg_basic.h"
-#include "io.h"
+#include "emeans.h"
 #include "cluster.h"
 #include "fitness.h"
 #include "operators.h"
+#include "reorder.h"
 #include "selection.h"
+#include "stats.h"
+#include "trace.h"
+
+// Alignment of the population arenas and of each chromosome within them
+#define ARENA_ALIGN 64
 
 
 int DEBUG, VERBOSE;
 
-// Define the configuration parameters
-int64_t n_clusters = 3,
-        trials = 1,
-        size = 100;
-double  m_rate = 0.01,
-        c_rate = 0.70;
-int64_t max_iter = 10000,
-        data_rows = 0,
-        data_cols = 0;
-char    *data_file = NULL,
-        *centroids_file = NULL,
-        *fitness_file = NULL,
-        *cluster_file = NULL;
-
-// The configuration file parsing mappings
-cfg_opt_t opts[] = {
-    CFG_SIMPLE_INT("n_clusters", &n_clusters),
-    CFG_SIMPLE_INT("trials", &trials),
-    CFG_SIMPLE_INT("size", &size),
-    CFG_SIMPLE_FLOAT("m_rate", &m_rate),
-    CFG_SIMPLE_FLOAT("c_rate", &c_rate),
-    CFG_SIMPLE_INT("max_iter", &max_iter),
-    CFG_SIMPLE_INT("data_rows", &data_rows),
-    CFG_SIMPLE_INT("data_cols", &data_cols),
-    CFG_SIMPLE_STR("data_file", &data_file),
-    CFG_SIMPLE_STR("centroids_file", &centroids_file),
-    CFG_SIMPLE_STR("fitness_file", &fitness_file),
-    CFG_SIMPLE_STR("cluster_file", &cluster_file),
-    CFG_END()
+struct emeans_ctx
+{
+    emeans_config config;       /**< The configuration of the current job */
+    gsl_matrix *data;           /**< The data, owned by the caller */
+    gsl_matrix *bounds;         /**< The min/max bounds of the data */
+    double *arena[2];           /**< The population and offspring arenas */
+    gsl_matrix_view *views[2];  /**< The chromosome views into each arena, the rows of
+                                     each view are the clusters of the chromosome */
+    int current;                /**< The arena holding the current population */
+    size_t stride;              /**< Doubles between chromosomes in an arena */
+    gsl_matrix **clusters;      /**< The clusters of each chromosome, size x n_clusters */
+    double *fitness;            /**< The fitness of each chromosome */
+    double *probability;        /**< The roulette wheel probabilities or weights */
+    double *accept;             /**< The acceptance probabilities of the alias table */
+    int *alias;                 /**< The aliases of the alias table */
+    int *parents;               /**< The parents selected for each offspring */
+    bool *cached;               /**< True if the fitness of the chromosome is known */
+    bool *duplicate;            /**< True if the chromosome duplicates another */
+    size_t *order;              /**< The chromosomes sorted by fitness or by key */
+    double *keys;               /**< The sort key of each chromosome for duplicates */
+    double *canon;              /**< The centroids of each chromosome in sorted order */
+    double *mean;               /**< The mean canonical form of the population */
+    double *row;                /**< Scratch for one row of the data */
+    gsl_matrix *spare;          /**< An offspring that does not fit in the population */
+    uint32_t *caps;             /**< The Lloyd's iteration cap of each chromosome */
+    uint32_t *ks;               /**< The number of clusters of each chromosome */
+    int *rank;                  /**< The fitness rank of each chromosome, 0 for the worst */
+    match_scratch **match;      /**< The centroid matching of the aligned crossovers, for
+                                     each thread that breeds */
+    int n_match;                /**< The number of threads matching is allocated for */
+    lloyd_budget budget;        /**< When Lloyd's algorithm stops for each evaluation */
+    double variance;            /**< The total variance of the data */
+    kd_tree *tree;              /**< The kd-tree of the data, built once for all jobs */
+    const uint32_t *weights;    /**< The number of rows each row of data stands for */
+    uint32_t *dims;             /**< The dimensions of the data by decreasing variance */
+    gsl_matrix *best;           /**< The centroids of the best chromosome */
+    uint32_t *labels;           /**< The labels of the best chromosome */
+    uint32_t *counts;           /**< The counts of the best chromosome */
+    bool labeled;               /**< True if the labels are those of the best chromosome */
+    double best_fitness;        /**< The fitness of the best chromosome */
+    int64_t generation;         /**< The number of generations executed */
+    int64_t last_improved;      /**< The generation that found the best chromosome */
+    double start_time;          /**< When the current job started */
+    double run_time;            /**< Seconds spent executing generations of the current job */
+    volatile sig_atomic_t stop; /**< Set by emeans_stop() to terminate */
+    int64_t n_clusters;         /**< The maximum number of clusters memory is allocated for */
+    bool variable;              /**< True if the number of clusters of chromosomes varies */
+    int64_t size;               /**< The population size memory is allocated for */
+    pcg32_random_t rng;         /**< The random number generator */
 };
-cfg_t *cfg;
+
+
+void emeans_defaults(emeans_config *config)
+{
+    config->n_clusters = 3;
+    config->k_min = 2;
+    config->k_max = 0;
+    config->trials = 1;
+    config->trials_select = TRIALS_SSE;
+    config->init_method = INIT_RANDOM;
+    config->init_rounds = 5;
+    config->mutate_method = MUTATE_RANDOM;
+    config->crossover_method = CROSSOVER_CUT;
+    config->steady_state = 0;
+    config->selection = SELECT_ROULETTE;
+    config->tournament = 2;
+    config->elitism = 0;
+    config->dup_tol = -1;
+    config->plateau = 0;
+    config->min_diversity = 0;
+    config->target_fitness = 0;
+    config->time_limit = 0;
+    config->lloyd_max_iter = 0;
+    config->lloyd_min_iter = 5;
+    config->lloyd_adaptive = 0;
+    config->lloyd_tol = 0;
+    config->lloyd_min_changed = 0;
+    config->size = 100;
+    config->max_iter = 10000;
+    config->seed = 0;
+    config->threads = 0;
+    config->batch_kb = 256;
+    config->kdtree = 0;
+    config->pds = 0;
+    config->m_rate = 0.01;
+    config->c_rate = 0.70;
+    config->k_rate = 0.05;
+}
+
+
+/**
+ * Frees the population and all of the memory that depends on its size.
+ *
+ * @param ctx Pointer to the context
+ */
+static void free_population(emeans_ctx *ctx)
+{
+    if (ctx->clusters != NULL)
+    {
+        for (int64_t i = 0; i < ctx->size * ctx->n_clusters; ++i)
+        {
+            gsl_matrix_free(ctx->clusters[i]);
+        }
+    }
+    for (int b = 0; b < 2; ++b)
+    {
+        free(ctx->arena[b]);
+        free(ctx->views[b]);
+        ctx->arena[b] = NULL;
+        ctx->views[b] = NULL;
+    }
+    free(ctx->clusters);
+    free(ctx->fitness);
+    free(ctx->probability);
+    free(ctx->accept);
+    free(ctx->alias);
+    free(ctx->parents);
+    free(ctx->cached);
+    free(ctx->duplicate);
+    free(ctx->order);
+    free(ctx->keys);
+    free(ctx->canon);
+    free(ctx->mean);
+    free(ctx->caps);
+    free(ctx->ks);
+    free(ctx->rank);
+    free(ctx->counts);
+    for (int t = 0; t < ctx->n_match; ++t)
+        match_free(ctx->match[t]);
+    free(ctx->match);
+    gsl_matrix_free(ctx->best);
+    gsl_matrix_free(ctx->spare);
+
+    ctx->clusters = NULL;
+    ctx->fitness = NULL;
+    ctx->probability = NULL;
+    ctx->accept = NULL;
+    ctx->alias = NULL;
+    ctx->parents = NULL;
+    ctx->cached = NULL;
+    ctx->duplicate = NULL;
+    ctx->order = NULL;
+    ctx->keys = NULL;
+    ctx->canon = NULL;
+    ctx->mean = NULL;
+    ctx->caps = NULL;
+    ctx->ks = NULL;
+    ctx->rank = NULL;
+    ctx->spare = NULL;
+    ctx->counts = NULL;
+    ctx->match = NULL;
+    ctx->n_match = 0;
+    ctx->best = NULL;
+    ctx->size = 0;
+    ctx->n_clusters = 0;
+}
 
 
 /**
- * The E-means algorithm, uses a genetic algorithm to optimize the parameters 
- * for the K-means implemetation of clustering based Lloyds clustering algorithm.
+ * Allocates the population and all of the memory that depends on its size.
+ *
+ * @param ctx Pointer to the context
  *
- * @return        Status code, 0 for SUCCESS, 1 for ERROR
+ * @return    The status code, 0 for SUCCESS, 1 for ERROR
  */
-int emeans(void)
+static int alloc_population(emeans_ctx *ctx)
 {
-    gsl_matrix *data = NULL,
-               *bounds = NULL,
-               *parent1 = NULL,
-               *parent2 = NULL,
-               **population = NULL,
-               **new_population = NULL,
-               ***clusters = NULL;
-    int status = SUCCESS;
-    double fitness[size],
-           probability[size];
+    int64_t size = ctx->config.size,
+            n_clusters = ctx->config.k_max > 0 ? ctx->config.k_max : ctx->config.n_clusters,
+            cols = ctx->data->size2;
+    size_t align = ARENA_ALIGN / sizeof(double);
+
+    // Pad each chromosome so that every chromosome starts on a cache line
+    ctx->size = size;
+    ctx->n_clusters = n_clusters;
+    ctx->stride = (n_clusters * cols + align - 1) / align * align;
+    ctx->best = gsl_matrix_alloc(n_clusters, cols);
+    ctx->spare = gsl_matrix_alloc(n_clusters, cols);
+    ctx->clusters = (gsl_matrix **)calloc(size * n_clusters, sizeof(gsl_matrix *));
+    ctx->fitness = (double *)calloc(size, sizeof(double));
+    ctx->probability = (double *)calloc(size, sizeof(double));
+    ctx->accept = (double *)calloc(size, sizeof(double));
+    ctx->alias = (int *)calloc(size, sizeof(int));
+    ctx->parents = (int *)calloc(size, sizeof(int));
+    ctx->cached = (bool *)calloc(size, sizeof(bool));
+    ctx->duplicate = (bool *)calloc(size, sizeof(bool));
+    ctx->order = (size_t *)calloc(size, sizeof(size_t));
+    ctx->keys = (double *)calloc(size, sizeof(double));
+    ctx->canon = (double *)calloc(size * ctx->stride, sizeof(double));
+    ctx->mean = (double *)calloc(n_clusters * cols, sizeof(double));
+    ctx->caps = (uint32_t *)calloc(size, sizeof(uint32_t));
+    ctx->ks = (uint32_t *)calloc(size, sizeof(uint32_t));
+    ctx->rank = (int *)calloc(size, sizeof(int));
+    ctx->counts = (uint32_t *)calloc(n_clusters, sizeof(uint32_t));
+
+    if (ctx->clusters == NULL || ctx->fitness == NULL || ctx->probability == NULL 
+        || ctx->accept == NULL || ctx->alias == NULL || ctx->parents == NULL
+        || ctx->cached == NULL || ctx->duplicate == NULL || ctx->order == NULL
+        || ctx->keys == NULL || ctx->canon == NULL || ctx->mean == NULL || ctx->caps == NULL
+        || ctx->ks == NULL || ctx->rank == NULL || ctx->counts == NULL)
+    {
+        fprintf(stderr, RED "Unable to allocate population of size %ld!\n" RESET, (long)size);
+        return ERROR;
+    }
+
+    // Allocate the population and offspring arenas, swapped every generation
+    for (int b = 0; b < 2; ++b)
+    {
+        void *arena = NULL;
+
+        if (posix_memalign(&arena, ARENA_ALIGN, size * ctx->stride * sizeof(double)) != 0
+            || (ctx->views[b] = (gsl_matrix_view *)malloc(size * sizeof(gsl_matrix_view))) == NULL)
+        {
+            free(arena);
+            fprintf(stderr, RED "Unable to allocate population arena of size %ld!\n" RESET, 
+                    (long)size);
+            return ERROR;
+        }
+        ctx->arena[b] = (double *)arena;
+        memset(ctx->arena[b], 0, size * ctx->stride * sizeof(double));
+
+        for (int64_t i = 0; i < size; ++i)
+        {
+            ctx->views[b][i] = gsl_matrix_view_array(ctx->arena[b] + i * ctx->stride, 
+                                                     n_clusters, cols);
+        }
+    }
+    ctx->current = 0;
+
+    return SUCCESS;
+}
+
+
+/**
+ * The Lloyd's iteration cap of an offspring, new chromosomes have no promise
+ * and run for the minimum iterations while the offspring of the fittest
+ * parents run for up to the maximum.
+ *
+ * @param ctx     Pointer to the context
+ * @param promise The mean fitness rank of the parents, from 0 to 1
+ *
+ * @return        The maximum iterations of Lloyd's algorithm
+ */
+static uint32_t lloyd_cap(emeans_ctx *ctx, double promise)
+{
+    uint32_t hi = ctx->budget.max_iter > 0 ? ctx->budget.max_iter : LLOYD_MAX_ITER,
+             lo = ctx->config.lloyd_min_iter > 0 ? (uint32_t)ctx->config.lloyd_min_iter : 1;
+
+    if (lo > hi)
+        lo = hi;
+
+    return lo + (uint32_t)((hi - lo) * promise);
+}
 
-    // Initialize the PRNG
-    pcg32_random_t rng;
-    int rounds = 5;
-    pcg32_srandom_r(&rng, time(NULL) ^ (intptr_t)&printf, (intptr_t)&rounds);
 
-    // Allocate memory and load the data
-    data = gsl_matrix_alloc(data_rows, data_cols);
-    bounds = gsl_matrix_alloc(data_cols, 2);
-    parent1 = gsl_matrix_alloc(n_clusters, data_cols);
-    parent2 = gsl_matrix_alloc(n_clusters, data_cols);
-    population = (gsl_matrix **)calloc(size, sizeof(gsl_matrix **));
-    new_population = (gsl_matrix **)calloc(size, sizeof(gsl_matrix **));
-    clusters = (gsl_matrix ***)calloc(size, sizeof(gsl_matrix ***));
+emeans_ctx *emeans_create(emeans_config *config, gsl_matrix *data, const uint32_t *weights)
+{
+    emeans_ctx *ctx = NULL;
+
+    if ((ctx = (emeans_ctx *)calloc(1, sizeof(emeans_ctx))) == NULL)
+    {
+        fprintf(stderr, RED "Unable to allocate E-means context!\n" RESET);
+        return NULL;
+    }
+    ctx->data = data;
+    ctx->weights = weights;
+    ctx->bounds = gsl_matrix_alloc(data->size2, 2);
+    ctx->labels = (uint32_t *)calloc(data->size1, sizeof(uint32_t));
+    ctx->dims = (uint32_t *)malloc(data->size2 * sizeof(uint32_t));
+    ctx->row = (double *)malloc(data->size2 * sizeof(double));
+    if (ctx->bounds == NULL || ctx->labels == NULL || ctx->dims == NULL || ctx->row == NULL)
+    {
+        fprintf(stderr, RED "Unable to allocate E-means context!\n" RESET);
+        emeans_free(ctx);
+        return NULL;
+    }
 
-    for (int i = 0; i < (int)size; ++i)
+    // Calculate the bounds, total variance and dimension order of the data
+    // once for all jobs
+    calc_bounds(data, ctx->bounds);
+    if (calc_dim_order(data, ctx->dims) != SUCCESS)
     {
-        clusters[i] = (gsl_matrix **)calloc(n_clusters, sizeof(gsl_matrix **));
-        population[i] = gsl_matrix_alloc(n_clusters, data_cols);
-        new_population[i] = gsl_matrix_alloc(n_clusters, data_cols);
+        emeans_free(ctx);
+        return NULL;
+    }
+    for (size_t j = 0; j < data->size2 && weights == NULL; ++j)
+    {
+        gsl_vector_view col = gsl_matrix_column(data, j);
+        ctx->variance += gsl_stats_variance(col.vector.data, col.vector.stride, data->size1);
+    }
+    for (size_t j = 0; j < data->size2 && weights != NULL; ++j)
+    {
+        double total = 0,
+               mean = 0,
+               sq = 0;
+
+        // The variance of the rows each weighted row stands for
+        for (size_t i = 0; i < data->size1; ++i)
+        {
+            total += weights[i];
+            mean += weights[i] * gsl_matrix_get(data, i, j);
+        }
+        mean /= total;
+        for (size_t i = 0; i < data->size1; ++i)
+        {
+            double diff = gsl_matrix_get(data, i, j) - mean;
+            sq += weights[i] * diff * diff;
+        }
+        ctx->variance += total > 1 ? sq / (total - 1) : 0;
     }
-    if ((status = load_data(data_file, data)) != SUCCESS)
-    {   
-        fprintf(stderr, RED "Unable to load data!\n" RESET);
-        status = ERROR;
-        goto free;
+
+    if (emeans_reset(ctx, config) != SUCCESS)
+    {
+        emeans_free(ctx);
+        return NULL;
     }
 
-    // Calculate the bounds of the data
-    calc_bounds(data, bounds);
+    return ctx;
+}
+
+
+int emeans_reset(emeans_ctx *ctx, emeans_config *config)
+{
+    int rounds = 5,
+        threads = config->threads > 0 ? (int)config->threads : omp_get_max_threads();
+    int64_t k_max = config->k_max > 0 ? config->k_max : config->n_clusters;
+    uint64_t seed = 0;
+
+    if (config->n_clusters < 2 || config->size < 2 || config->size % 2 != 0)
+    {
+        fprintf(stderr, RED "Require n_clusters >= 2 and an even population size >= 2!\n" RESET);
+        return ERROR;
+    }
+    if (config->k_max > 0 && (config->k_min < 2 || config->k_min > config->k_max))
+    {
+        fprintf(stderr, RED "Require 2 <= k_min <= k_max!\n" RESET);
+        return ERROR;
+    }
+    if (config->elitism < 0)
+    {
+        fprintf(stderr, RED "Require elitism >= 0!\n" RESET);
+        return ERROR;
+    }
+    if (k_max > (int64_t)ctx->data->size1)
+    {
+        fprintf(stderr, RED "Require no more clusters than rows of data!\n" RESET);
+        return ERROR;
+    }
+    if (config->init_method < INIT_RANDOM || config->init_method > INIT_KMEANS_PARALLEL
+        || config->mutate_method < MUTATE_RANDOM || config->mutate_method > MUTATE_RESAMPLE
+        || config->crossover_method < CROSSOVER_CUT || config->crossover_method > CROSSOVER_UNIFORM
+        || config->selection < SELECT_ROULETTE || config->selection > SELECT_RANK
+        || config->trials_select < TRIALS_SSE || config->trials_select > TRIALS_CONSENSUS)
+    {
+        fprintf(stderr, RED "Unknown init, mutate, crossover, selection or trials method!\n" RESET);
+        return ERROR;
+    }
+
+    // Only reallocate if the shape of the population has changed
+    if (config->size != ctx->size || k_max != ctx->n_clusters)
+    {
+        free_population(ctx);
+        ctx->config = *config;
+        if (alloc_population(ctx) != SUCCESS)
+        {
+            return ERROR;
+        }
+    }
+    ctx->config = *config;
+    ctx->variable = config->k_max > 0;
+
+    // The aligned crossovers match the centroids with memory allocated once
+    // for each thread that breeds
+    if (config->crossover_method != CROSSOVER_CUT 
+        && ctx->n_match < (config->steady_state ? threads : 1))
+    {
+        int n_match = config->steady_state ? threads : 1;
+        match_scratch **match = (match_scratch **)realloc(ctx->match, 
+                                                          n_match * sizeof(match_scratch *));
+        if (match == NULL)
+        {
+            fprintf(stderr, RED "Unable to allocate the centroid matching!\n" RESET);
+            return ERROR;
+        }
+        ctx->match = match;
+        for (; ctx->n_match < n_match; ++ctx->n_match)
+        {
+            if ((ctx->match[ctx->n_match] = match_alloc(ctx->n_clusters)) == NULL)
+                return ERROR;
+        }
+    }
+
+    // Build the kd-tree of the data once, on the first job that uses it
+    if (config->kdtree && ctx->tree == NULL)
+    {
+        double start = stats_now();
+        if ((ctx->tree = kd_build(ctx->data, ctx->weights)) == NULL)
+        {
+            return ERROR;
+        }
+        stats_time(PHASE_LOAD, start);
+    }
+    ctx->best_fitness = -INFINITY;
+    ctx->labeled = true;
+    ctx->generation = 0;
+    ctx->last_improved = 0;
+    ctx->start_time = stats_now();
+    ctx->run_time = 0;
+    ctx->stop = 0;
+    memset(ctx->cached, 0, ctx->size * sizeof(bool));
+
+    // The Lloyd's tolerance is relative to the total variance of the data
+    ctx->budget.max_iter = config->lloyd_max_iter > 0 ? (uint32_t)config->lloyd_max_iter : 0;
+    ctx->budget.shift_tol = config->lloyd_tol * ctx->variance;
+    ctx->budget.min_changed = config->lloyd_min_changed;
+    for (int i = 0; i < (int)ctx->size; ++i)
+        ctx->caps[i] = lloyd_cap(ctx, 0);
+
+    // Initialize the PRNG
+    if (config->seed != 0)
+        pcg32_srandom_r(&ctx->rng, config->seed, 54u);
+    else
+        pcg32_srandom_r(&ctx->rng, time(NULL) ^ (intptr_t)&printf, (intptr_t)&rounds);
 
     // Generate the initial population
-    printf(CYAN "Generating initial population...\n" RESET);
-    for (int i = 0; i < (int)size; ++i)
+    if (VERBOSE == 1)
+        printf(CYAN "Generating initial population...\n" RESET);
+    ctx->current = 0;
+    seed = ((uint64_t)pcg32_random_r(&ctx->rng) << 32) | pcg32_random_r(&ctx->rng);
+    for (int i = 0; i < (int)ctx->size; ++i)
     {
-        random_centroids(population[i], bounds, &rng);
+        gsl_matrix *chromosome = &ctx->views[ctx->current][i].matrix;
+        pcg32_random_t rng;
+        int status = SUCCESS;
+
+        // Each chromosome draws from its own stream of the PRNG
+        pcg32_srandom_r(&rng, seed, (uint64_t)i);
+
+        // Draw the number of clusters of each chromosome uniformly from the range
+        chromosome->size1 = ctx->n_clusters;
+        if (ctx->variable)
+            chromosome->size1 = config->k_min 
+                                + pcg32_boundedrand_r(&rng, (uint32_t)(k_max - config->k_min + 1));
+        switch (config->init_method)
+        {
+            case INIT_KMEANSPP:
+                status = kmeanspp_centroids(chromosome, ctx->data, threads, &rng);
+                break;
+            case INIT_KMEANS_PARALLEL:
+                status = kmeans_parallel_centroids(chromosome, ctx->data, (int)config->init_rounds,
+                                                   threads, &rng);
+                break;
+            default:
+                status = random_centroids(chromosome, ctx->bounds, &rng);
+                break;
+        }
+        if (status != SUCCESS)
+        {
+            return ERROR;
+        }
     }
 
-    // Perform the Genetic Algorithm
-    for (int iter = 0; iter < max_iter; ++iter)
+    // Seed the first chromosome with the best of the random restarts of Lloyd's
+    if (config->trials > 1)
     {
-        // Compute the fitness of each chromosome
-        for (int i = 0; i < (int)size; ++i)
+        gsl_matrix *first = &ctx->views[ctx->current][0].matrix;
+
+        if (lloyd_random((int)config->trials, ctx->data, (int)first->size1,
+                         (int)config->trials_select, threads, first, NULL, &ctx->rng,
+                         ctx->weights) != SUCCESS)
         {
-            lloyd_defined(trials, population[i], data, n_clusters, clusters[i]);
-            fitness[i] = dunn_index(population[i], n_clusters, clusters[i]);
-            if (VERBOSE == 1)
-                printf(CYAN "chromsome[%d], fitness: %10.6f\n" RESET, i, fitness[i]);
+            return ERROR;
         }
+    }
 
-        // Generate the probabilities for roulette wheel selection
-        gen_probability(size, fitness, probability);
+    return SUCCESS;
+}
 
-        // Save the results if there is a new best solution
-        save_results(fitness_file, centroids_file, cluster_file, size, fitness, 
-                     population, n_clusters, clusters);
 
-        // Perform roulette wheel selection and GA operators
-        if (VERBOSE == 1)
-            printf(CYAN "Executing roulette wheel selection...\n" RESET);
+/**
+ * Populates the result with the best solution found so far, labeling the rows
+ * with the best chromosome if it changed since the last result.
+ *
+ * @param ctx    Pointer to the context
+ * @param result Pointer to the result, populated by function
+ */
+static void get_result(emeans_ctx *ctx, emeans_result *result)
+{
+    if (!ctx->labeled)
+    {
+        assign_clusters(ctx->data, ctx->best, ctx->labels, ctx->counts);
+        ctx->labeled = true;
+    }
+    result->fitness = ctx->best_fitness;
+    result->centroids = ctx->best;
+    result->labels = ctx->labels;
+    result->generations = ctx->generation;
+    result->run_time = ctx->run_time;
+    result->term = EMEANS_RUNNING;
+}
 
-        // Select parents from the population and perform genetic operators
-        for (int i = 0; i < size; i += 2)
+
+/**
+ * Removes the centroids of the empty clusters of a chromosome with a variable
+ * number of clusters, down to the minimum, so that each chromosome is scored
+ * on the clusters it actually forms and the fitness compares fairly across
+ * the number of clusters.
+ *
+ * @param ctx        Pointer to the context
+ * @param chromosome The chromosome, resized by function
+ * @param clusters   The clusters of the chromosome, reordered with the centroids
+ */
+static void prune_empty(emeans_ctx *ctx, gsl_matrix *chromosome, gsl_matrix **clusters)
+{
+    size_t n = 0;
+
+    if (!ctx->variable)
+    {
+        return;
+    }
+
+    while (n < chromosome->size1 && chromosome->size1 > (size_t)ctx->config.k_min)
+    {
+        size_t last = chromosome->size1 - 1;
+        gsl_matrix *swap = clusters[n];
+
+        if (clusters[n] != NULL)
         {
-            // Select parents
-            for (int j = 0, idx = 0; j < 2; ++j)
-            {
-                idx = select_parent(size, probability, &rng);
-                if (VERBOSE == 1)
-                    printf(CYAN "Parent %d selected as chromsome %d from population\n" RESET, j, idx);
-
-                if (j == 0)
-                    gsl_matrix_memcpy(parent1, population[idx]);
-                else
-                    gsl_matrix_memcpy(parent2, population[idx]);
-            }
+            ++n;
+            continue;
+        }
+
+        // Move the last centroid and its cluster into the empty row
+        gsl_matrix_swap_rows(chromosome, n, last);
+        clusters[n] = clusters[last];
+        clusters[last] = swap;
+        chromosome->size1 = last;
+    }
+}
+
+
+/**
+ * Evaluates every chromosome of the current population with Lloyd's algorithm
+ * and then the fitness of the clusters, chromosomes with a cached fitness are
+ * skipped.
+ *
+ * @param ctx     Pointer to the context
+ * @param threads The number of threads to use
+ */
+static void evaluate_population(emeans_ctx *ctx, int threads)
+{
+    int size = (int)ctx->size,
+        n_clusters = (int)ctx->n_clusters;
+    double start = 0;
+    gsl_matrix_view *population = ctx->views[ctx->current];
+    uint32_t *caps = ctx->config.lloyd_adaptive ? ctx->caps : NULL;
 
-            // Perform crossover and mutation with specified probabilities
+    if (ctx->config.batch_kb > 0)
+    {
+        // Lloyd's for the whole population, streaming cache sized blocks of rows
+        uint32_t block_rows = ctx->config.batch_kb * 1024 / (ctx->data->size2 * sizeof(double));
+
+        start = stats_now();
+        for (int i = 0; i < size; ++i)
+            ctx->ks[i] = population[i].matrix.size1;
+        lloyd_population(ctx->data, ctx->arena[ctx->current], ctx->stride, size, n_clusters,
+                         block_rows > 0 ? block_rows : 1, threads, ctx->cached, &ctx->budget,
+                         caps, ctx->variable ? ctx->ks : NULL, 
+                         ctx->config.kdtree ? ctx->tree : NULL,
+                         ctx->config.pds ? ctx->dims : NULL, ctx->weights);
+        stats_time(PHASE_LLOYD, start);
+
+        // Compute the clusters and fitness of each chromosome in parallel
+        #pragma omp parallel for schedule(dynamic) num_threads(threads)
+        for (int i = 0; i < size; ++i)
+        {
+            double t = stats_now();
+            if (ctx->cached[i])
+                continue;
+            trace_begin("evaluate", i);
+            build_clusters(&population[i].matrix, ctx->data, population[i].matrix.size1,
+                           &ctx->clusters[i * n_clusters]);
+            prune_empty(ctx, &population[i].matrix, &ctx->clusters[i * n_clusters]);
+            ctx->fitness[i] = dunn_index(&population[i].matrix, population[i].matrix.size1, 
+                                         &ctx->clusters[i * n_clusters]);
+            stats_time(PHASE_FITNESS, t);
+            trace_end("evaluate", i);
             if (VERBOSE == 1)
-                printf(CYAN "Performing crossover...\n" RESET);
-            if (pcg32_random_r(&rng) / (double)UINT32_MAX <= c_rate)
-            {
-                crossover(parent1, parent2, &rng);
-            }
+                printf(CYAN "chromsome[%d], fitness: %10.6f\n" RESET, i, ctx->fitness[i]);
+        }
+    }
+    else
+    {
+        // Compute the fitness of each chromosome in parallel
+        #pragma omp parallel for schedule(dynamic) num_threads(threads)
+        for (int i = 0; i < size; ++i)
+        {
+            double t = stats_now();
+            lloyd_budget budget = ctx->budget;
+            if (ctx->cached[i])
+                continue;
+            if (caps != NULL)
+                budget.max_iter = caps[i];
+            trace_begin("evaluate", i);
+            lloyd_defined(ctx->config.trials, &population[i].matrix, ctx->data, 
+                          population[i].matrix.size1, &ctx->clusters[i * n_clusters], &budget,
+                          ctx->config.kdtree ? ctx->tree : NULL, ctx->weights);
+            stats_time(PHASE_LLOYD, t);
 
+            t = stats_now();
+            prune_empty(ctx, &population[i].matrix, &ctx->clusters[i * n_clusters]);
+            ctx->fitness[i] = dunn_index(&population[i].matrix, population[i].matrix.size1, 
+                                         &ctx->clusters[i * n_clusters]);
+            stats_time(PHASE_FITNESS, t);
+            trace_end("evaluate", i);
             if (VERBOSE == 1)
-                printf(CYAN "Performing background mutation...\n" RESET);
-            for (int j = 0; j < 2; ++j)
+                printf(CYAN "chromsome[%d], fitness: %10.6f\n" RESET, i, ctx->fitness[i]);
+        }
+    }
+    for (int i = 0; i < size; ++i)
+    {
+        if (!ctx->cached[i])
+            stats_add(STAT_EVALUATIONS, 1);
+        ctx->cached[i] = true;
+    }
+}
+
+
+/**
+ * Copies a chromosome, resizing the destination to the number of clusters of
+ * the source within the rows allocated for the maximum.
+ *
+ * @param dest The destination chromosome
+ * @param src  The source chromosome
+ */
+static void copy_chromosome(gsl_matrix *dest, gsl_matrix *src)
+{
+    dest->size1 = src->size1;
+    gsl_matrix_memcpy(dest, src);
+}
+
+
+/**
+ * Keeps the chromosome if it is a new best, must not be called concurrently.
+ * The rows are labeled later by get_result() so that the steady-state mode
+ * does not label them while holding the population lock.
+ *
+ * @param ctx        Pointer to the context
+ * @param chromosome The chromosome
+ * @param fitness    The fitness of the chromosome
+ *
+ * @return           True if the chromosome is a new best
+ */
+static bool update_best(emeans_ctx *ctx, gsl_matrix *chromosome, double fitness)
+{
+    if (fitness > ctx->best_fitness)
+    {
+        ctx->best_fitness = fitness;
+        ctx->last_improved = ctx->generation;
+        copy_chromosome(ctx->best, chromosome);
+        ctx->labeled = false;
+        stats_fitness(ctx->best_fitness);
+        return true;
+    }
+    return false;
+}
+
+
+/**
+ * Performs crossover and mutation of a pair of children with the specified
+ * probabilities.
+ *
+ * @param ctx     Pointer to the context
+ * @param child1  The first child, a copy of the first parent
+ * @param child2  The second child, a copy of the second parent
+ * @param scratch The scratch memory to match centroids, NULL unless the
+ *                crossover aligns the centroids
+ * @param rng     Pointer to the random number generator
+ */
+static void breed(emeans_ctx *ctx, gsl_matrix *child1, gsl_matrix *child2, 
+                  match_scratch *scratch, pcg32_random_t *rng)
+{
+    if (VERBOSE == 1)
+        printf(CYAN "Performing crossover...\n" RESET);
+    if (pcg32_random_r(rng) / (double)UINT32_MAX <= ctx->config.c_rate)
+    {
+        // Parents with a different number of clusters exchange variable tails
+        if (child1->size1 != child2->size1)
+            crossover_variable(child1, child2, (uint32_t)ctx->config.k_min, 
+                               (uint32_t)ctx->n_clusters, rng);
+        else if (ctx->config.crossover_method == CROSSOVER_UNIFORM)
+            crossover_uniform(child1, child2, scratch, rng);
+        else if (ctx->config.crossover_method == CROSSOVER_ALIGNED)
+            crossover_aligned(child1, child2, scratch, rng);
+        else
+            crossover(child1, child2, rng);
+    }
+
+    if (VERBOSE == 1)
+        printf(CYAN "Performing background mutation...\n" RESET);
+    for (int j = 0; j < 2; ++j)
+    {
+        if (pcg32_random_r(rng) / (double)UINT32_MAX <= ctx->config.m_rate)
+        {
+            gsl_matrix *child = j == 0 ? child1 : child2;
+
+            if (ctx->config.mutate_method == MUTATE_RESAMPLE)
+                mutate_resample(child, ctx->data, rng);
+            else
+                mutate(child, ctx->bounds, rng);
+        }
+        if (ctx->variable && pcg32_random_r(rng) / (double)UINT32_MAX <= ctx->config.k_rate)
+        {
+            mutate_k(j == 0 ? child1 : child2, ctx->data, (uint32_t)ctx->config.k_min,
+                     (uint32_t)ctx->n_clusters, rng);
+        }
+    }
+}
+
+
+/**
+ * Performs a population size worth of steady-state evaluations. Each thread
+ * breeds a child from parents chosen by tournament selection as soon as its
+ * previous evaluation finishes and the child replaces the worst chromosome
+ * unless it is less fit, so no thread waits for the slowest evaluation. Only
+ * selection and replacement hold the population lock.
+ *
+ * @param ctx      Pointer to the context
+ * @param threads  The number of threads to use
+ * @param improved True if a new best was found, populated by function
+ *
+ * @return         The status code, 0 for SUCCESS, 1 for ERROR
+ */
+static int steady_state(emeans_ctx *ctx, int threads, bool *improved)
+{
+    int size = (int)ctx->size,
+        n_clusters = (int)ctx->n_clusters,
+        claimed = 0,
+        tournament = ctx->config.tournament > 0 ? (int)ctx->config.tournament : 1;
+    uint64_t seed = ((uint64_t)pcg32_random_r(&ctx->rng) << 32) | pcg32_random_r(&ctx->rng);
+    bool found = false;
+    gsl_matrix_view *population = ctx->views[ctx->current];
+    gsl_matrix **tables = (gsl_matrix **)calloc((size_t)threads * n_clusters, sizeof(gsl_matrix *));
+
+    // The clusters of the child evaluated by each thread
+    if (tables == NULL)
+    {
+        fprintf(stderr, RED "Unable to allocate the steady-state clusters!\n" RESET);
+        return ERROR;
+    }
+
+    #pragma omp parallel num_threads(threads) reduction(||:found)
+    {
+        pcg32_random_t rng;
+        gsl_matrix *child[2];
+        gsl_matrix **clusters = tables + (size_t)omp_get_thread_num() * n_clusters;
+
+        // Each thread breeds from its own stream of the PRNG
+        pcg32_srandom_r(&rng, seed, (uint64_t)omp_get_thread_num());
+        child[0] = gsl_matrix_alloc(n_clusters, ctx->data->size2);
+        child[1] = gsl_matrix_alloc(n_clusters, ctx->data->size2);
+        stats_add(STAT_ALLOCATIONS, 2);
+
+        for (;;)
+        {
+            int id = 0,
+                keep = 0;
+            double fitness = 0,
+                   t = 0;
+            lloyd_budget budget = ctx->budget;
+
+            #pragma omp atomic capture
+            id = claimed++;
+            if (id >= size || ctx->stop)
+                break;
+
+            // Select the parents, the population may be replaced concurrently
+            t = stats_now();
+            #pragma omp critical(population)
             {
-                if (pcg32_random_r(&rng) / (double)UINT32_MAX <= m_rate)
+                int p1 = select_tournament(size, ctx->fitness, tournament, &rng),
+                    p2 = select_tournament(size, ctx->fitness, tournament, &rng);
+                copy_chromosome(child[0], &population[p1].matrix);
+                copy_chromosome(child[1], &population[p2].matrix);
+
+                // The fitness rank of the parents within the current population
+                if (ctx->config.lloyd_adaptive)
                 {
-                    if (j == 0)
-                        mutate(parent1, bounds, &rng);
-                    else
-                        mutate(parent2, bounds, &rng);
+                    int below = 0;
+                    for (int i = 0; i < size; ++i)
+                    {
+                        below += ctx->fitness[i] < ctx->fitness[p1];
+                        below += ctx->fitness[i] < ctx->fitness[p2];
+                    }
+                    budget.max_iter = lloyd_cap(ctx, below / (2.0 * (size - 1)));
                 }
             }
+            breed(ctx, child[0], child[1], 
+                  ctx->match != NULL ? ctx->match[omp_get_thread_num()] : NULL, &rng);
+            keep = (int)pcg32_boundedrand_r(&rng, 2);
+            stats_time(PHASE_OPERATORS, t);
+
+            // Evaluate one of the children
+            t = stats_now();
+            trace_begin("evaluate", id);
+            lloyd_defined(ctx->config.trials, child[keep], ctx->data, child[keep]->size1, 
+                          clusters, &budget, ctx->config.kdtree ? ctx->tree : NULL, ctx->weights);
+            stats_time(PHASE_LLOYD, t);
 
-            // Copy each parent to the new population
+            t = stats_now();
+            prune_empty(ctx, child[keep], clusters);
+            fitness = dunn_index(child[keep], child[keep]->size1, clusters);
+            stats_time(PHASE_FITNESS, t);
+            trace_end("evaluate", id);
+            stats_add(STAT_EVALUATIONS, 1);
             if (VERBOSE == 1)
-                printf(CYAN "Copying parents to new population...\n" RESET);
-            gsl_matrix_memcpy(new_population[i], parent1);
-            gsl_matrix_memcpy(new_population[i+1], parent2);
+                printf(CYAN "offspring[%d], fitness: %10.6f\n" RESET, id, fitness);
+
+            // Replace the worst chromosome
+            #pragma omp critical(population)
+            {
+                int worst = 0;
+                for (int i = 1; i < size; ++i)
+                {
+                    if (ctx->fitness[i] < ctx->fitness[worst])
+                        worst = i;
+                }
+                if (fitness >= ctx->fitness[worst])
+                {
+                    copy_chromosome(&population[worst].matrix, child[keep]);
+                    ctx->fitness[worst] = fitness;
+                }
+                found = update_best(ctx, child[keep], fitness) || found;
+            }
         }
 
-        // Copy the new population to the next population
-        if (VERBOSE == 1)
-            printf(CYAN "Copying current population as new population\n" RESET);
+        gsl_matrix_free(child[0]);
+        gsl_matrix_free(child[1]);
+    }
+    for (size_t n = 0; n < (size_t)threads * n_clusters; ++n)
+        gsl_matrix_free(tables[n]);
+    free(tables);
+    *improved = found;
 
-        for (int i = 0; i < size; ++i)
+    return SUCCESS;
+}
+
+
+/**
+ * Copies the centroids of a chromosome sorted lexicographically by row, so
+ * that chromosomes with the same set of centroids in a different order have
+ * the same canonical form.
+ *
+ * @param chromosome The chromosome
+ * @param canon      The canonical form, populated by function
+ * @param row        Scratch for one centroid
+ */
+static void canonical_form(gsl_matrix *chromosome, double *canon, double *row)
+{
+    size_t rows = chromosome->size1,
+           cols = chromosome->size2;
+
+    // Insertion sort, the number of clusters is small
+    for (size_t i = 0; i < rows; ++i)
+    {
+        size_t j = i;
+
+        memcpy(row, gsl_matrix_const_ptr(chromosome, i, 0), cols * sizeof(double));
+        while (j > 0)
         {
-            gsl_matrix_memcpy(population[i], new_population[i]);
+            size_t c = 0;
+            while (c < cols && canon[(j - 1) * cols + c] == row[c])
+                ++c;
+            if (c == cols || canon[(j - 1) * cols + c] < row[c])
+                break;
+            memcpy(&canon[j * cols], &canon[(j - 1) * cols], cols * sizeof(double));
+            --j;
         }
+        memcpy(&canon[j * cols], row, cols * sizeof(double));
+    }
+}
+
+
+/**
+ * Replaces the offspring which are duplicates or near duplicates of another
+ * chromosome with new k-means++ seeds, so that no evaluation is wasted on a
+ * copy. Chromosomes are duplicates if the squared distance between their
+ * canonical forms is within the tolerance, relative to the squared diagonal
+ * of the bounds for each centroid. Candidates are found by sorting on the sum
+ * of the canonical form, which differs by at most sqrt(len * tol) between
+ * duplicates, and the elites are never replaced. Chromosomes with a different
+ * number of clusters are never duplicates.
+ *
+ * @param ctx     Pointer to the context
+ * @param elites  The number of elites at the start of the population
+ * @param threads The number of threads to seed with
+ *
+ * @return        The status code, 0 for SUCCESS, 1 for ERROR
+ */
+static int replace_duplicates(emeans_ctx *ctx, int elites, int threads)
+{
+    int size = (int)ctx->size;
+    size_t len = ctx->n_clusters * ctx->data->size2;
+    uint64_t replaced = 0;
+    double unit = 0,
+           window = 0;
+    gsl_matrix_view *population = ctx->views[ctx->current];
+
+    if (ctx->config.dup_tol < 0)
+    {
+        return SUCCESS;
+    }
 
-        // Check if stop signal, terminate if present
-        if (access("./stop", F_OK) != -1)
+    for (size_t j = 0; j < ctx->data->size2; ++j)
+    {
+        double range = gsl_matrix_get(ctx->bounds, j, 1) - gsl_matrix_get(ctx->bounds, j, 0);
+        unit += range * range;
+    }
+    unit *= ctx->config.dup_tol;
+    window = sqrt(len * unit * ctx->n_clusters);
+
+    for (int i = 0; i < size; ++i)
+    {
+        double *canon = ctx->canon + i * ctx->stride;
+
+        canonical_form(&population[i].matrix, canon, ctx->row);
+        ctx->keys[i] = 0;
+        for (size_t j = 0; j < population[i].matrix.size1 * ctx->data->size2; ++j)
+            ctx->keys[i] += canon[j];
+        ctx->duplicate[i] = false;
+    }
+    gsl_sort_index(ctx->order, ctx->keys, 1, size);
+
+    // Compare each chromosome with the preceding chromosomes within the window
+    for (int a = 1; a < size; ++a)
+    {
+        int i = (int)ctx->order[a];
+
+        for (int b = a - 1; b >= 0 && ctx->keys[i] - ctx->keys[ctx->order[b]] <= window; --b)
         {
-            printf(YELLOW "Stop signal received, shutting down!\n" RESET);
-            remove("./stop");
-            break;
+            int j = (int)ctx->order[b];
+            size_t k = population[i].matrix.size1;
+            double dist = 0,
+                   tol = unit * k;
+
+            if (ctx->duplicate[j] || population[j].matrix.size1 != k)
+                continue;
+            for (size_t c = 0; c < k * ctx->data->size2 && dist <= tol; ++c)
+            {
+                double diff = ctx->canon[i * ctx->stride + c] - ctx->canon[j * ctx->stride + c];
+                dist += diff * diff;
+            }
+            if (dist > tol)
+                continue;
+
+            // Keep the elite of the pair
+            if (i >= elites)
+            {
+                ctx->duplicate[i] = true;
+                break;
+            }
+            if (j >= elites)
+                ctx->duplicate[j] = true;
         }
+    }
+
+    for (int i = 0; i < size; ++i)
+    {
+        if (!ctx->duplicate[i])
+            continue;
+        if (kmeanspp_centroids(&population[i].matrix, ctx->data, threads, &ctx->rng) != SUCCESS)
+            return ERROR;
+        ctx->cached[i] = false;
+        ctx->caps[i] = lloyd_cap(ctx, 0);
+        ++replaced;
+    }
+    stats_add(STAT_DUPLICATES, replaced);
+    if (VERBOSE == 1 && replaced > 0)
+        printf(CYAN "Replaced %lu duplicate chromosomes\n" RESET, (unsigned long)replaced);
+
+    return SUCCESS;
+}
+
+
+/**
+ * Selects the parents of every offspring of the next generation with the
+ * configured selection method.
+ *
+ * @param ctx Pointer to the context
+ *
+ * @return    The status code, 0 for SUCCESS, 1 for ERROR
+ */
+static int select_parents(emeans_ctx *ctx)
+{
+    int size = (int)ctx->size,
+        tournament = ctx->config.tournament > 0 ? (int)ctx->config.tournament : 1;
+
+    if (VERBOSE == 1)
+        printf(CYAN "Executing selection...\n" RESET);
+
+    switch (ctx->config.selection)
+    {
+        case SELECT_ALIAS:
+        case SELECT_RANK:
+            if (ctx->config.selection == SELECT_RANK)
+            {
+                if (gen_rank(size, ctx->fitness, ctx->probability) != SUCCESS)
+                    return ERROR;
+            }
+            else
+            {
+                gen_weights(size, ctx->fitness, ctx->probability);
+            }
+            if (gen_alias(size, ctx->probability, ctx->accept, ctx->alias) != SUCCESS)
+            {
+                return ERROR;
+            }
+            for (int i = 0; i < size; ++i)
+            {
+                ctx->parents[i] = select_alias(size, ctx->accept, ctx->alias, &ctx->rng);
+            }
+            break;
+        case SELECT_SUS:
+            gen_probability(size, ctx->fitness, ctx->probability);
+            select_sus(size, ctx->probability, size, ctx->parents, &ctx->rng);
+            break;
+        case SELECT_TOURNAMENT:
+            for (int i = 0; i < size; ++i)
+            {
+                ctx->parents[i] = select_tournament(size, ctx->fitness, tournament, &ctx->rng);
+            }
+            break;
+        default:
+            gen_probability(size, ctx->fitness, ctx->probability);
+            for (int i = 0; i < size; ++i)
+            {
+                ctx->parents[i] = select_parent(size, ctx->probability, &ctx->rng);
+            }
+            break;
+    }
+
+    return SUCCESS;
+}
+
+
+int emeans_step(emeans_ctx *ctx, emeans_result *result)
+{
+    int size = (int)ctx->size,
+        threads = ctx->config.threads > 0 ? (int)ctx->config.threads : omp_get_max_threads(),
+        elites = ctx->config.elitism < ctx->size ? (int)ctx->config.elitism : size,
+        max_idx = 0;
+    double start = 0,
+           step_start = stats_now();
+    gsl_matrix_view *population = ctx->views[ctx->current],
+                    *offspring = ctx->views[!ctx->current];
+
+    trace_begin("generation", ctx->generation);
+    result->improved = false;
+
+    // The steady-state mode only evaluates the whole initial population
+    if (!ctx->config.steady_state || ctx->generation == 0)
+    {
+        evaluate_population(ctx, threads);
 
+        // Keep the chromosome with the highest fitness if it is a new best
+        for (int i = 1; i < size; ++i)
+        {
+            if (ctx->fitness[i] > ctx->fitness[max_idx])
+                max_idx = i;
+        }
+        result->improved = update_best(ctx, &population[max_idx].matrix, ctx->fitness[max_idx]);
     }
-    printf(GREEN "Finished executing E-means, shutting down!\n" RESET);
 
-free:
-    for (int i = 0; i < (int)size; ++i)
+    if (ctx->config.steady_state)
     {
-        for (int j = 0; j < n_clusters; ++j)
+        bool improved = false;
+
+        if (steady_state(ctx, threads, &improved) != SUCCESS)
         {
-            gsl_matrix_free(clusters[i][j]);
+            return ERROR;
         }
-        free(clusters[i]);
+        result->improved = improved || result->improved;
+        stats_add(STAT_GENERATIONS, 1);
+        trace_end("generation", ctx->generation);
+        ctx->generation += 1;
+        ctx->run_time += stats_now() - step_start;
+        get_result(ctx, result);
+
+        return SUCCESS;
+    }
+
+    // Select the parents of every offspring
+    start = stats_now();
+    if (select_parents(ctx) != SUCCESS)
+    {
+        return ERROR;
+    }
+
+    // Carry the elites over unchanged, their fitness is kept aside until the
+    // fitness of the current population is no longer needed
+    if (elites > 0 || ctx->config.lloyd_adaptive)
+    {
+        gsl_sort_index(ctx->order, ctx->fitness, 1, size);
+        for (int r = 0; r < size; ++r)
+            ctx->rank[ctx->order[r]] = r;
     }
-    free(clusters);
-    for (int i = 0; i < (int)size; ++i)
+    for (int e = 0; e < elites; ++e)
     {
-        gsl_matrix_free(population[i]);
-        gsl_matrix_free(new_population[i]);
+        size_t idx = ctx->order[size - 1 - e];
+        copy_chromosome(&offspring[e].matrix, &population[idx].matrix);
+        ctx->probability[e] = ctx->fitness[idx];
     }
-    free(population);
-    free(new_population);
-    gsl_matrix_free(data);
-    gsl_matrix_free(bounds);
-    return status;
+
+    // Breed the selected parents in the remaining slots of the offspring arena
+    for (int i = elites; i < size; i += 2)
+    {
+        int p1 = ctx->parents[i],
+            p2 = ctx->parents[(i + 1) % size];
+        gsl_matrix *child1 = &offspring[i].matrix,
+                   *child2 = i + 1 < size ? &offspring[i+1].matrix : ctx->spare;
+
+        if (VERBOSE == 1)
+            printf(CYAN "Parents %d and %d selected from population\n" RESET, p1, p2);
+        copy_chromosome(child1, &population[p1].matrix);
+        copy_chromosome(child2, &population[p2].matrix);
+
+        // Perform crossover and mutation with specified probabilities
+        breed(ctx, child1, child2, ctx->match != NULL ? ctx->match[0] : NULL, &ctx->rng);
+
+        // Offspring of fitter parents are given more Lloyd's iterations
+        ctx->caps[i] = lloyd_cap(ctx, (ctx->rank[p1] + ctx->rank[p2]) / (2.0 * (size - 1)));
+        if (i + 1 < size)
+            ctx->caps[i + 1] = ctx->caps[i];
+    }
+
+    // The offspring become the next population by swapping the arenas
+    if (VERBOSE == 1)
+        printf(CYAN "Swapping offspring in as the new population\n" RESET);
+    for (int i = 0; i < size; ++i)
+    {
+        ctx->cached[i] = i < elites;
+        if (i < elites)
+            ctx->fitness[i] = ctx->probability[i];
+    }
+    ctx->current = !ctx->current;
+    if (replace_duplicates(ctx, elites, threads) != SUCCESS)
+    {
+        return ERROR;
+    }
+    stats_time(PHASE_OPERATORS, start);
+    stats_add(STAT_GENERATIONS, 1);
+    trace_end("generation", ctx->generation);
+    ctx->generation += 1;
+    ctx->run_time += stats_now() - step_start;
+    get_result(ctx, result);
+
+    return SUCCESS;
 }
 
 
-int main(int argc, char *argv[])
+/**
+ * Calculates the diversity of the population, the mean squared distance of
+ * the canonical form of each chromosome from the mean canonical form relative
+ * to the squared diagonal of the bounds for each centroid.
+ *
+ * @param ctx Pointer to the context
+ *
+ * @return    The diversity, 0 if every chromosome is the same and 1 if the
+ *            number of clusters differs
+ */
+static double population_diversity(emeans_ctx *ctx)
 {
-    int status = SUCCESS;
-    char conf_file[100] = "./conf/emeans.conf";
+    int size = (int)ctx->size;
+    size_t len = 0;
+    double *mean = ctx->mean;
+    double diversity = 0,
+           scale = 0;
+    gsl_matrix_view *population = ctx->views[ctx->current];
 
-    if (argc < 3 || argc > 4)
+    // A population with a different number of clusters has not collapsed
+    for (int i = 1; i < size; ++i)
     {
-        fprintf(stderr, RED "Incorrect parameters!\n" RESET);
-        fprintf(stderr, RED "Correct usage:\n" RESET);
-        fprintf(stderr, RED "%s <DEBUG> (1..N=DEBUG 0=NODEBUG) <VERBOSE> (1=YES 0=NO) <CONFIG> (DEFAULT ./conf/emeans.conf)\n\n" RESET, argv[0]);
-        status = ERROR;
-        goto free;
+        if (population[i].matrix.size1 != population[0].matrix.size1)
+            return 1;
     }
-    DEBUG = atoi(argv[1]);
-    VERBOSE = atoi(argv[2]);
+    len = population[0].matrix.size1 * ctx->data->size2;
+
+    memset(mean, 0, len * sizeof(double));
+    for (int i = 0; i < size; ++i)
+    {
+        double *canon = ctx->canon + i * ctx->stride;
 
-    if (argc > 3)
+        canonical_form(&population[i].matrix, canon, ctx->row);
+        for (size_t j = 0; j < len; ++j)
+            mean[j] += canon[j] / size;
+    }
+    for (int i = 0; i < size; ++i)
     {
-        strcpy(conf_file, argv[3]);
+        double *canon = ctx->canon + i * ctx->stride;
+
+        for (size_t j = 0; j < len; ++j)
+            diversity += (canon[j] - mean[j]) * (canon[j] - mean[j]) / size;
     }
 
-    if (access(conf_file, F_OK) != -1)
+    for (size_t j = 0; j < ctx->data->size2; ++j)
     {
-        cfg = cfg_init(opts, 0);
-        cfg_parse(cfg, conf_file);
+        double range = gsl_matrix_get(ctx->bounds, j, 1) - gsl_matrix_get(ctx->bounds, j, 0);
+        scale += range * range;
     }
+    scale *= population[0].matrix.size1;
+
+    return scale > 0 ? diversity / scale : 0;
+}
+
+
+bool emeans_done(emeans_ctx *ctx, emeans_result *result)
+{
+    emeans_config *config = &ctx->config;
+
+    if (ctx->stop)
+        result->term = EMEANS_STOPPED;
+    else if (ctx->generation >= config->max_iter)
+        result->term = EMEANS_MAX_ITER;
+    else if (config->target_fitness > 0 && ctx->best_fitness >= config->target_fitness)
+        result->term = EMEANS_TARGET;
+    else if (config->plateau > 0 && ctx->generation - ctx->last_improved >= config->plateau)
+        result->term = EMEANS_PLATEAU;
+    else if (config->time_limit > 0 && stats_now() - ctx->start_time >= config->time_limit)
+        result->term = EMEANS_DEADLINE;
+    else if (config->min_diversity > 0 && population_diversity(ctx) < config->min_diversity)
+        result->term = EMEANS_COLLAPSED;
     else
+        result->term = EMEANS_RUNNING;
+
+    return result->term != EMEANS_RUNNING;
+}
+
+
+void emeans_stop(emeans_ctx *ctx)
+{
+    ctx->stop = 1;
+}
+
+
+int emeans_run(emeans_ctx *ctx, emeans_result *result)
+{
+    bool improved = false;
+
+    get_result(ctx, result);
+    while (!emeans_done(ctx, result))
+    {
+        if (emeans_step(ctx, result) != SUCCESS)
+        {
+            return ERROR;
+        }
+        improved |= result->improved;
+    }
+    result->improved = improved;
+
+    return SUCCESS;
+}
+
+
+int emeans_permute(emeans_ctx *ctx, const uint32_t *perm)
+{
+    double start = stats_now();
+
+    if (permute_rows(ctx->data, perm) != SUCCESS 
+        || permute_index(ctx->labels, perm, ctx->data->size1) != SUCCESS)
+    {
+        return ERROR;
+    }
+
+    // The kd-tree indexes the rows so it is built again
+    if (ctx->tree != NULL)
     {
-        fprintf(stderr, RED "Unable to open file %s\n" RESET, conf_file);
-        status = ERROR;
-        goto free;
-    }
-
-    if (DEBUG == DEBUG_CONFIG)
-    {
-        printf(YELLOW "\n============================================================\n" RESET);
-        printf(YELLOW "= CONFIG FILE PARAMS\n" RESET);
-        printf(YELLOW "============================================================\n" RESET);
-        printf(YELLOW "   NUM CLUSTERS: %10ld\n" RESET, n_clusters);
-        printf(YELLOW "CENTROID TRIALS: %10ld\n" RESET, trials);
-        printf(YELLOW "POPULATION SIZE: %10ld\n" RESET, size);
-        printf(YELLOW "  MUTATION RATE: %10.6f\n" RESET, m_rate);
-        printf(YELLOW " CROSSOVER RATE: %10.6f\n" RESET, c_rate);
-        printf(YELLOW " MAX ITERATIONS: %10ld\n" RESET, max_iter);
-        printf(YELLOW "      DATA ROWS: %10ld\n" RESET, data_rows);
-        printf(YELLOW "      DATA COLS: %10ld\n" RESET, data_cols);
-        printf(YELLOW "      DATA FILE: %s\n" RESET, data_file);
-        printf(YELLOW " CENTROIDS FILE: %s\n" RESET, centroids_file);
-        printf(YELLOW "   FITNESS FILE: %s\n" RESET, fitness_file);
-        printf(YELLOW "   CLUSTER FILE: %s\n" RESET, cluster_file);
-        goto free;
-    }
-
-    // Execute the E-means algorithm
-    status = emeans();
-
-// Free memory and exit
-free:
-    cfg_free(cfg);
-    free(data_file);
-    free(centroids_file);
-    free(fitness_file);
-    free(cluster_file);
-
-    exit(status);
-}
\ No newline at end of file
+        kd_free(ctx->tree);
+        if ((ctx->tree = kd_build(ctx->data, ctx->weights)) == NULL)
+        {
+            return ERROR;
+        }
+    }
+    stats_time(PHASE_LOAD, start);
+
+    return SUCCESS;
+}
+
+
+void emeans_free(emeans_ctx *ctx)
+{
+    if (ctx == NULL)
+    {
+        return;
+    }
+    free_population(ctx);
+    gsl_matrix_free(ctx->bounds);
+    kd_free(ctx->tree);
+    free(ctx->labels);
+    free(ctx->dims);
+    free(ctx->row);
+    free(ctx);
+}
@@ -0,0 +1,130 @@
+/*
+ * Evolutionary K-means clustering (E-means) using Genetic Algorithms.
+ *
+ * Copyright (C) 2015, Jonathan Gillett
+ * All rights reserved.
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+#define _DEFAULT_SOURCE
+#include <stdio.h>
+#include <stdlib.h>
+#include <stdint.h>
+#include <string.h>
+#include <unistd.h>
+#include <gsl/gsl_matrix.h>
+#include "utility.h"
+#include "io.h"
+#include "stats.h"
+#include "assign.h"
+
+
+/**
+ * Assigns each row of a data file to the nearest of the centroids saved by
+ * E-means and reports the sustained throughput.
+ */
+int main(int argc, char *argv[])
+{
+    int status = SUCCESS,
+        opt = 0;
+    double start = 0,
+           elapsed = 0;
+    assign_config config;
+    assign_stats stats;
+    gsl_matrix *centroids = NULL;
+    FILE *in = NULL,
+         *out = NULL,
+         *log = stdout;
+
+    memset(&config, 0, sizeof(config));
+    while ((opt = getopt(argc, argv, "bBdt:")) != -1)
+    {
+        switch (opt)
+        {
+            case 'b':
+                config.binary_in = 1;
+                break;
+            case 'B':
+                config.binary_out = 1;
+                break;
+            case 'd':
+                config.distances = 1;
+                break;
+            case 't':
+                config.threads = atoi(optarg);
+                break;
+            default:
+                argc = 0;
+                break;
+        }
+    }
+    if (argc - optind != 3)
+    {
+        fprintf(stderr, RED "Incorrect parameters!\n" RESET);
+        fprintf(stderr, RED "Correct usage:\n" RESET);
+        fprintf(stderr, RED "%s [-b] [-B] [-d] [-t THREADS] <CENTROIDS> <INPUT> <OUTPUT>\n" RESET, argv[0]);
+        fprintf(stderr, RED "  -b  the input is rows of raw doubles instead of CSV\n" RESET);
+        fprintf(stderr, RED "  -B  write raw uint32 labels, and doubles with -d, instead of CSV\n" RESET);
+        fprintf(stderr, RED "  -d  write the distance of each row to its centroid\n" RESET);
+        fprintf(stderr, RED "  -t  threads, 0 for the OpenMP default\n" RESET);
+        fprintf(stderr, RED "  INPUT and OUTPUT may be - for stdin and stdout\n\n" RESET);
+        exit(ERROR);
+    }
+
+    if ((centroids = load_centroids(argv[optind])) == NULL)
+    {
+        status = ERROR;
+        goto free;
+    }
+    in = strcmp(argv[optind + 1], "-") == 0 ? stdin : fopen(argv[optind + 1], "rb");
+    out = strcmp(argv[optind + 2], "-") == 0 ? stdout : fopen(argv[optind + 2], "wb");
+    if (in == NULL || out == NULL)
+    {
+        fprintf(stderr, RED "Can't open %s!\n" RESET, in == NULL ? argv[optind + 1] : argv[optind + 2]);
+        status = ERROR;
+        goto free;
+    }
+    log = out == stdout ? stderr : stdout;
+    fprintf(log, CYAN "Assigning to %lu centroids of %lu columns...\n" RESET,
+            (unsigned long)centroids->size1, (unsigned long)centroids->size2);
+
+    start = stats_now();
+    status = assign_stream(centroids, in, out, &config, &stats);
+    fflush(out);
+    elapsed = stats_now() - start;
+    if (status != SUCCESS)
+    {
+        goto free;
+    }
+
+    // The sustained rate end to end and of each stage alone
+    fprintf(log, GREEN "Assigned %lu rows in %.3f s, %.0f rows/s\n" RESET, (unsigned long)stats.rows,
+            elapsed, elapsed > 0 ? stats.rows / elapsed : 0.0);
+    fprintf(log, YELLOW "%-8s %10s %16s\n" RESET, "STAGE", "TIME (s)", "ROWS/S");
+    fprintf(log, YELLOW "%-8s %10.3f %16.0f\n" RESET, "read", stats.read_time,
+            stats.read_time > 0 ? stats.rows / stats.read_time : 0.0);
+    fprintf(log, YELLOW "%-8s %10.3f %16.0f\n" RESET, "assign", stats.assign_time,
+            stats.assign_time > 0 ? stats.rows / stats.assign_time : 0.0);
+    fprintf(log, YELLOW "%-8s %10.3f %16.0f\n" RESET, "write", stats.write_time,
+            stats.write_time > 0 ? stats.rows / stats.write_time : 0.0);
+
+free:
+    if (in != NULL && in != stdin)
+        fclose(in);
+    if (out != NULL && out != stdout)
+        fclose(out);
+    gsl_matrix_free(centroids);
+
+    exit(status);
+}
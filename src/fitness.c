@@ -28,12 +28,15 @@
 #include <gsl/gsl_statistics.h>
 #include "utility.h"
 #include "fitness.h"
+#include "stats.h"
 
 double dunn_index(gsl_matrix *centroids, int n_clusters, gsl_matrix **clusters)
 {
     uint32_t rows = 0,
              cols = centroids->size2;
     double dunn = 0;
+    uint64_t distances = n_clusters * (n_clusters-1),
+             allocs = 3;
     gsl_vector *sub = gsl_vector_alloc(cols),
                *mean_dist = gsl_vector_alloc(n_clusters),
                *interclus = gsl_vector_alloc(n_clusters * (n_clusters-1));
@@ -49,6 +52,8 @@ double dunn_index(gsl_matrix *centroids, int n_clusters, gsl_matrix **clusters)
         }
         rows = clusters[n]->size1;
         gsl_vector *dist = gsl_vector_alloc(rows * (rows-1));
+        distances += (uint64_t)rows * (rows-1);
+        ++allocs;
 
         for (uint32_t i = 0, k = 0; i < rows; ++i)
         {
@@ -82,6 +87,8 @@ double dunn_index(gsl_matrix *centroids, int n_clusters, gsl_matrix **clusters)
 
     // Calculate the Dunn Index
     dunn = gsl_vector_min(interclus) / gsl_vector_max(mean_dist);
+    stats_add(STAT_DISTANCES, distances);
+    stats_add(STAT_ALLOCATIONS, allocs);
 
     if (DEBUG == DEBUG_DUNN)
     {
@@ -106,6 +113,9 @@ double dunn_index(gsl_matrix *centroids, int n_clusters, gsl_matrix **clusters)
 
         printf(YELLOW "DUNN INDEX: %10.6f\n" RESET, dunn);
     }
+    gsl_vector_free(sub);
+    gsl_vector_free(mean_dist);
+    gsl_vector_free(interclus);
 
     return dunn;
 }
@@ -0,0 +1,56 @@
+/*
+ * Evolutionary K-means clustering (E-means) using Genetic Algorithms.
+ *
+ * Copyright (C) 2015, Jonathan Gillett
+ * All rights reserved.
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+#include <stdio.h>
+#include <stdlib.h>
+#include <stdint.h>
+#include "utility.h"
+#include "synth.h"
+
+
+int main(int argc, char *argv[])
+{
+    int status = SUCCESS;
+
+    if (argc != 7)
+    {
+        fprintf(stderr, RED "Incorrect parameters!\n" RESET);
+        fprintf(stderr, RED "Correct usage:\n" RESET);
+        fprintf(stderr, RED "%s <ROWS> <COLS> <K> <SEPARATION> <SEED> <OUTPUT>\n\n" RESET, argv[0]);
+        exit(ERROR);
+    }
+
+    uint64_t rows = strtoull(argv[1], NULL, 10),
+             seed = strtoull(argv[5], NULL, 10);
+    uint32_t cols = (uint32_t)strtoul(argv[2], NULL, 10),
+             k = (uint32_t)strtoul(argv[3], NULL, 10);
+    double separation = strtod(argv[4], NULL);
+
+    if (rows < 1 || cols < 1 || k < 1)
+    {
+        fprintf(stderr, RED "ROWS, COLS and K must all be at least 1!\n" RESET);
+        exit(ERROR);
+    }
+
+    printf(CYAN "Generating %lu x %u dataset with %u blobs: %s\n" RESET,
+           (unsigned long)rows, cols, k, argv[6]);
+    status = synth_blobs(argv[6], rows, cols, k, separation, seed);
+
+    exit(status);
+}
@@ -21,36 +21,21 @@
 #include <stdlib.h>
 #include <stdint.h>
 #include <float.h>
+#include "emeans.h"
 #include "utility.h"
 #include "io.h"
 
 
-int save_results(char *output, char *output2, char *output3, int size, double fitness[size], 
-                 gsl_matrix **population, int n_clusters, gsl_matrix ***clusters)
+int save_results(char *output, char *output2, char *output3, emeans_result *result,
+                 gsl_matrix *data, const uint32_t *index)
 {
-    uint32_t rows = 0,
-             cols = 0;
-    int max_idx = 0;
+    uint32_t rows = result->centroids->size1,
+             cols = result->centroids->size2,
+             n_clusters = rows;
+    uint32_t *offsets = NULL,
+             *order = NULL,
+             *file = NULL;
     FILE *ofp, *ofp2, *ofp3;
-    double new_fitness = DBL_MIN;
-    // Static record across all function calls of the max fitness
-    static double max_fitness = DBL_MIN;
-
-    // Determine the chromosome with the highest fitness
-    for (int i = 0; i < size; ++i)
-    {
-        if (fitness[i] > max_fitness)
-        {
-            new_fitness = fitness[i];
-            max_idx = i;
-        }
-    }
-    // Only save the results if fitness is same or better
-    if (max_fitness > new_fitness)
-    {
-        return SUCCESS;
-    }
-    max_fitness = new_fitness;
 
     // Append the fitness to the file
     if ((ofp = fopen(output, "a")) == NULL) 
@@ -61,60 +46,83 @@ int save_results(char *output, char *output2, char *output3, int size, double fi
     if ((ofp2 = fopen(output2, "w")) == NULL) 
     {
         fprintf(stderr, RED "Can't open output file %s!\n" RESET, output2);
+        fclose(ofp);
         return ERROR;
     }
     if ((ofp3 = fopen(output3, "w")) == NULL) 
     {
         fprintf(stderr, RED "Can't open output file %s!\n" RESET, output3);
+        fclose(ofp);
+        fclose(ofp2);
         return ERROR;
     }
 
     // Save the new best fitness
-    printf(GREEN "Saving results for new best fitness: %10.6f\n" RESET, max_fitness);
-    fprintf(ofp, "%10.6f\n", max_fitness);
+    printf(GREEN "Saving results for new best fitness: %10.6f\n" RESET, result->fitness);
+    fprintf(ofp, "%10.6f\n", result->fitness);
     fclose(ofp);
 
     // Save the optimal population centroids
     printf(GREEN "Saving optimal population centroids\n" RESET);
-    rows = population[max_idx]->size1;
-    cols = population[max_idx]->size2;
     for (uint32_t i = 0; i < rows; ++i)
     {
         for (uint32_t j = 0; j < cols; ++j)
         {
             if (j == 0)
-                fprintf(ofp2, "%10.6f", gsl_matrix_get(population[max_idx], i, j));
+                fprintf(ofp2, "%10.6f", gsl_matrix_get(result->centroids, i, j));
             else
-                fprintf(ofp2, ",%10.6f", gsl_matrix_get(population[max_idx], i, j));
+                fprintf(ofp2, ",%10.6f", gsl_matrix_get(result->centroids, i, j));
         }
         fprintf(ofp2, "\n");
     }
     fclose(ofp2);
 
+    // Order the rows by cluster, keeping the order of the data file within
+    // each cluster, file holds the row of data of each row of the data file
+    rows = data->size1;
+    offsets = (uint32_t *)calloc(n_clusters + 1, sizeof(uint32_t));
+    order = (uint32_t *)malloc(rows * sizeof(uint32_t));
+    file = index != NULL ? (uint32_t *)malloc(rows * sizeof(uint32_t)) : NULL;
+    if (offsets == NULL || order == NULL || (index != NULL && file == NULL))
+    {
+        fprintf(stderr, RED "Unable to allocate cluster ordering!\n" RESET);
+        free(offsets);
+        free(order);
+        free(file);
+        fclose(ofp3);
+        return ERROR;
+    }
+    for (uint32_t i = 0; index != NULL && i < rows; ++i)
+        file[index[i]] = i;
+    for (uint32_t i = 0; i < rows; ++i)
+        offsets[result->labels[i] + 1] += 1;
+    for (uint32_t n = 0; n < n_clusters; ++n)
+        offsets[n + 1] += offsets[n];
+    for (uint32_t f = 0; f < rows; ++f)
+    {
+        uint32_t i = file != NULL ? file[f] : f;
+        order[offsets[result->labels[i]]++] = i;
+    }
+
     // Save the optimal clustering
     printf(GREEN "Saving optimal clustering results\n" RESET);
-    for (int n = 0; n < n_clusters; ++n)
+    for (uint32_t i = 0; i < rows; ++i)
     {
-        // Skip empty clusters
-        if (clusters[max_idx][n] == NULL)
-            continue;
+        uint32_t r = order[i];
 
-        rows = clusters[max_idx][n]->size1;
-        cols = clusters[max_idx][n]->size2;
-
-        for (uint32_t i = 0; i < rows; ++i)
+        for (uint32_t j = 0; j < cols; ++j)
         {
-            for (uint32_t j = 0; j < cols; ++j)
-            {
-                if (j == 0)
-                    fprintf(ofp3, "%10.6f,%10.6f", (double)n, gsl_matrix_get(clusters[max_idx][n], i, j));
-                else
-                    fprintf(ofp3, ",%10.6f", gsl_matrix_get(clusters[max_idx][n], i, j));
-            }
-            fprintf(ofp3, "\n");
+            if (j == 0)
+                fprintf(ofp3, "%10.6f,%10.6f", (double)result->labels[r], gsl_matrix_get(data, r, j));
+            else
+                fprintf(ofp3, ",%10.6f", gsl_matrix_get(data, r, j));
         }
+        fprintf(ofp3, "\n");
     }
     fclose(ofp3);
+    free(offsets);
+    free(order);
+    free(file);
     
     return SUCCESS;
 }
@@ -160,4 +168,61 @@ int load_data(char *input, gsl_matrix *data)
         }
     }
     return SUCCESS;
-}
\ No newline at end of file
+}
+
+
+gsl_matrix *load_centroids(char *input)
+{
+    uint32_t rows = 0,
+             cols = 1;
+    int c = 0,
+        prev = '\n';
+    double val = 0;
+    gsl_matrix *centroids = NULL;
+    FILE *ifp;
+
+    if ((ifp = fopen(input, "r")) == NULL) 
+    {
+        fprintf(stderr, RED "Can't open input file %s!\n" RESET, input);
+        return NULL;
+    }
+
+    // Count the non-empty lines and the columns of the first line
+    while ((c = fgetc(ifp)) != EOF)
+    {
+        if (c == ',' && rows == 0)
+            ++cols;
+        if (c == '\n' && prev != '\n')
+            ++rows;
+        prev = c;
+    }
+    rows += prev != '\n';
+    if (rows == 0)
+    {
+        fprintf(stderr, RED "No centroids in %s!\n" RESET, input);
+        fclose(ifp);
+        return NULL;
+    }
+
+    // Parse the centroids as load_data() does, without logging to stdout
+    rewind(ifp);
+    centroids = gsl_matrix_alloc(rows, cols);
+    for (uint32_t i = 0; i < rows; ++i)
+    {
+        for (uint32_t j = 0; j < cols; ++j)
+        {
+            if (fscanf(ifp, "%lf,", &val) != 1)
+            {
+                fprintf(stderr, RED "Centroid %u of %s does not have %u columns!\n" RESET, 
+                        i + 1, input, cols);
+                gsl_matrix_free(centroids);
+                fclose(ifp);
+                return NULL;
+            }
+            gsl_matrix_set(centroids, i, j, val);
+        }
+    }
+    fclose(ifp);
+
+    return centroids;
+}
@@ -0,0 +1,428 @@
+/*
+ * Evolutionary K-means clustering (E-means) using Genetic Algorithms.
+ *
+ * Copyright (C) 2015, Jonathan Gillett
+ * All rights reserved.
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+#include <stdio.h>
+#include <stdlib.h>
+#include <stdint.h>
+#include <string.h>
+#include <float.h>
+#include <gsl/gsl_matrix.h>
+#include "utility.h"
+#include "kdtree.h"
+#include "stats.h"
+
+
+/**
+ * Appends a cell to the kd-tree, growing the arrays of the cells as needed.
+ *
+ * @param tree     The kd-tree
+ * @param lo       The first row of the cell in the index
+ * @param hi       One past the last row of the cell in the index
+ * @param capacity The number of cells allocated, updated by function
+ *
+ * @return         The cell, -1 on ERROR
+ */
+static int32_t add_node(kd_tree *tree, uint32_t lo, uint32_t hi, uint32_t *capacity)
+{
+    uint32_t cols = tree->cols;
+
+    if (tree->n_nodes == *capacity)
+    {
+        uint32_t grown = *capacity * 2;
+        kd_node *nodes = (kd_node *)realloc(tree->nodes, grown * sizeof(kd_node));
+        double *bounds = NULL,
+               *sums = NULL;
+
+        if (nodes != NULL)
+            tree->nodes = nodes;
+        bounds = (double *)realloc(tree->bounds, (size_t)grown * 2 * cols * sizeof(double));
+        if (bounds != NULL)
+            tree->bounds = bounds;
+        sums = (double *)realloc(tree->sums, (size_t)grown * cols * sizeof(double));
+        if (sums != NULL)
+            tree->sums = sums;
+        if (nodes == NULL || bounds == NULL || sums == NULL)
+            return -1;
+        *capacity = grown;
+    }
+    tree->nodes[tree->n_nodes].lo = lo;
+    tree->nodes[tree->n_nodes].hi = hi;
+    tree->nodes[tree->n_nodes].left = -1;
+    tree->nodes[tree->n_nodes].right = -1;
+
+    return (int32_t)tree->n_nodes++;
+}
+
+
+/**
+ * Partially sorts the range of the index by a column so that the row at mid
+ * has the median value, with no greater value before and no lesser value
+ * after it.
+ *
+ * @param index The rows of the data
+ * @param data  Pointer to matrix containing the data
+ * @param col   The column to sort by
+ * @param lo    The first row of the range in the index
+ * @param hi    One past the last row of the range in the index
+ * @param mid   The position of the median
+ */
+static void select_median(uint32_t *index, gsl_matrix *data, uint32_t col, uint32_t lo,
+                          uint32_t hi, uint32_t mid)
+{
+    while (hi - lo > 1)
+    {
+        double pivot = gsl_matrix_get(data, index[lo + (hi - lo) / 2], col);
+        uint32_t i = lo,
+                 j = hi - 1;
+
+        // Hoare partition around the pivot
+        while (i <= j)
+        {
+            while (gsl_matrix_get(data, index[i], col) < pivot)
+                ++i;
+            while (gsl_matrix_get(data, index[j], col) > pivot)
+                --j;
+            if (i <= j)
+            {
+                uint32_t swap = index[i];
+                index[i] = index[j];
+                index[j] = swap;
+                ++i;
+                if (j == 0)
+                    break;
+                --j;
+            }
+        }
+        if (mid <= j)
+            hi = j + 1;
+        else if (mid >= i)
+            lo = i;
+        else
+            return;
+    }
+}
+
+
+/**
+ * Builds the cell of the kd-tree over a range of the index and its children.
+ *
+ * @param tree     The kd-tree
+ * @param data     Pointer to matrix containing the data
+ * @param lo       The first row of the cell in the index
+ * @param hi       One past the last row of the cell in the index
+ * @param capacity The number of cells allocated, updated by function
+ *
+ * @return         The cell, -1 on ERROR
+ */
+static int32_t build_node(kd_tree *tree, gsl_matrix *data, uint32_t lo, uint32_t hi,
+                          uint32_t *capacity)
+{
+    uint32_t cols = tree->cols,
+             widest = 0,
+             mid = lo + (hi - lo) / 2;
+    int32_t id = add_node(tree, lo, hi, capacity),
+            left = 0,
+            right = 0;
+    double *min = NULL,
+           *max = NULL,
+           *sum = NULL;
+
+    if (id < 0)
+    {
+        return -1;
+    }
+    min = tree->bounds + (size_t)id * 2 * cols;
+    max = min + cols;
+    sum = tree->sums + (size_t)id * cols;
+
+    // The bounding box and the weighted sum of the rows of the cell
+    for (uint32_t j = 0; j < cols; ++j)
+    {
+        min[j] = DBL_MAX;
+        max[j] = -DBL_MAX;
+        sum[j] = 0;
+    }
+    tree->nodes[id].count = 0;
+    for (uint32_t i = lo; i < hi; ++i)
+    {
+        const double *row = data->data + (size_t)tree->index[i] * data->tda;
+        uint32_t w = tree->weights != NULL ? tree->weights[tree->index[i]] : 1;
+
+        for (uint32_t j = 0; j < cols; ++j)
+        {
+            if (row[j] < min[j])
+                min[j] = row[j];
+            if (row[j] > max[j])
+                max[j] = row[j];
+            sum[j] += w * row[j];
+        }
+        tree->nodes[id].count += w;
+    }
+    for (uint32_t j = 1; j < cols; ++j)
+    {
+        if (max[j] - min[j] > max[widest] - min[widest])
+            widest = j;
+    }
+
+    // Split at the median of the widest column, unless every row is the same
+    if (hi - lo <= KD_LEAF_SIZE || max[widest] == min[widest])
+    {
+        return id;
+    }
+    select_median(tree->index, data, widest, lo, hi, mid);
+
+    if ((left = build_node(tree, data, lo, mid, capacity)) < 0
+        || (right = build_node(tree, data, mid, hi, capacity)) < 0)
+    {
+        return -1;
+    }
+    tree->nodes[id].left = left;
+    tree->nodes[id].right = right;
+
+    return id;
+}
+
+
+kd_tree *kd_build(gsl_matrix *data, const uint32_t *weights)
+{
+    uint32_t rows = data->size1,
+             cols = data->size2,
+             capacity = 2 * (rows / KD_LEAF_SIZE) + 1;
+    kd_tree *tree = (kd_tree *)calloc(1, sizeof(kd_tree));
+
+    if (tree == NULL)
+    {
+        fprintf(stderr, RED "Unable to allocate the kd-tree!\n" RESET);
+        return NULL;
+    }
+    tree->cols = cols;
+    tree->weights = weights;
+    tree->index = (uint32_t *)malloc(rows * sizeof(uint32_t));
+    tree->nodes = (kd_node *)malloc(capacity * sizeof(kd_node));
+    tree->bounds = (double *)malloc((size_t)capacity * 2 * cols * sizeof(double));
+    tree->sums = (double *)malloc((size_t)capacity * cols * sizeof(double));
+    if (tree->index == NULL || tree->nodes == NULL || tree->bounds == NULL || tree->sums == NULL)
+    {
+        fprintf(stderr, RED "Unable to allocate the kd-tree!\n" RESET);
+        kd_free(tree);
+        return NULL;
+    }
+    stats_add(STAT_ALLOCATIONS, 5);
+
+    for (uint32_t i = 0; i < rows; ++i)
+        tree->index[i] = i;
+
+    if (build_node(tree, data, 0, rows, &capacity) < 0)
+    {
+        fprintf(stderr, RED "Unable to allocate the kd-tree!\n" RESET);
+        kd_free(tree);
+        return NULL;
+    }
+
+    if (VERBOSE == 1)
+        printf(CYAN "Built kd-tree with %u cells\n" RESET, tree->n_nodes);
+
+    return tree;
+}
+
+
+void kd_free(kd_tree *tree)
+{
+    if (tree == NULL)
+    {
+        return;
+    }
+    free(tree->nodes);
+    free(tree->index);
+    free(tree->bounds);
+    free(tree->sums);
+    free(tree);
+}
+
+
+/**
+ * Assigns a row to its cluster and counts it if it changed cluster.
+ *
+ * @param labels The cluster of each row of data, may be NULL
+ * @param row    The row
+ * @param k      The cluster of the row
+ *
+ * @return       The number of rows that changed cluster, 0 or 1
+ */
+static inline uint32_t set_label(uint32_t *labels, uint32_t row, uint32_t k)
+{
+    if (labels == NULL || labels[row] == k)
+        return 0;
+    labels[row] = k;
+    return 1;
+}
+
+
+/**
+ * Filters the candidate centroids of a cell and assigns its rows, recursing
+ * into the children while more than one candidate remains.
+ *
+ * @param tree      The kd-tree of the data
+ * @param data      Pointer to matrix containing the data
+ * @param centroids Pointer to matrix containing the centroids
+ * @param id        The cell
+ * @param cand      The candidate centroids of the cell in ascending order
+ * @param n_cand    The number of candidates
+ * @param sums      The sums of the rows in each cluster
+ * @param counts    The number of rows in each cluster
+ * @param labels    The cluster of each row of data, may be NULL
+ * @param distances The number of distances evaluated, updated by function
+ *
+ * @return          The number of rows that changed cluster
+ */
+static uint32_t filter(const kd_tree *tree, gsl_matrix *data, gsl_matrix *centroids,
+                       int32_t id, const uint32_t *cand, uint32_t n_cand, double *sums,
+                       uint32_t *counts, uint32_t *labels, uint64_t *distances)
+{
+    const kd_node *node = &tree->nodes[id];
+    uint32_t cols = tree->cols,
+             best = cand[0],
+             n_keep = 0,
+             changed = 0;
+    uint32_t keep[n_cand];
+    const double *min = tree->bounds + (size_t)id * 2 * cols,
+                 *max = min + cols,
+                 *zbest = NULL;
+    double best_dist = DBL_MAX;
+
+    // The rows of a leaf are assigned to the nearest candidate
+    if (node->left < 0)
+    {
+        for (uint32_t i = node->lo; i < node->hi; ++i)
+        {
+            uint32_t row = tree->index[i],
+                     k = cand[0],
+                     w = tree->weights != NULL ? tree->weights[row] : 1;
+            const double *x = data->data + (size_t)row * data->tda;
+
+            best_dist = DBL_MAX;
+            for (uint32_t c = 0; c < n_cand; ++c)
+            {
+                const double *z = gsl_matrix_const_ptr(centroids, cand[c], 0);
+                double dist = 0;
+
+                for (uint32_t j = 0; j < cols; ++j)
+                    dist += (x[j] - z[j]) * (x[j] - z[j]);
+                if (dist < best_dist)
+                {
+                    best_dist = dist;
+                    k = cand[c];
+                }
+            }
+            for (uint32_t j = 0; j < cols; ++j)
+                sums[k * cols + j] += w * x[j];
+            counts[k] += w;
+            changed += set_label(labels, row, k);
+        }
+        *distances += (uint64_t)(node->hi - node->lo) * n_cand;
+        return changed;
+    }
+
+    // The candidate nearest the midpoint of the cell
+    for (uint32_t c = 0; c < n_cand; ++c)
+    {
+        const double *z = gsl_matrix_const_ptr(centroids, cand[c], 0);
+        double dist = 0;
+
+        for (uint32_t j = 0; j < cols; ++j)
+        {
+            double mid = 0.5 * (min[j] + max[j]);
+            dist += (z[j] - mid) * (z[j] - mid);
+        }
+        if (dist < best_dist)
+        {
+            best_dist = dist;
+            best = cand[c];
+        }
+    }
+    zbest = gsl_matrix_const_ptr(centroids, best, 0);
+
+    // Prune each candidate that is farther than the best from the vertex of
+    // the cell furthest in its direction, and so from every point of the cell
+    for (uint32_t c = 0; c < n_cand; ++c)
+    {
+        const double *z = gsl_matrix_const_ptr(centroids, cand[c], 0);
+        double dist = 0,
+               dist_best = 0;
+
+        if (cand[c] == best)
+        {
+            keep[n_keep++] = best;
+            continue;
+        }
+        for (uint32_t j = 0; j < cols; ++j)
+        {
+            double v = z[j] > zbest[j] ? max[j] : min[j];
+            dist += (z[j] - v) * (z[j] - v);
+            dist_best += (zbest[j] - v) * (zbest[j] - v);
+        }
+        if (dist < dist_best)
+            keep[n_keep++] = cand[c];
+    }
+    *distances += 3 * (uint64_t)n_cand;
+
+    // A single candidate owns every row of the cell
+    if (n_keep == 1)
+    {
+        const double *sum = tree->sums + (size_t)id * cols;
+
+        for (uint32_t j = 0; j < cols; ++j)
+            sums[best * cols + j] += sum[j];
+        counts[best] += node->count;
+        if (labels != NULL)
+        {
+            for (uint32_t i = node->lo; i < node->hi; ++i)
+                changed += set_label(labels, tree->index[i], best);
+        }
+        return changed;
+    }
+
+    changed += filter(tree, data, centroids, node->left, keep, n_keep, sums, counts, 
+                      labels, distances);
+    changed += filter(tree, data, centroids, node->right, keep, n_keep, sums, counts, 
+                      labels, distances);
+
+    return changed;
+}
+
+
+uint32_t kd_assign(const kd_tree *tree, gsl_matrix *data, gsl_matrix *centroids,
+                   double *sums, uint32_t *counts, uint32_t *labels)
+{
+    uint32_t n_clusters = centroids->size1,
+             changed = 0;
+    uint32_t cand[n_clusters];
+    uint64_t distances = 0;
+
+    memset(sums, 0, (size_t)n_clusters * tree->cols * sizeof(double));
+    memset(counts, 0, n_clusters * sizeof(uint32_t));
+    for (uint32_t k = 0; k < n_clusters; ++k)
+        cand[k] = k;
+
+    changed = filter(tree, data, centroids, 0, cand, n_clusters, sums, counts, labels, 
+                     &distances);
+    stats_add(STAT_DISTANCES, distances);
+
+    return changed;
+}
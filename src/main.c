@@ -0,0 +1,585 @@
+/*
+ * Evolutionary K-means clustering (E-means) using Genetic Algorithms.
+ *
+ * Copyright (C) 2015, Jonathan Gillett
+ * All rights reserved.
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+#define _POSIX_C_SOURCE 200809L
+#include <stdio.h>
+#include <stdlib.h>
+#include <stdint.h>
+#include <stdbool.h>
+#include <string.h>
+#include <unistd.h>
+#include <signal.h>
+#include <time.h>
+#include <confuse.h>
+#include <omp.h>
+#include <gsl/gsl_matrix.h>
+#include "utility.h"
+#include "emeans.h"
+#include "io.h"
+#include "compress.h"
+#include "pcg_basic.h"
+#include "reduce.h"
+#include "reorder.h"
+#include "stats.h"
+#include "trace.h"
+
+
+// Define the configuration parameters
+emeans_config config;
+int64_t data_rows = 0,
+        data_cols = 0,
+        reduce_method = REDUCE_NONE,
+        reduce_dims = 0,
+        reorder = REORDER_NONE,
+        dedup = 0;
+double  dedup_cell = 0,
+        stats_interval = 5.0;
+char    *data_file = NULL,
+        *centroids_file = NULL,
+        *fitness_file = NULL,
+        *cluster_file = NULL,
+        *stats_file = NULL,
+        *trace_file = NULL;
+
+// The configuration file parsing mappings
+cfg_opt_t opts[] = {
+    CFG_SIMPLE_INT("n_clusters", &config.n_clusters),
+    CFG_SIMPLE_INT("k_min", &config.k_min),
+    CFG_SIMPLE_INT("k_max", &config.k_max),
+    CFG_SIMPLE_INT("trials", &config.trials),
+    CFG_SIMPLE_INT("trials_select", &config.trials_select),
+    CFG_SIMPLE_INT("init_method", &config.init_method),
+    CFG_SIMPLE_INT("init_rounds", &config.init_rounds),
+    CFG_SIMPLE_INT("mutate_method", &config.mutate_method),
+    CFG_SIMPLE_INT("crossover_method", &config.crossover_method),
+    CFG_SIMPLE_INT("size", &config.size),
+    CFG_SIMPLE_INT("seed", &config.seed),
+    CFG_SIMPLE_INT("threads", &config.threads),
+    CFG_SIMPLE_INT("batch_kb", &config.batch_kb),
+    CFG_SIMPLE_INT("kdtree", &config.kdtree),
+    CFG_SIMPLE_INT("pds", &config.pds),
+    CFG_SIMPLE_INT("steady_state", &config.steady_state),
+    CFG_SIMPLE_INT("selection", &config.selection),
+    CFG_SIMPLE_INT("tournament", &config.tournament),
+    CFG_SIMPLE_INT("elitism", &config.elitism),
+    CFG_SIMPLE_FLOAT("dup_tol", &config.dup_tol),
+    CFG_SIMPLE_INT("plateau", &config.plateau),
+    CFG_SIMPLE_FLOAT("min_diversity", &config.min_diversity),
+    CFG_SIMPLE_FLOAT("target_fitness", &config.target_fitness),
+    CFG_SIMPLE_FLOAT("time_limit", &config.time_limit),
+    CFG_SIMPLE_INT("lloyd_max_iter", &config.lloyd_max_iter),
+    CFG_SIMPLE_INT("lloyd_min_iter", &config.lloyd_min_iter),
+    CFG_SIMPLE_INT("lloyd_adaptive", &config.lloyd_adaptive),
+    CFG_SIMPLE_FLOAT("lloyd_tol", &config.lloyd_tol),
+    CFG_SIMPLE_FLOAT("lloyd_min_changed", &config.lloyd_min_changed),
+    CFG_SIMPLE_FLOAT("m_rate", &config.m_rate),
+    CFG_SIMPLE_FLOAT("c_rate", &config.c_rate),
+    CFG_SIMPLE_FLOAT("k_rate", &config.k_rate),
+    CFG_SIMPLE_INT("max_iter", &config.max_iter),
+    CFG_SIMPLE_INT("data_rows", &data_rows),
+    CFG_SIMPLE_INT("data_cols", &data_cols),
+    CFG_SIMPLE_INT("reduce_method", &reduce_method),
+    CFG_SIMPLE_INT("reduce_dims", &reduce_dims),
+    CFG_SIMPLE_INT("reorder", &reorder),
+    CFG_SIMPLE_INT("dedup", &dedup),
+    CFG_SIMPLE_FLOAT("dedup_cell", &dedup_cell),
+    CFG_SIMPLE_STR("data_file", &data_file),
+    CFG_SIMPLE_STR("centroids_file", &centroids_file),
+    CFG_SIMPLE_STR("fitness_file", &fitness_file),
+    CFG_SIMPLE_STR("cluster_file", &cluster_file),
+    CFG_SIMPLE_STR("stats_file", &stats_file),
+    CFG_SIMPLE_FLOAT("stats_interval", &stats_interval),
+    CFG_SIMPLE_STR("trace_file", &trace_file),
+    CFG_END()
+};
+cfg_t *cfg;
+
+// The running context, stopped gracefully by SIGINT and SIGTERM
+static emeans_ctx *running = NULL;
+
+// The reason for each termination policy
+static const char *term_reasons[] = {
+    "running", "maximum iterations reached", "fitness plateau reached",
+    "population diversity collapsed", "target fitness reached", "time limit reached",
+    "stop signal received"
+};
+
+
+/**
+ * Handles SIGINT and SIGTERM by requesting that E-means terminates once the
+ * current generation completes, a second signal terminates immediately.
+ *
+ * @param signum The signal number
+ */
+static void handle_signal(int signum)
+{
+    (void)signum;
+    if (running != NULL)
+        emeans_stop(running);
+}
+
+
+/**
+ * Projects the data to reduce_dims dimensions with the configured method.
+ *
+ * @param data Pointer to matrix containing the data
+ *
+ * @return     The projected data, NULL on ERROR
+ */
+static gsl_matrix *reduce_data(gsl_matrix *data)
+{
+    int status = SUCCESS;
+    pcg32_random_t rng;
+    gsl_matrix *reduced = gsl_matrix_alloc(data->size1, reduce_dims);
+
+    printf(CYAN "Reducing the data to %ld dimensions...\n" RESET, (long)reduce_dims);
+    if (reduce_method == REDUCE_PCA)
+    {
+        status = pca_projection(data, reduced);
+    }
+    else
+    {
+        pcg32_srandom_r(&rng, config.seed != 0 ? (uint64_t)config.seed : (uint64_t)time(NULL), 89u);
+        status = random_projection(data, reduced, (int)config.threads, &rng);
+    }
+    if (status != SUCCESS)
+    {
+        gsl_matrix_free(reduced);
+        return NULL;
+    }
+
+    return reduced;
+}
+
+
+/**
+ * Saves the best result, the labels of compressed data are expanded to every
+ * row of the data file.
+ *
+ * @param result Pointer to the best result
+ * @param data   Pointer to matrix containing the data as loaded, or the
+ *               reordered data if not compressed
+ * @param rep    The compressed row of each row of data, NULL if not compressed
+ * @param index  The row of the data file of each row of data, may be NULL
+ *
+ * @return       The status code, 0 for SUCCESS, 1 for ERROR
+ */
+static int save_best(emeans_result *result, gsl_matrix *data, const uint32_t *rep,
+                     const uint32_t *index)
+{
+    int status = SUCCESS;
+    emeans_result full = *result;
+
+    if (rep == NULL)
+    {
+        return save_results(fitness_file, centroids_file, cluster_file, result, data, index);
+    }
+    if ((full.labels = (uint32_t *)malloc(data->size1 * sizeof(uint32_t))) == NULL)
+    {
+        fprintf(stderr, RED "Unable to allocate the expanded labels!\n" RESET);
+        return ERROR;
+    }
+    for (size_t i = 0; i < data->size1; ++i)
+        full.labels[i] = result->labels[rep[i]];
+    status = save_results(fitness_file, centroids_file, cluster_file, &full, data, NULL);
+    free(full.labels);
+
+    return status;
+}
+
+
+/**
+ * Refines the best clustering found in the reduced space in the full space
+ * and saves it.
+ *
+ * @param result  Pointer to the result in the reduced space
+ * @param work    Pointer to matrix containing the data that is clustered
+ * @param weights The number of rows each row of work stands for, may be NULL
+ * @param data    Pointer to matrix containing the data as loaded
+ * @param rep     The compressed row of each row of data, NULL if not compressed
+ * @param index   The row of the data file of each row of data, may be NULL
+ *
+ * @return        The status code, 0 for SUCCESS, 1 for ERROR
+ */
+static int save_refined(emeans_result *result, gsl_matrix *work, const uint32_t *weights,
+                        gsl_matrix *data, const uint32_t *rep, const uint32_t *index)
+{
+    int status = SUCCESS;
+    double start = stats_now();
+    emeans_result full = *result;
+    pcg32_random_t rng;
+
+    printf(CYAN "Refining the best clustering in %ld dimensions...\n" RESET, (long)work->size2);
+    pcg32_srandom_r(&rng, config.seed != 0 ? (uint64_t)config.seed : (uint64_t)time(NULL), 91u);
+    full.centroids = gsl_matrix_alloc(result->centroids->size1, work->size2);
+    full.labels = (uint32_t *)malloc(work->size1 * sizeof(uint32_t));
+    if (full.labels == NULL 
+        || refine_clustering(work, result->labels, full.centroids, full.labels, 
+                             &full.fitness, &rng, weights) != SUCCESS)
+    {
+        status = ERROR;
+        goto free;
+    }
+    stats_time(PHASE_LLOYD, start);
+
+    start = stats_now();
+    status = save_best(&full, data, rep, index);
+    stats_time(PHASE_IO, start);
+
+free:
+    gsl_matrix_free(full.centroids);
+    free(full.labels);
+    return status;
+}
+
+
+/**
+ * Reorders the rows of the data that is clustered and of the E-means context
+ * if created, and tracks the row of the data file of each row.
+ *
+ * @param perm    The row that is moved to each row
+ * @param index   The row of the data file of each row of work, updated by function
+ * @param work    Pointer to matrix containing the data that is clustered
+ * @param weights The number of rows each row of work stands for, may be NULL
+ * @param rep     The row of work of each row of the data file, may be NULL
+ * @param reduced Pointer to matrix containing the reduced data clustered by the
+ *                context, NULL if the data is not reduced
+ * @param ctx     Pointer to the E-means context, NULL before the data is reduced
+ *                and the context is created
+ *
+ * @return        The status code, 0 for SUCCESS, 1 for ERROR
+ */
+static int reorder_data(const uint32_t *perm, uint32_t *index, gsl_matrix *work,
+                        uint32_t *weights, uint32_t *rep, gsl_matrix *reduced, emeans_ctx *ctx)
+{
+    uint32_t rows = work->size1;
+
+    // The weights are permuted first as the context rebuilds its kd-tree
+    if (weights != NULL && permute_index(weights, perm, rows) != SUCCESS)
+        return ERROR;
+    if (rep != NULL && relabel_index(rep, data_rows, perm, rows) != SUCCESS)
+        return ERROR;
+
+    // The context permutes the matrix it clusters, the data unless reduced
+    if (ctx != NULL && emeans_permute(ctx, perm) != SUCCESS)
+        return ERROR;
+    if ((ctx == NULL || reduced != NULL) && permute_rows(work, perm) != SUCCESS)
+        return ERROR;
+
+    return permute_index(index, perm, rows);
+}
+
+
+/**
+ * The E-means algorithm, uses a genetic algorithm to optimize the parameters 
+ * for the K-means implemetation of clustering based Lloyds clustering algorithm.
+ *
+ * @return        Status code, 0 for SUCCESS, 1 for ERROR
+ */
+int emeans(void)
+{
+    gsl_matrix *data = NULL,
+               *compressed = NULL,
+               *work = NULL,
+               *reduced = NULL;
+    uint32_t *index = NULL,
+             *perm = NULL,
+             *rep = NULL,
+             *weights = NULL;
+    emeans_ctx *ctx = NULL;
+    emeans_result result;
+    int status = SUCCESS;
+    double start = 0,
+           last_write = 0,
+           last_check = 0;
+    struct sigaction action;
+
+    // Allocate memory and load the data
+    if (trace_file != NULL
+        && trace_init(config.threads > 0 ? (int)config.threads : omp_get_max_threads()) != SUCCESS)
+    {
+        return ERROR;
+    }
+    stats_reset();
+    start = stats_now();
+    data = gsl_matrix_alloc(data_rows, data_cols);
+
+    if ((status = load_data(data_file, data)) != SUCCESS)
+    {   
+        fprintf(stderr, RED "Unable to load data!\n" RESET);
+        status = ERROR;
+        goto free;
+    }
+
+    // Optionally cluster the distinct rows, or the means of the rows in each
+    // grid cell, weighted by the number of rows they stand for
+    work = data;
+    if (dedup != 0)
+    {
+        if ((rep = (uint32_t *)malloc(data_rows * sizeof(uint32_t))) == NULL
+            || (compressed = compress_data(data, dedup_cell, rep, &weights)) == NULL)
+        {
+            status = ERROR;
+            goto free;
+        }
+        work = compressed;
+    }
+
+    // Optionally reorder the rows so rows that cluster together are close in
+    // memory, the clustering is saved in the order of the data file
+    if (reorder != REORDER_NONE)
+    {
+        index = (uint32_t *)malloc(work->size1 * sizeof(uint32_t));
+        perm = (uint32_t *)malloc(work->size1 * sizeof(uint32_t));
+        if (index == NULL || perm == NULL)
+        {
+            fprintf(stderr, RED "Unable to allocate the row order!\n" RESET);
+            status = ERROR;
+            goto free;
+        }
+        for (size_t i = 0; i < work->size1; ++i)
+            index[i] = (uint32_t)i;
+    }
+    if (reorder == REORDER_MORTON)
+    {
+        printf(CYAN "Reordering the rows along the Morton curve...\n" RESET);
+        if ((status = morton_order(work, perm)) != SUCCESS
+            || (status = reorder_data(perm, index, work, weights, rep, NULL, NULL)) != SUCCESS)
+        {
+            goto free;
+        }
+    }
+
+    // Optionally cluster the data projected to fewer dimensions
+    if (reduce_method != REDUCE_NONE && reduce_dims > 0 && reduce_dims < data_cols)
+    {
+        if ((reduced = reduce_data(work)) == NULL)
+        {
+            status = ERROR;
+            goto free;
+        }
+    }
+
+    // Calculate the bounds and generate the initial population
+    printf(CYAN "Generating initial population...\n" RESET);
+    if ((ctx = emeans_create(&config, reduced != NULL ? reduced : work, weights)) == NULL)
+    {
+        status = ERROR;
+        goto free;
+    }
+    stats_time(PHASE_LOAD, start);
+
+    // Terminate gracefully on SIGINT and SIGTERM, flushing the results
+    memset(&result, 0, sizeof(result));
+    memset(&action, 0, sizeof(action));
+    action.sa_handler = handle_signal;
+    action.sa_flags = SA_RESETHAND;
+    sigemptyset(&action.sa_mask);
+    running = ctx;
+    sigaction(SIGINT, &action, NULL);
+    sigaction(SIGTERM, &action, NULL);
+
+    // Perform the Genetic Algorithm
+    for (int64_t iter = 0; !emeans_done(ctx, &result); ++iter)
+    {
+        if ((status = emeans_step(ctx, &result)) != SUCCESS)
+        {
+            goto free;
+        }
+        stats_run_time(result.run_time);
+
+        // Reorder the rows by the best clustering of the first generation
+        if (reorder == REORDER_CLUSTER && iter == 0 && result.labels != NULL)
+        {
+            printf(CYAN "Reordering the rows by cluster...\n" RESET);
+            if ((status = cluster_order(result.labels, work->size1, perm)) != SUCCESS
+                || (status = reorder_data(perm, index, work, weights, rep, reduced, ctx)) != SUCCESS)
+            {
+                goto free;
+            }
+        }
+
+        // Save the results if there is a new best solution, a clustering of
+        // the reduced data is only saved once refined at termination
+        if (result.improved && reduced != NULL)
+        {
+            printf(CYAN "New best fitness in the reduced space: %10.6f\n" RESET, result.fitness);
+        }
+        else if (result.improved)
+        {
+            start = stats_now();
+            trace_begin("save_results", iter);
+            save_best(&result, rep != NULL ? data : work, rep, index);
+            trace_end("save_results", iter);
+            stats_time(PHASE_IO, start);
+        }
+
+        // Refresh the stats file periodically
+        if (stats_file != NULL && stats_now() - last_write >= stats_interval)
+        {
+            stats_write(stats_file);
+            last_write = stats_now();
+        }
+
+        // Check for the stop file at most once a second, stopping if present
+        if (stats_now() - last_check >= 1.0)
+        {
+            last_check = stats_now();
+            if (access("./stop", F_OK) != -1)
+            {
+                remove("./stop");
+                emeans_stop(ctx);
+            }
+        }
+    }
+    printf(YELLOW "Terminating after %ld generations, %s!\n" RESET, 
+           (long)result.generations, term_reasons[result.term]);
+    if (reduced != NULL && result.centroids != NULL 
+        && (status = save_refined(&result, work, weights, rep != NULL ? data : work,
+                                  rep, index)) != SUCCESS)
+    {
+        goto free;
+    }
+    printf(GREEN "Finished executing E-means, shutting down!\n" RESET);
+    if (stats_file != NULL)
+        stats_write(stats_file);
+    stats_summary();
+    if (trace_file != NULL)
+        trace_write(trace_file);
+
+free:
+    signal(SIGINT, SIG_DFL);
+    signal(SIGTERM, SIG_DFL);
+    running = NULL;
+    emeans_free(ctx);
+    gsl_matrix_free(reduced);
+    gsl_matrix_free(compressed);
+    gsl_matrix_free(data);
+    free(index);
+    free(perm);
+    free(rep);
+    free(weights);
+    return status;
+}
+
+int main(int argc, char *argv[])
+{
+    int status = SUCCESS;
+    char conf_file[100] = "./conf/emeans.conf";
+
+    if (argc < 3 || argc > 4)
+    {
+        fprintf(stderr, RED "Incorrect parameters!\n" RESET);
+        fprintf(stderr, RED "Correct usage:\n" RESET);
+        fprintf(stderr, RED "%s <DEBUG> (1..N=DEBUG 0=NODEBUG) <VERBOSE> (1=YES 0=NO) "
+                            "<CONFIG> (DEFAULT ./conf/emeans.conf)\n\n" RESET, argv[0]);
+        status = ERROR;
+        goto free;
+    }
+    DEBUG = atoi(argv[1]);
+    VERBOSE = atoi(argv[2]);
+
+    if (argc > 3)
+    {
+        strcpy(conf_file, argv[3]);
+    }
+
+    if (access(conf_file, F_OK) != -1)
+    {
+        emeans_defaults(&config);
+        cfg = cfg_init(opts, 0);
+        cfg_parse(cfg, conf_file);
+    }
+    else
+    {
+        fprintf(stderr, RED "Unable to open file %s\n" RESET, conf_file);
+        status = ERROR;
+        goto free;
+    }
+
+    if (DEBUG == DEBUG_CONFIG)
+    {
+        printf(YELLOW "\n============================================================\n" RESET);
+        printf(YELLOW "= CONFIG FILE PARAMS\n" RESET);
+        printf(YELLOW "============================================================\n" RESET);
+        printf(YELLOW "   NUM CLUSTERS: %10ld\n" RESET, (long)config.n_clusters);
+        printf(YELLOW "   MIN CLUSTERS: %10ld\n" RESET, (long)config.k_min);
+        printf(YELLOW "   MAX CLUSTERS: %10ld\n" RESET, (long)config.k_max);
+        printf(YELLOW "CENTROID TRIALS: %10ld\n" RESET, (long)config.trials);
+        printf(YELLOW "  TRIALS SELECT: %10ld\n" RESET, (long)config.trials_select);
+        printf(YELLOW "    INIT METHOD: %10ld\n" RESET, (long)config.init_method);
+        printf(YELLOW "    INIT ROUNDS: %10ld\n" RESET, (long)config.init_rounds);
+        printf(YELLOW "  MUTATE METHOD: %10ld\n" RESET, (long)config.mutate_method);
+        printf(YELLOW "      CROSSOVER: %10ld\n" RESET, (long)config.crossover_method);
+        printf(YELLOW "POPULATION SIZE: %10ld\n" RESET, (long)config.size);
+        printf(YELLOW "           SEED: %10ld\n" RESET, (long)config.seed);
+        printf(YELLOW "        THREADS: %10ld\n" RESET, (long)config.threads);
+        printf(YELLOW "     BATCH (KB): %10ld\n" RESET, (long)config.batch_kb);
+        printf(YELLOW "        KD-TREE: %10ld\n" RESET, (long)config.kdtree);
+        printf(YELLOW "            PDS: %10ld\n" RESET, (long)config.pds);
+        printf(YELLOW "   STEADY STATE: %10ld\n" RESET, (long)config.steady_state);
+        printf(YELLOW "      SELECTION: %10ld\n" RESET, (long)config.selection);
+        printf(YELLOW "     TOURNAMENT: %10ld\n" RESET, (long)config.tournament);
+        printf(YELLOW "        ELITISM: %10ld\n" RESET, (long)config.elitism);
+        printf(YELLOW "  DUP TOLERANCE: %10.6f\n" RESET, config.dup_tol);
+        printf(YELLOW "  MUTATION RATE: %10.6f\n" RESET, config.m_rate);
+        printf(YELLOW " CROSSOVER RATE: %10.6f\n" RESET, config.c_rate);
+        printf(YELLOW "   CLUSTER RATE: %10.6f\n" RESET, config.k_rate);
+        printf(YELLOW " MAX ITERATIONS: %10ld\n" RESET, (long)config.max_iter);
+        printf(YELLOW "        PLATEAU: %10ld\n" RESET, (long)config.plateau);
+        printf(YELLOW "  MIN DIVERSITY: %10.6f\n" RESET, config.min_diversity);
+        printf(YELLOW " TARGET FITNESS: %10.6f\n" RESET, config.target_fitness);
+        printf(YELLOW "     TIME LIMIT: %10.6f\n" RESET, config.time_limit);
+        printf(YELLOW " LLOYD MAX ITER: %10ld\n" RESET, (long)config.lloyd_max_iter);
+        printf(YELLOW " LLOYD MIN ITER: %10ld\n" RESET, (long)config.lloyd_min_iter);
+        printf(YELLOW " LLOYD ADAPTIVE: %10ld\n" RESET, (long)config.lloyd_adaptive);
+        printf(YELLOW "LLOYD TOLERANCE: %10.6f\n" RESET, config.lloyd_tol);
+        printf(YELLOW "  LLOYD CHANGED: %10.6f\n" RESET, config.lloyd_min_changed);
+        printf(YELLOW "      DATA ROWS: %10ld\n" RESET, data_rows);
+        printf(YELLOW "      DATA COLS: %10ld\n" RESET, data_cols);
+        printf(YELLOW "  REDUCE METHOD: %10ld\n" RESET, reduce_method);
+        printf(YELLOW "    REDUCE DIMS: %10ld\n" RESET, reduce_dims);
+        printf(YELLOW "        REORDER: %10ld\n" RESET, reorder);
+        printf(YELLOW "          DEDUP: %10ld\n" RESET, dedup);
+        printf(YELLOW "     DEDUP CELL: %10.6f\n" RESET, dedup_cell);
+        printf(YELLOW "      DATA FILE: %s\n" RESET, data_file);
+        printf(YELLOW " CENTROIDS FILE: %s\n" RESET, centroids_file);
+        printf(YELLOW "   FITNESS FILE: %s\n" RESET, fitness_file);
+        printf(YELLOW "   CLUSTER FILE: %s\n" RESET, cluster_file);
+        printf(YELLOW "     STATS FILE: %s\n" RESET, stats_file);
+        printf(YELLOW " STATS INTERVAL: %10.6f\n" RESET, stats_interval);
+        printf(YELLOW "     TRACE FILE: %s\n" RESET, trace_file);
+        goto free;
+    }
+
+    // Execute the E-means algorithm
+    status = emeans();
+
+// Free memory and exit
+free:
+    cfg_free(cfg);
+    free(data_file);
+    free(centroids_file);
+    free(fitness_file);
+    free(cluster_file);
+    free(stats_file);
+    free(trace_file);
+
+    exit(status);
+}
\ No newline at end of file
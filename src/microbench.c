@@ -0,0 +1,456 @@
+/*
+ * Evolutionary K-means clustering (E-means) using Genetic Algorithms.
+ *
+ * Copyright (C) 2015, Jonathan Gillett
+ * All rights reserved.
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+#define _DEFAULT_SOURCE
+#include <stdio.h>
+#include <stdlib.h>
+#include <stdint.h>
+#include <string.h>
+#include <math.h>
+#include <time.h>
+#include <gsl/gsl_matrix.h>
+#include <gsl/gsl_sort.h>
+#include <gsl/gsl_statistics.h>
+#include "utility.h"
+#include "pcg_basic.h"
+#include "cluster.h"
+#include "fitness.h"
+#include "operators.h"
+#include "selection.h"
+#include "synth.h"
+
+// Number of untimed calls before measuring and the minimum time of a repetition
+#define WARMUP      3
+#define MIN_REP_NS  1000000.0
+
+
+int DEBUG, VERBOSE;
+
+/**
+ * @struct kernel_ctx
+ * @brief The inputs shared by all of the kernels under measurement
+ */
+typedef struct
+{
+    gsl_matrix *data;           /**< The synthetic dataset */
+    gsl_matrix *bounds;         /**< The min/max bounds of the dataset */
+    gsl_matrix *centroids;      /**< Centroids of a single chromosome */
+    gsl_matrix *parent1;        /**< First parent for the GA operators */
+    gsl_matrix *parent2;        /**< Second parent for the GA operators */
+    match_scratch *match;       /**< Scratch to match the centroids of the parents */
+    gsl_matrix **clusters;      /**< The clusters for the centroids */
+    uint32_t *labels;           /**< Cluster assignment of each row */
+    uint32_t *counts;           /**< Number of rows in each cluster */
+    double *sums;               /**< Sum of the rows in each cluster */
+    kd_tree *tree;              /**< The kd-tree of the dataset */
+    double *population;         /**< A single chromosome for one batch Lloyd's iteration */
+    uint32_t *order;            /**< The dimensions by decreasing variance */
+    int size;                   /**< The size of the population */
+    double *fitness;            /**< Fitness of the population */
+    double *probability;        /**< Roulette wheel probabilities of the population */
+    double *weight;             /**< Selection weights of the population */
+    double *accept;             /**< Acceptance probabilities of the alias table */
+    int *alias;                 /**< Aliases of the alias table */
+    int *parents;               /**< Parents selected from the population */
+    pcg32_random_t rng;         /**< The random number generator */
+} kernel_ctx;
+
+typedef void (*kernel_fn)(kernel_ctx *ctx);
+
+
+static void kernel_assign(kernel_ctx *ctx)
+{
+    assign_clusters(ctx->data, ctx->centroids, ctx->labels, ctx->counts);
+}
+
+static void kernel_assign_kd(kernel_ctx *ctx)
+{
+    kd_assign(ctx->tree, ctx->data, ctx->centroids, ctx->sums, ctx->counts, NULL);
+}
+
+static void kernel_nearest(kernel_ctx *ctx)
+{
+    nearest_centroids(ctx->data, ctx->centroids, ctx->labels, NULL, 1);
+}
+
+static void kernel_batch(kernel_ctx *ctx)
+{
+    lloyd_budget step = {1, 0, 0};
+    memcpy(ctx->population, ctx->centroids->data, 
+           ctx->centroids->size1 * ctx->data->size2 * sizeof(double));
+    lloyd_population(ctx->data, ctx->population, 0, 1, ctx->centroids->size1, 
+                     256 * 1024 / (ctx->data->size2 * sizeof(double)), 1, NULL, &step,
+                     NULL, NULL, NULL, NULL, NULL);
+}
+
+static void kernel_batch_pds(kernel_ctx *ctx)
+{
+    lloyd_budget step = {1, 0, 0};
+    memcpy(ctx->population, ctx->centroids->data, 
+           ctx->centroids->size1 * ctx->data->size2 * sizeof(double));
+    lloyd_population(ctx->data, ctx->population, 0, 1, ctx->centroids->size1, 
+                     256 * 1024 / (ctx->data->size2 * sizeof(double)), 1, NULL, &step,
+                     NULL, NULL, NULL, ctx->order, NULL);
+}
+
+static void kernel_centroids(kernel_ctx *ctx)
+{
+    calc_centroids(ctx->centroids, ctx->data, ctx->centroids->size1, ctx->clusters);
+}
+
+static void kernel_dunn(kernel_ctx *ctx)
+{
+    dunn_index(ctx->centroids, ctx->centroids->size1, ctx->clusters);
+}
+
+static void kernel_crossover(kernel_ctx *ctx)
+{
+    crossover(ctx->parent1, ctx->parent2, &ctx->rng);
+}
+
+static void kernel_crossover_aligned(kernel_ctx *ctx)
+{
+    crossover_aligned(ctx->parent1, ctx->parent2, ctx->match, &ctx->rng);
+}
+
+static void kernel_crossover_uniform(kernel_ctx *ctx)
+{
+    crossover_uniform(ctx->parent1, ctx->parent2, ctx->match, &ctx->rng);
+}
+
+static void kernel_mutate(kernel_ctx *ctx)
+{
+    mutate(ctx->parent1, ctx->bounds, &ctx->rng);
+}
+
+static void kernel_select(kernel_ctx *ctx)
+{
+    gen_probability(ctx->size, ctx->fitness, ctx->probability);
+    for (int i = 0; i < ctx->size; ++i)
+    {
+        ctx->parents[i] = select_parent(ctx->size, ctx->probability, &ctx->rng);
+    }
+}
+
+static void kernel_alias(kernel_ctx *ctx)
+{
+    gen_weights(ctx->size, ctx->fitness, ctx->weight);
+    gen_alias(ctx->size, ctx->weight, ctx->accept, ctx->alias);
+    for (int i = 0; i < ctx->size; ++i)
+    {
+        ctx->parents[i] = select_alias(ctx->size, ctx->accept, ctx->alias, &ctx->rng);
+    }
+}
+
+static void kernel_sus(kernel_ctx *ctx)
+{
+    gen_probability(ctx->size, ctx->fitness, ctx->probability);
+    select_sus(ctx->size, ctx->probability, ctx->size, ctx->parents, &ctx->rng);
+}
+
+static void kernel_tournament(kernel_ctx *ctx)
+{
+    for (int i = 0; i < ctx->size; ++i)
+    {
+        ctx->parents[i] = select_tournament(ctx->size, ctx->fitness, 2, &ctx->rng);
+    }
+}
+
+static void kernel_rank(kernel_ctx *ctx)
+{
+    gen_rank(ctx->size, ctx->fitness, ctx->weight);
+    gen_alias(ctx->size, ctx->weight, ctx->accept, ctx->alias);
+    for (int i = 0; i < ctx->size; ++i)
+    {
+        ctx->parents[i] = select_alias(ctx->size, ctx->accept, ctx->alias, &ctx->rng);
+    }
+}
+
+
+/**
+ * Returns the elapsed time in nanoseconds between two timestamps.
+ */
+static double elapsed_ns(struct timespec *start, struct timespec *end)
+{
+    return (end->tv_sec - start->tv_sec) * 1e9 + (end->tv_nsec - start->tv_nsec);
+}
+
+
+/**
+ * Measures a kernel and prints the median and 95th percentile time per call,
+ * the time per element and the throughput over the bytes of its input. Calls
+ * are batched so each repetition runs long enough for the clock resolution.
+ *
+ * @param name     The name of the kernel
+ * @param fn       The kernel to measure
+ * @param ctx      Pointer to the inputs of the kernel
+ * @param reps     The number of timed repetitions
+ * @param elements The number of elements processed by each call
+ * @param bytes    The number of bytes of input read by each call
+ */
+static void measure(char *name, kernel_fn fn, kernel_ctx *ctx, int reps,
+                    double elements, double bytes)
+{
+    uint64_t batch = 1;
+    double times[reps],
+           median = 0,
+           p95 = 0;
+    struct timespec start, end;
+
+    for (int i = 0; i < WARMUP; ++i)
+    {
+        fn(ctx);
+    }
+
+    // Calibrate the number of calls in each repetition
+    for (;;)
+    {
+        clock_gettime(CLOCK_MONOTONIC, &start);
+        for (uint64_t b = 0; b < batch; ++b)
+            fn(ctx);
+        clock_gettime(CLOCK_MONOTONIC, &end);
+
+        if (elapsed_ns(&start, &end) >= MIN_REP_NS)
+            break;
+        batch *= 2;
+    }
+
+    for (int r = 0; r < reps; ++r)
+    {
+        clock_gettime(CLOCK_MONOTONIC, &start);
+        for (uint64_t b = 0; b < batch; ++b)
+            fn(ctx);
+        clock_gettime(CLOCK_MONOTONIC, &end);
+        times[r] = elapsed_ns(&start, &end) / batch;
+    }
+    gsl_sort(times, 1, reps);
+    median = gsl_stats_median_from_sorted_data(times, 1, reps);
+    p95 = gsl_stats_quantile_from_sorted_data(times, 1, reps, 0.95);
+
+    printf("%-16s %16.1f %16.1f %14.3f %10.3f\n", name, median, p95,
+           median / elements, bytes / median);
+}
+
+
+/**
+ * Prints the model name of the CPU so that results can be compared across CPUs.
+ */
+static void print_cpu(void)
+{
+    char line[256];
+    FILE *ifp;
+
+    if ((ifp = fopen("/proc/cpuinfo", "r")) == NULL)
+    {
+        return;
+    }
+    while (fgets(line, sizeof(line), ifp) != NULL)
+    {
+        if (strncmp(line, "model name", 10) == 0)
+        {
+            printf(CYAN "CPU %s" RESET, strchr(line, ':') + 2);
+            break;
+        }
+    }
+    fclose(ifp);
+}
+
+
+/**
+ * Benchmarks each of the hot kernels in isolation on a synthetic dataset.
+ *
+ * @param rows The number of rows of data
+ * @param cols The number of columns of data
+ * @param k    The number of clusters
+ * @param size The size of the population for selection
+ * @param reps The number of timed repetitions
+ *
+ * @return     Status code, 0 for SUCCESS, 1 for ERROR
+ */
+int microbench(uint32_t rows, uint32_t cols, uint32_t k, int size, int reps)
+{
+    int status = SUCCESS;
+    double pairs = 0,
+           cluster_bytes = 0;
+    kernel_ctx ctx;
+
+    memset(&ctx, 0, sizeof(ctx));
+    pcg32_srandom_r(&ctx.rng, 42u, 54u);
+
+    ctx.data = gsl_matrix_alloc(rows, cols);
+    ctx.bounds = gsl_matrix_alloc(cols, 2);
+    ctx.centroids = gsl_matrix_alloc(k, cols);
+    ctx.parent1 = gsl_matrix_alloc(k, cols);
+    ctx.parent2 = gsl_matrix_alloc(k, cols);
+    ctx.match = match_alloc(k);
+    ctx.clusters = (gsl_matrix **)calloc(k, sizeof(gsl_matrix *));
+    ctx.labels = (uint32_t *)malloc(rows * sizeof(uint32_t));
+    ctx.counts = (uint32_t *)calloc(k, sizeof(uint32_t));
+    ctx.sums = (double *)calloc((size_t)k * cols, sizeof(double));
+    ctx.population = (double *)malloc((size_t)k * cols * sizeof(double));
+    ctx.order = (uint32_t *)malloc(cols * sizeof(uint32_t));
+    ctx.size = size;
+    ctx.fitness = (double *)malloc(size * sizeof(double));
+    ctx.probability = (double *)malloc(size * sizeof(double));
+    ctx.weight = (double *)malloc(size * sizeof(double));
+    ctx.accept = (double *)malloc(size * sizeof(double));
+    ctx.alias = (int *)malloc(size * sizeof(int));
+    ctx.parents = (int *)malloc(size * sizeof(int));
+
+    if (ctx.match == NULL || (status = synth_fill(ctx.data, k, 5.0, 42u)) != SUCCESS)
+    {
+        status = ERROR;
+        goto free;
+    }
+    calc_bounds(ctx.data, ctx.bounds);
+    calc_dim_order(ctx.data, ctx.order);
+    if ((ctx.tree = kd_build(ctx.data, NULL)) == NULL)
+    {
+        status = ERROR;
+        goto free;
+    }
+    random_centroids(ctx.centroids, ctx.bounds, &ctx.rng);
+    random_centroids(ctx.parent1, ctx.bounds, &ctx.rng);
+    random_centroids(ctx.parent2, ctx.bounds, &ctx.rng);
+
+    // Build the clusters for the centroids, as done by each Lloyd's iteration
+    assign_clusters(ctx.data, ctx.centroids, ctx.labels, ctx.counts);
+    for (uint32_t n = 0; n < k; ++n)
+    {
+        if (ctx.counts[n] > 0)
+            ctx.clusters[n] = gsl_matrix_alloc(ctx.counts[n], cols);
+        pairs += (double)ctx.counts[n] * (ctx.counts[n] - 1);
+        cluster_bytes += (double)ctx.counts[n] * cols * sizeof(double);
+        ctx.counts[n] = 0;
+    }
+    for (uint32_t i = 0; i < rows; ++i)
+    {
+        uint32_t n = ctx.labels[i];
+        gsl_vector_view data_row = gsl_matrix_row(ctx.data, i);
+        gsl_vector_view clust_row = gsl_matrix_row(ctx.clusters[n], ctx.counts[n]++);
+        gsl_vector_memcpy(&clust_row.vector, &data_row.vector);
+    }
+    pairs += (double)k * (k - 1);
+
+    // A population of random fitness for the selection kernels
+    for (int i = 0; i < size; ++i)
+    {
+        ctx.fitness[i] = ldexp(pcg32_random_r(&ctx.rng), -32);
+    }
+
+    print_cpu();
+    printf(CYAN "ROWS: %u, COLS: %u, K: %u, SIZE: %d, REPS: %d\n" RESET,
+           rows, cols, k, size, reps);
+    printf("%-16s %16s %16s %14s %10s\n", "KERNEL", "MEDIAN (ns)", "P95 (ns)",
+           "ns/element", "GB/s");
+
+    measure("assign", kernel_assign, &ctx, reps, (double)rows * k,
+            ((double)rows * cols + (double)k * cols) * sizeof(double));
+    measure("assign_kdtree", kernel_assign_kd, &ctx, reps, (double)rows * k,
+            ((double)rows * cols + (double)k * cols) * sizeof(double));
+    measure("nearest", kernel_nearest, &ctx, reps, (double)rows * k,
+            ((double)rows * cols + (double)k * cols) * sizeof(double));
+    measure("lloyd_batch", kernel_batch, &ctx, reps, (double)rows * k,
+            ((double)rows * cols + (double)k * cols) * sizeof(double));
+    measure("lloyd_batch_pds", kernel_batch_pds, &ctx, reps, (double)rows * k,
+            ((double)rows * cols + (double)k * cols) * sizeof(double));
+    measure("calc_centroids", kernel_centroids, &ctx, reps, rows, cluster_bytes);
+    measure("dunn_index", kernel_dunn, &ctx, reps, pairs, cluster_bytes);
+    measure("crossover", kernel_crossover, &ctx, reps, (double)k * cols,
+            2.0 * k * cols * sizeof(double));
+    measure("crossover_align", kernel_crossover_aligned, &ctx, reps, (double)k * cols,
+            2.0 * k * cols * sizeof(double));
+    measure("crossover_unif", kernel_crossover_uniform, &ctx, reps, (double)k * cols,
+            2.0 * k * cols * sizeof(double));
+    measure("mutate", kernel_mutate, &ctx, reps, 1, sizeof(double));
+    measure("select_parent", kernel_select, &ctx, reps, size,
+            (double)size * sizeof(double));
+    measure("select_alias", kernel_alias, &ctx, reps, size,
+            (double)size * sizeof(double));
+    measure("select_sus", kernel_sus, &ctx, reps, size,
+            (double)size * sizeof(double));
+    measure("select_tourn", kernel_tournament, &ctx, reps, size,
+            (double)size * sizeof(double));
+    measure("select_rank", kernel_rank, &ctx, reps, size,
+            (double)size * sizeof(double));
+
+free:
+    for (uint32_t n = 0; n < k; ++n)
+    {
+        gsl_matrix_free(ctx.clusters[n]);
+    }
+    free(ctx.clusters);
+    match_free(ctx.match);
+    free(ctx.labels);
+    free(ctx.counts);
+    free(ctx.sums);
+    free(ctx.population);
+    free(ctx.order);
+    kd_free(ctx.tree);
+    free(ctx.fitness);
+    free(ctx.probability);
+    free(ctx.weight);
+    free(ctx.accept);
+    free(ctx.alias);
+    free(ctx.parents);
+    gsl_matrix_free(ctx.data);
+    gsl_matrix_free(ctx.bounds);
+    gsl_matrix_free(ctx.centroids);
+    gsl_matrix_free(ctx.parent1);
+    gsl_matrix_free(ctx.parent2);
+
+    return status;
+}
+
+
+int main(int argc, char *argv[])
+{
+    uint32_t rows = 10000,
+             cols = 4,
+             k = 8;
+    int size = 1000,
+        reps = 25;
+
+    if (argc > 6)
+    {
+        fprintf(stderr, RED "Incorrect parameters!\n" RESET);
+        fprintf(stderr, RED "Correct usage:\n" RESET);
+        fprintf(stderr, RED "%s <ROWS> (DEFAULT 10000) <COLS> (DEFAULT 4) <K> (DEFAULT 8) "
+                "<SIZE> (DEFAULT 1000) <REPS> (DEFAULT 25)\n\n" RESET, argv[0]);
+        exit(ERROR);
+    }
+    if (argc > 1)
+        rows = (uint32_t)strtoul(argv[1], NULL, 10);
+    if (argc > 2)
+        cols = (uint32_t)strtoul(argv[2], NULL, 10);
+    if (argc > 3)
+        k = (uint32_t)strtoul(argv[3], NULL, 10);
+    if (argc > 4)
+        size = atoi(argv[4]);
+    if (argc > 5)
+        reps = atoi(argv[5]);
+
+    if (k < 2 || rows < k || cols < 1 || size < 2 || reps < 1)
+    {
+        fprintf(stderr, RED "Require K >= 2, ROWS >= K, COLS >= 1, SIZE >= 2 and REPS >= 1!\n" RESET);
+        exit(ERROR);
+    }
+
+    exit(microbench(rows, cols, k, size, reps));
+}
@@ -0,0 +1,154 @@
+/*
+ * Evolutionary K-means clustering (E-means) using Genetic Algorithms.
+ *
+ * Copyright (C) 2015, Jonathan Gillett
+ * All rights reserved.
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+#include <stdio.h>
+#include <stdlib.h>
+#include <stdint.h>
+#include <string.h>
+#include <float.h>
+#include <gsl/gsl_matrix.h>
+#include "utility.h"
+#include "pcg_basic.h"
+#include "online.h"
+
+
+online_model *online_create(uint32_t n_clusters, uint32_t cols, double decay,
+                            uint32_t reservoir, uint64_t seed)
+{
+    online_model *model = (online_model *)calloc(1, sizeof(online_model));
+
+    if (model == NULL)
+    {
+        fprintf(stderr, RED "Unable to allocate the online model!\n" RESET);
+        return NULL;
+    }
+    model->centroids = gsl_matrix_alloc(n_clusters, cols);
+    model->counts = (double *)calloc(n_clusters, sizeof(double));
+    model->reservoir = gsl_matrix_alloc(reservoir, cols);
+    model->decay = decay;
+    if (model->centroids == NULL || model->counts == NULL || model->reservoir == NULL)
+    {
+        fprintf(stderr, RED "Unable to allocate the online model!\n" RESET);
+        online_free(model);
+        return NULL;
+    }
+    pcg32_srandom_r(&model->rng, seed, 54u);
+
+    return model;
+}
+
+
+uint32_t online_update(online_model *model, const double *row)
+{
+    uint32_t cols = model->centroids->size2,
+             n_clusters = model->centroids->size1,
+             k = 0;
+    double min_dist = DBL_MAX,
+           rate = 0;
+    double *cent = NULL;
+
+    // Offer the row to the reservoir, replacing a random row once full
+    ++model->seen;
+    if (model->filled < model->reservoir->size1)
+    {
+        memcpy(gsl_matrix_ptr(model->reservoir, model->filled++, 0), row, cols * sizeof(double));
+    }
+    else
+    {
+        uint64_t r = (((uint64_t)pcg32_random_r(&model->rng) << 32) 
+                      | pcg32_random_r(&model->rng)) % model->seen;
+        if (r < model->reservoir->size1)
+            memcpy(gsl_matrix_ptr(model->reservoir, r, 0), row, cols * sizeof(double));
+    }
+
+    // Find the nearest centroid, ties go to the last as in assign_clusters()
+    for (uint32_t n = 0; n < model->n_init; ++n)
+    {
+        const double *c = gsl_matrix_const_ptr(model->centroids, n, 0);
+        double dist = 0;
+
+        for (uint32_t j = 0; j < cols; ++j)
+        {
+            double diff = row[j] - c[j];
+            dist += diff * diff;
+        }
+        if (dist <= min_dist)
+        {
+            min_dist = dist;
+            k = n;
+        }
+    }
+
+    // A distinct row initializes the next centroid until all are initialized
+    if (model->n_init < n_clusters && (model->n_init == 0 || min_dist > 0))
+    {
+        k = model->n_init++;
+        memcpy(gsl_matrix_ptr(model->centroids, k, 0), row, cols * sizeof(double));
+        model->counts[k] = 1;
+        return k;
+    }
+
+    model->counts[k] = model->decay * model->counts[k] + 1;
+    rate = 1.0 / model->counts[k];
+    cent = gsl_matrix_ptr(model->centroids, k, 0);
+    for (uint32_t j = 0; j < cols; ++j)
+        cent[j] += rate * (row[j] - cent[j]);
+
+    return k;
+}
+
+
+int online_replace(online_model *model, gsl_matrix *centroids, const double *counts)
+{
+    uint32_t n_clusters = centroids->size1;
+
+    if (n_clusters != model->centroids->size1)
+    {
+        gsl_matrix *resized = gsl_matrix_alloc(n_clusters, centroids->size2);
+        double *recounts = (double *)malloc(n_clusters * sizeof(double));
+
+        if (resized == NULL || recounts == NULL)
+        {
+            fprintf(stderr, RED "Unable to resize the online model!\n" RESET);
+            gsl_matrix_free(resized);
+            free(recounts);
+            return ERROR;
+        }
+        gsl_matrix_free(model->centroids);
+        free(model->counts);
+        model->centroids = resized;
+        model->counts = recounts;
+    }
+    gsl_matrix_memcpy(model->centroids, centroids);
+    memcpy(model->counts, counts, n_clusters * sizeof(double));
+    model->n_init = n_clusters;
+
+    return SUCCESS;
+}
+
+
+void online_free(online_model *model)
+{
+    if (model == NULL)
+        return;
+    gsl_matrix_free(model->centroids);
+    gsl_matrix_free(model->reservoir);
+    free(model->counts);
+    free(model);
+}
@@ -28,6 +28,7 @@
 #include <gsl/gsl_blas.h>
 #include <gsl/gsl_statistics.h>
 #include "utility.h"
+#include "cluster.h"
 #include "fitness.h"
 #include "operators.h"
 
@@ -37,7 +38,6 @@ void crossover(gsl_matrix *parent1, gsl_matrix *parent2, pcg32_random_t *rng)
              cols = parent1->size2;
     uint32_t cut = (uint32_t)pcg32_boundedrand_r(rng, rows-1) + 1;
     bool left = (bool)pcg32_boundedrand_r(rng, 2);
-    gsl_matrix *temp = gsl_matrix_alloc(1, cols);
 
     if (DEBUG == DEBUG_CROSSOVER)
     {
@@ -71,10 +71,7 @@ void crossover(gsl_matrix *parent1, gsl_matrix *parent2, pcg32_random_t *rng)
         {
             gsl_vector_view parent1_row = gsl_matrix_row(parent1, i);
             gsl_vector_view parent2_row = gsl_matrix_row(parent2, i);
-            gsl_vector_view temp_row = gsl_matrix_row(temp, 0);
-            gsl_vector_memcpy(&temp_row.vector, &parent2_row.vector);
-            gsl_vector_memcpy(&parent2_row.vector, &parent1_row.vector);
-            gsl_vector_memcpy(&parent1_row.vector, &temp_row.vector);
+            gsl_vector_swap(&parent1_row.vector, &parent2_row.vector);
         }
     }
     else
@@ -84,10 +81,7 @@ void crossover(gsl_matrix *parent1, gsl_matrix *parent2, pcg32_random_t *rng)
         {
             gsl_vector_view parent1_row = gsl_matrix_row(parent1, i);
             gsl_vector_view parent2_row = gsl_matrix_row(parent2, i);
-            gsl_vector_view temp_row = gsl_matrix_row(temp, 0);
-            gsl_vector_memcpy(&temp_row.vector, &parent2_row.vector);
-            gsl_vector_memcpy(&parent2_row.vector, &parent1_row.vector);
-            gsl_vector_memcpy(&parent1_row.vector, &temp_row.vector);
+            gsl_vector_swap(&parent1_row.vector, &parent2_row.vector);
         }
     }
 
@@ -115,8 +109,149 @@ void crossover(gsl_matrix *parent1, gsl_matrix *parent2, pcg32_random_t *rng)
             printf("\n");
         }
     }
+}
+
+
+void align_centroids(gsl_matrix *parent1, gsl_matrix *parent2, match_scratch *scratch)
+{
+    uint32_t rows = parent1->size1;
+    uint32_t *map = scratch->map;
+
+    // Move each centroid of the second parent to the row of its match, each
+    // swap places at least one centroid in its final row
+    match_centroids(parent2, parent1, map, scratch);
+    for (uint32_t i = 0; i < rows; ++i)
+    {
+        while (map[i] != i)
+        {
+            uint32_t j = map[i];
+            gsl_matrix_swap_rows(parent2, i, j);
+            map[i] = map[j];
+            map[j] = j;
+        }
+    }
+}
+
 
-    gsl_matrix_free(temp);
+void crossover_aligned(gsl_matrix *parent1, gsl_matrix *parent2, match_scratch *scratch,
+                       pcg32_random_t *rng)
+{
+    align_centroids(parent1, parent2, scratch);
+    crossover(parent1, parent2, rng);
+}
+
+
+void crossover_uniform(gsl_matrix *parent1, gsl_matrix *parent2, match_scratch *scratch,
+                       pcg32_random_t *rng)
+{
+    uint32_t rows = parent1->size1,
+             cols = parent1->size2,
+             mask = 0;
+
+    align_centroids(parent1, parent2, scratch);
+
+    // Swap each pair of matched centroids with even odds
+    for (uint32_t i = 0; i < rows; ++i)
+    {
+        if (i % 32 == 0)
+            mask = pcg32_random_r(rng);
+        if (mask & 1)
+        {
+            gsl_vector_view parent1_row = gsl_matrix_row(parent1, i);
+            gsl_vector_view parent2_row = gsl_matrix_row(parent2, i);
+            gsl_vector_swap(&parent1_row.vector, &parent2_row.vector);
+        }
+        mask >>= 1;
+    }
+
+    if (DEBUG == DEBUG_CROSSOVER)
+    {
+        printf(YELLOW "UNIFORM CROSSOVER CENTROIDS AFTER\n" RESET);
+        printf(YELLOW "PARENT[1]:\n" RESET);
+        for (uint32_t i = 0; i < rows; ++i)
+        {
+            for (uint32_t j = 0; j < cols; ++j)
+            {
+                printf(YELLOW "%10.6f " RESET, gsl_matrix_get(parent1, i, j));
+            }
+            printf("\n");
+        }
+        printf(YELLOW "PARENT[2]:\n" RESET);
+        for (uint32_t i = 0; i < rows; ++i)
+        {
+            for (uint32_t j = 0; j < cols; ++j)
+            {
+                printf(YELLOW "%10.6f " RESET, gsl_matrix_get(parent2, i, j));
+            }
+            printf("\n");
+        }
+    }
+}
+
+
+void crossover_variable(gsl_matrix *parent1, gsl_matrix *parent2, uint32_t k_min,
+                        uint32_t k_max, pcg32_random_t *rng)
+{
+    uint32_t k1 = parent1->size1,
+             k2 = parent2->size1,
+             cols = parent1->size2,
+             cut1 = 0,
+             cut2 = 0;
+    size_t tda1 = parent1->tda,
+           tda2 = parent2->tda;
+
+    // Draw cuts until both children are within the range, the cuts at the
+    // start of both parents always are
+    for (int attempt = 0; attempt < 8; ++attempt)
+    {
+        uint32_t a = (uint32_t)pcg32_boundedrand_r(rng, k1 + 1),
+                 b = (uint32_t)pcg32_boundedrand_r(rng, k2 + 1);
+
+        if (a + k2 - b >= k_min && a + k2 - b <= k_max 
+            && b + k1 - a >= k_min && b + k1 - a <= k_max)
+        {
+            cut1 = a;
+            cut2 = b;
+            break;
+        }
+    }
+
+    // Swap the overlapping rows of the tails, then move the excess rows of
+    // the longer tail to the other child
+    uint32_t tail1 = k1 - cut1,
+             tail2 = k2 - cut2,
+             common = tail1 < tail2 ? tail1 : tail2;
+    for (uint32_t i = 0; i < common; ++i)
+    {
+        double *row1 = parent1->data + (cut1 + i) * tda1,
+               *row2 = parent2->data + (cut2 + i) * tda2;
+
+        for (uint32_t j = 0; j < cols; ++j)
+        {
+            double temp = row1[j];
+            row1[j] = row2[j];
+            row2[j] = temp;
+        }
+    }
+    for (uint32_t i = common; i < tail2; ++i)
+    {
+        memcpy(parent1->data + (cut1 + i) * tda1, parent2->data + (cut2 + i) * tda2,
+               cols * sizeof(double));
+    }
+    for (uint32_t i = common; i < tail1; ++i)
+    {
+        memcpy(parent2->data + (cut2 + i) * tda2, parent1->data + (cut1 + i) * tda1,
+               cols * sizeof(double));
+    }
+    parent1->size1 = cut1 + tail2;
+    parent2->size1 = cut2 + tail1;
+
+    if (DEBUG == DEBUG_CROSSOVER)
+    {
+        printf(YELLOW "VARIABLE CROSSOVER CUTS: %d, %d\n" RESET, cut1, cut2);
+        printf(YELLOW "CENTROIDS BEFORE: %d, %d, AFTER: %d, %d\n" RESET, k1, k2,
+               (int)parent1->size1, (int)parent2->size1);
+    }
 }
 
 
@@ -152,3 +287,69 @@ void mutate(gsl_matrix *chromosome, gsl_matrix *bounds, pcg32_random_t *rng)
         }
     }
 }
+
+
+void mutate_resample(gsl_matrix *chromosome, gsl_matrix *data, pcg32_random_t *rng)
+{
+    uint32_t rows = chromosome->size1,
+             cols = chromosome->size2,
+             row;
+
+    // Select a random centroid and draw its replacement from the data
+    row = (uint32_t)pcg32_boundedrand_r(rng, rows);
+    resample_centroid(chromosome, row, data, rng);
+
+    if (DEBUG == DEBUG_MUTATE)
+    {
+        printf(YELLOW "RESAMPLED CHROMSOME\n" RESET);
+        printf(YELLOW "ROW: %d\n" RESET, row);
+        for (uint32_t i = 0; i < rows; ++i)
+        {
+            for (uint32_t j = 0; j < cols; ++j)
+            {
+                printf(YELLOW "%10.6f " RESET, gsl_matrix_get(chromosome, i, j));
+            }
+            printf("\n");
+        }
+    }
+}
+
+
+void mutate_k(gsl_matrix *chromosome, gsl_matrix *data, uint32_t k_min, uint32_t k_max,
+              pcg32_random_t *rng)
+{
+    uint32_t rows = chromosome->size1,
+             cols = chromosome->size2;
+    bool grow = (bool)pcg32_boundedrand_r(rng, 2);
+
+    if (rows >= k_max)
+        grow = false;
+    else if (rows <= k_min)
+        grow = true;
+    if (rows == k_min && rows == k_max)
+        return;
+
+    if (grow)
+    {
+        // Add a centroid drawn from the data as in k-means++
+        chromosome->size1 = rows + 1;
+        resample_centroid(chromosome, rows, data, rng);
+    }
+    else
+    {
+        // Remove a random centroid, moving the last centroid into its row
+        uint32_t row = (uint32_t)pcg32_boundedrand_r(rng, rows);
+        if (row != rows - 1)
+        {
+            memcpy(chromosome->data + row * chromosome->tda, 
+                   chromosome->data + (rows - 1) * chromosome->tda, cols * sizeof(double));
+        }
+        chromosome->size1 = rows - 1;
+    }
+
+    if (DEBUG == DEBUG_MUTATE)
+    {
+        printf(YELLOW "%s CENTROID, CENTROIDS: %d\n" RESET, grow ? "ADDED" : "REMOVED",
+               (int)chromosome->size1);
+    }
+}
@@ -0,0 +1,302 @@
+/*
+ * Evolutionary K-means clustering (E-means) using Genetic Algorithms.
+ *
+ * Copyright (C) 2015, Jonathan Gillett
+ * All rights reserved.
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+#include <stdio.h>
+#include <stdlib.h>
+#include <stdint.h>
+#include <string.h>
+#include <math.h>
+#include <omp.h>
+#include <gsl/gsl_matrix.h>
+#include <gsl/gsl_blas.h>
+#include "utility.h"
+#include "pcg_basic.h"
+#include "cluster.h"
+#include "fitness.h"
+#include "reduce.h"
+#include "stats.h"
+
+// LAPACK eigenvalues and eigenvectors of a real symmetric matrix
+extern void dsyevr_(char *jobz, char *range, char *uplo, int *n, double *a, int *lda,
+                    double *vl, double *vu, int *il, int *iu, double *abstol, int *m,
+                    double *w, double *z, int *ldz, int *isuppz, double *work, int *lwork,
+                    int *iwork, int *liwork, int *info);
+
+
+int random_projection(gsl_matrix *data, gsl_matrix *reduced, int threads, pcg32_random_t *rng)
+{
+    uint32_t rows = data->size1,
+             cols = data->size2,
+             dims = reduced->size2,
+             nnz = 0;
+    double scale = sqrt(3.0 / dims);
+    uint32_t *start = (uint32_t *)calloc(cols + 1, sizeof(uint32_t)),
+             *out = (uint32_t *)malloc((size_t)cols * dims * sizeof(uint32_t));
+    double *sign = (double *)malloc((size_t)cols * dims * sizeof(double));
+
+    if (start == NULL || out == NULL || sign == NULL)
+    {
+        fprintf(stderr, RED "Unable to allocate the random projection!\n" RESET);
+        free(start);
+        free(out);
+        free(sign);
+        return ERROR;
+    }
+    stats_add(STAT_ALLOCATIONS, 3);
+
+    // Draw the non-zero entries of the projection for each column
+    for (uint32_t j = 0; j < cols; ++j)
+    {
+        start[j] = nnz;
+        for (uint32_t o = 0; o < dims; ++o)
+        {
+            uint32_t r = pcg32_boundedrand_r(rng, 6);
+            if (r > 1)
+                continue;
+            out[nnz] = o;
+            sign[nnz] = r == 0 ? scale : -scale;
+            ++nnz;
+        }
+    }
+    start[cols] = nnz;
+
+    threads = threads > 0 ? threads : omp_get_max_threads();
+    #pragma omp parallel for schedule(static) num_threads(threads)
+    for (uint32_t i = 0; i < rows; ++i)
+    {
+        const double *row = gsl_matrix_const_ptr(data, i, 0);
+        double *proj = gsl_matrix_ptr(reduced, i, 0);
+
+        memset(proj, 0, dims * sizeof(double));
+        for (uint32_t j = 0; j < cols; ++j)
+        {
+            for (uint32_t e = start[j]; e < start[j + 1]; ++e)
+                proj[out[e]] += sign[e] * row[j];
+        }
+    }
+    if (VERBOSE == 1)
+        printf(CYAN "Random projection from %u to %u dimensions, %u non-zeros\n" RESET, 
+               cols, dims, nnz);
+
+    free(start);
+    free(out);
+    free(sign);
+
+    return SUCCESS;
+}
+
+
+/**
+ * Copies a block of rows of the data centred on the mean of each column.
+ *
+ * @param data  Pointer to matrix containing the data
+ * @param mean  The mean of each column
+ * @param first The first row of the block
+ * @param block Pointer to matrix for the centred rows, the rows of the block
+ *              are resized to the rows copied
+ */
+static void centre_block(gsl_matrix *data, const double *mean, uint32_t first, gsl_matrix *block)
+{
+    uint32_t cols = data->size2,
+             len = data->size1 - first < REDUCE_BLOCK ? data->size1 - first : REDUCE_BLOCK;
+
+    block->size1 = len;
+    for (uint32_t i = 0; i < len; ++i)
+    {
+        for (uint32_t j = 0; j < cols; ++j)
+            gsl_matrix_set(block, i, j, gsl_matrix_get(data, first + i, j) - mean[j]);
+    }
+}
+
+
+int pca_projection(gsl_matrix *data, gsl_matrix *reduced)
+{
+    int status = SUCCESS,
+        n = (int)data->size2,
+        il = (int)(data->size2 - reduced->size2 + 1),
+        iu = n,
+        m = 0,
+        lwork = -1,
+        liwork = -1,
+        info = 0,
+        iwork_size = 0;
+    uint32_t rows = data->size1,
+             cols = data->size2,
+             dims = reduced->size2;
+    double vl = 0,
+           vu = 0,
+           abstol = 0,
+           work_size = 0;
+    double *mean = (double *)calloc(cols, sizeof(double)),
+           *eigval = (double *)malloc(cols * sizeof(double)),
+           *eigvec = (double *)malloc((size_t)cols * dims * sizeof(double)),
+           *work = NULL;
+    int *isuppz = (int *)malloc(2 * dims * sizeof(int)),
+        *iwork = NULL;
+    gsl_matrix *cov = gsl_matrix_calloc(cols, cols),
+               *block = gsl_matrix_alloc(REDUCE_BLOCK, cols),
+               *components = gsl_matrix_alloc(cols, dims);
+    gsl_matrix_view out;
+
+    if (mean == NULL || eigval == NULL || eigvec == NULL || isuppz == NULL || cov == NULL
+        || block == NULL || components == NULL)
+    {
+        fprintf(stderr, RED "Unable to allocate the principal components!\n" RESET);
+        status = ERROR;
+        goto free;
+    }
+    stats_add(STAT_ALLOCATIONS, 7);
+
+    // The covariance matrix of the centred data, accumulated over blocks of rows
+    for (uint32_t i = 0; i < rows; ++i)
+    {
+        for (uint32_t j = 0; j < cols; ++j)
+            mean[j] += gsl_matrix_get(data, i, j) / rows;
+    }
+    for (uint32_t first = 0; first < rows; first += REDUCE_BLOCK)
+    {
+        centre_block(data, mean, first, block);
+        gsl_blas_dgemm(CblasTrans, CblasNoTrans, 1.0 / (rows - 1), block, block, 1.0, cov);
+    }
+
+    // Query the workspace size then find the largest eigenvalues, in ascending order
+    dsyevr_("V", "I", "U", &n, cov->data, &n, &vl, &vu, &il, &iu, &abstol, &m, eigval,
+            eigvec, &n, isuppz, &work_size, &lwork, &iwork_size, &liwork, &info);
+    lwork = (int)work_size;
+    liwork = iwork_size;
+    work = (double *)malloc(lwork * sizeof(double));
+    iwork = (int *)malloc(liwork * sizeof(int));
+    if (info != 0 || work == NULL || iwork == NULL)
+    {
+        fprintf(stderr, RED "Unable to allocate the LAPACK workspace!\n" RESET);
+        status = ERROR;
+        goto free;
+    }
+    dsyevr_("V", "I", "U", &n, cov->data, &n, &vl, &vu, &il, &iu, &abstol, &m, eigval,
+            eigvec, &n, isuppz, work, &lwork, iwork, &liwork, &info);
+    if (info != 0 || m != (int)dims)
+    {
+        fprintf(stderr, RED "Unable to find the principal components, dsyevr info %d!\n" RESET, info);
+        status = ERROR;
+        goto free;
+    }
+
+    // The eigenvectors are the columns of the column major result, the
+    // component with the largest eigenvalue first
+    for (uint32_t c = 0; c < dims; ++c)
+    {
+        for (uint32_t j = 0; j < cols; ++j)
+            gsl_matrix_set(components, j, c, eigvec[(size_t)(dims - 1 - c) * cols + j]);
+    }
+    if (VERBOSE == 1)
+    {
+        double total = 0,
+               kept = 0;
+        for (uint32_t j = 0; j < cols; ++j)
+            total += gsl_matrix_get(cov, j, j);
+        for (uint32_t c = 0; c < dims; ++c)
+            kept += eigval[c];
+        printf(CYAN "PCA from %u to %u dimensions, %.2f%% of the variance kept\n" RESET, 
+               cols, dims, total > 0 ? 100.0 * kept / total : 0.0);
+    }
+
+    // Project the centred data onto the components
+    for (uint32_t first = 0; first < rows; first += REDUCE_BLOCK)
+    {
+        centre_block(data, mean, first, block);
+        out = gsl_matrix_submatrix(reduced, first, 0, block->size1, dims);
+        gsl_blas_dgemm(CblasNoTrans, CblasNoTrans, 1.0, block, components, 0.0, &out.matrix);
+    }
+
+free:
+    free(mean);
+    free(eigval);
+    free(eigvec);
+    free(isuppz);
+    free(work);
+    free(iwork);
+    gsl_matrix_free(cov);
+    if (block != NULL)
+        block->size1 = REDUCE_BLOCK;
+    gsl_matrix_free(block);
+    gsl_matrix_free(components);
+
+    return status;
+}
+
+
+int refine_clustering(gsl_matrix *data, const uint32_t *labels, gsl_matrix *centroids,
+                      uint32_t *refined, double *fitness, pcg32_random_t *rng,
+                      const uint32_t *weights)
+{
+    int status = SUCCESS;
+    uint32_t rows = data->size1,
+             n_clusters = centroids->size1;
+    uint32_t counts[n_clusters];
+    gsl_matrix **clusters = (gsl_matrix **)calloc(n_clusters, sizeof(gsl_matrix *));
+
+    if (clusters == NULL)
+    {
+        fprintf(stderr, RED "Unable to allocate the refined clusters!\n" RESET);
+        return ERROR;
+    }
+
+    // The means of the clusters in the full space
+    gsl_matrix_set_zero(centroids);
+    memset(counts, 0, n_clusters * sizeof(uint32_t));
+    for (uint32_t i = 0; i < rows; ++i)
+    {
+        uint32_t w = weights != NULL ? weights[i] : 1;
+        gsl_vector_view row = gsl_matrix_row(data, i),
+                        cent = gsl_matrix_row(centroids, labels[i]);
+        gsl_blas_daxpy(w, &row.vector, &cent.vector);
+        counts[labels[i]] += w;
+    }
+    for (uint32_t n = 0; n < n_clusters; ++n)
+    {
+        gsl_vector_view cent = gsl_matrix_row(centroids, n);
+
+        if (counts[n] > 0)
+        {
+            gsl_vector_scale(&cent.vector, 1.0 / counts[n]);
+        }
+        else
+        {
+            gsl_vector_view row = gsl_matrix_row(data, pcg32_boundedrand_r(rng, rows));
+            gsl_vector_memcpy(&cent.vector, &row.vector);
+        }
+    }
+
+    // Lloyd's algorithm in the full space from the means
+    if (lloyd_defined(1, centroids, data, n_clusters, clusters, NULL, NULL, weights) != SUCCESS)
+    {
+        fprintf(stderr, RED "Unable to refine the clustering in the full space!\n" RESET);
+        status = ERROR;
+        goto free;
+    }
+    *fitness = dunn_index(centroids, n_clusters, clusters);
+    assign_clusters(data, centroids, refined, counts);
+
+free:
+    for (uint32_t n = 0; n < n_clusters; ++n)
+        gsl_matrix_free(clusters[n]);
+    free(clusters);
+
+    return status;
+}
@@ -0,0 +1,229 @@
+/*
+ * Evolutionary K-means clustering (E-means) using Genetic Algorithms.
+ *
+ * Copyright (C) 2015, Jonathan Gillett
+ * All rights reserved.
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+#include <stdio.h>
+#include <stdlib.h>
+#include <stdint.h>
+#include <stdbool.h>
+#include <string.h>
+#include <gsl/gsl_matrix.h>
+#include "utility.h"
+#include "cluster.h"
+#include "reorder.h"
+
+/**
+ * @struct morton_key
+ * @brief The Morton code of a row of data
+ */
+typedef struct
+{
+    uint64_t code;              /**< The interleaved bits of the row */
+    uint32_t row;               /**< The row of data */
+} morton_key;
+
+
+/**
+ * Compares the Morton codes of two rows, ties are ordered by row so the sort
+ * is stable.
+ *
+ * @param a Pointer to the first key
+ * @param b Pointer to the second key
+ *
+ * @return  Negative, zero or positive as a is before, equal to or after b
+ */
+static int compare_keys(const void *a, const void *b)
+{
+    const morton_key *ka = (const morton_key *)a,
+                     *kb = (const morton_key *)b;
+
+    if (ka->code != kb->code)
+        return ka->code < kb->code ? -1 : 1;
+    return ka->row < kb->row ? -1 : (ka->row > kb->row);
+}
+
+
+int morton_order(gsl_matrix *data, uint32_t *perm)
+{
+    int status = SUCCESS;
+    uint32_t rows = data->size1,
+             cols = data->size2,
+             dims = cols < 64 ? cols : 64,
+             bits = 64 / dims < MORTON_MAX_BITS ? 64 / dims : MORTON_MAX_BITS;
+    uint32_t *order = (uint32_t *)malloc(cols * sizeof(uint32_t));
+    morton_key *keys = (morton_key *)malloc(rows * sizeof(morton_key));
+    gsl_matrix *bounds = gsl_matrix_alloc(cols, 2);
+
+    if (order == NULL || keys == NULL || bounds == NULL)
+    {
+        fprintf(stderr, RED "Unable to allocate the Morton codes!\n" RESET);
+        status = ERROR;
+        goto free;
+    }
+
+    // Only the dimensions with the largest variance contribute bits to the
+    // code when there are more than 64
+    calc_bounds(data, bounds);
+    if ((status = calc_dim_order(data, order)) != SUCCESS)
+    {
+        goto free;
+    }
+
+    #pragma omp parallel for
+    for (uint32_t i = 0; i < rows; ++i)
+    {
+        uint32_t cells[dims];
+        uint64_t code = 0;
+
+        // Quantize each dimension to a cell of the grid over the bounds
+        for (uint32_t d = 0; d < dims; ++d)
+        {
+            double min = gsl_matrix_get(bounds, order[d], 0),
+                   range = gsl_matrix_get(bounds, order[d], 1) - min,
+                   cell = range > 0 ? (gsl_matrix_get(data, i, order[d]) - min) / range : 0;
+            cells[d] = (uint32_t)(cell * ((1u << bits) - 1) + 0.5);
+        }
+
+        // Interleave the bits from the most significant
+        for (int b = (int)bits - 1; b >= 0; --b)
+        {
+            for (uint32_t d = 0; d < dims; ++d)
+                code = (code << 1) | ((cells[d] >> b) & 1u);
+        }
+        keys[i].code = code;
+        keys[i].row = i;
+    }
+    qsort(keys, rows, sizeof(morton_key), compare_keys);
+
+    for (uint32_t i = 0; i < rows; ++i)
+        perm[i] = keys[i].row;
+
+free:
+    free(order);
+    free(keys);
+    gsl_matrix_free(bounds);
+    return status;
+}
+
+
+int cluster_order(const uint32_t *labels, uint32_t rows, uint32_t *perm)
+{
+    uint32_t n_clusters = 0;
+    uint32_t *offsets = NULL;
+
+    for (uint32_t i = 0; i < rows; ++i)
+    {
+        if (labels[i] + 1 > n_clusters)
+            n_clusters = labels[i] + 1;
+    }
+    if ((offsets = (uint32_t *)calloc(n_clusters + 1, sizeof(uint32_t))) == NULL)
+    {
+        fprintf(stderr, RED "Unable to allocate cluster ordering!\n" RESET);
+        return ERROR;
+    }
+
+    // Counting sort of the rows by cluster
+    for (uint32_t i = 0; i < rows; ++i)
+        offsets[labels[i] + 1] += 1;
+    for (uint32_t n = 0; n < n_clusters; ++n)
+        offsets[n + 1] += offsets[n];
+    for (uint32_t i = 0; i < rows; ++i)
+        perm[offsets[labels[i]]++] = i;
+
+    free(offsets);
+
+    return SUCCESS;
+}
+
+
+int permute_rows(gsl_matrix *data, const uint32_t *perm)
+{
+    uint32_t rows = data->size1,
+             cols = data->size2;
+    bool *done = (bool *)calloc(rows, sizeof(bool));
+    gsl_vector *tmp = gsl_vector_alloc(cols);
+
+    if (done == NULL)
+    {
+        fprintf(stderr, RED "Unable to allocate the row permutation!\n" RESET);
+        gsl_vector_free(tmp);
+        return ERROR;
+    }
+
+    // Follow each cycle of the permutation, holding its first row aside
+    for (uint32_t start = 0; start < rows; ++start)
+    {
+        uint32_t i = start;
+
+        if (done[start] || perm[start] == start)
+            continue;
+
+        gsl_matrix_get_row(tmp, data, start);
+        while (perm[i] != start)
+        {
+            gsl_vector_view dst = gsl_matrix_row(data, i);
+            gsl_matrix_get_row(&dst.vector, data, perm[i]);
+            done[i] = true;
+            i = perm[i];
+        }
+        gsl_matrix_set_row(data, i, tmp);
+        done[i] = true;
+    }
+
+    free(done);
+    gsl_vector_free(tmp);
+
+    return SUCCESS;
+}
+
+
+int permute_index(uint32_t *values, const uint32_t *perm, uint32_t n)
+{
+    uint32_t *copy = (uint32_t *)malloc(n * sizeof(uint32_t));
+
+    if (copy == NULL)
+    {
+        fprintf(stderr, RED "Unable to allocate the index permutation!\n" RESET);
+        return ERROR;
+    }
+    memcpy(copy, values, n * sizeof(uint32_t));
+    for (uint32_t i = 0; i < n; ++i)
+        values[i] = copy[perm[i]];
+    free(copy);
+
+    return SUCCESS;
+}
+
+
+int relabel_index(uint32_t *values, uint32_t n, const uint32_t *perm, uint32_t rows)
+{
+    uint32_t *moved = (uint32_t *)malloc(rows * sizeof(uint32_t));
+
+    if (moved == NULL)
+    {
+        fprintf(stderr, RED "Unable to allocate the index permutation!\n" RESET);
+        return ERROR;
+    }
+    for (uint32_t i = 0; i < rows; ++i)
+        moved[perm[i]] = i;
+    for (uint32_t i = 0; i < n; ++i)
+        values[i] = moved[values[i]];
+    free(moved);
+
+    return SUCCESS;
+}
@@ -22,34 +22,48 @@
 #include <math.h>
 #include <string.h>
 #include <stdbool.h>
+#include <gsl/gsl_sort.h>
 #include "pcg_basic.h"
 #include "utility.h"
 #include "selection.h"
 
-void gen_probability(int size, double fitness[size], double probability[size])
+void gen_weights(int size, double fitness[size], double weight[size])
 {
-    double total = 0;
- 
-    if (VERBOSE == 1)
-        printf(CYAN "Generating probabilities for population...\n" RESET);
-        
-    // Update the total, including the weighting for negative values
+    double total = 0,
+           min = INFINITY;
+
+    // Shift the fitness so the least fit has no weight if any are negative
     for (int i = 0; i < size; ++i)
     {
-        total += fitness[i];
+        if (isfinite(fitness[i]) && fitness[i] < min)
+            min = fitness[i];
     }
+    min = min < 0 ? min : 0;
 
-    // Create probability numberline of weighted fitness values from 0 to 1
     for (int i = 0; i < size; ++i)
     {
-        if (i == 0)
-        {
-            probability[i] = fitness[i] / total;
-        }
-        else
-        {
-            probability[i] = probability[i-1] + (fitness[i] / total);
-        }
+        weight[i] = isfinite(fitness[i]) ? fitness[i] - min : 0;
+        total += weight[i];
+    }
+
+    // Fall back to uniform weights if no chromosome has any fitness
+    for (int i = 0; i < size; ++i)
+    {
+        weight[i] = total > 0 ? weight[i] / total : 1.0 / size;
+    }
+}
+
+
+void gen_probability(int size, double fitness[size], double probability[size])
+{
+    if (VERBOSE == 1)
+        printf(CYAN "Generating probabilities for population...\n" RESET);
+
+    // Create probability numberline of weighted fitness values from 0 to 1
+    gen_weights(size, fitness, probability);
+    for (int i = 1; i < size; ++i)
+    {
+        probability[i] += probability[i-1];
     }
 
     if (DEBUG == DEBUG_PROBABILITY)
@@ -64,26 +78,140 @@ void gen_probability(int size, double fitness[size], double probability[size])
 }
 
 
-int select_parent(int size, double probability[size], pcg32_random_t *rng)
+int gen_rank(int size, double fitness[size], double weight[size])
 {
-    int idx = 0;
-    double r = pcg32_random_r(rng) / (double)UINT32_MAX;
+    size_t *order = (size_t *)malloc(size * sizeof(size_t));
+    double total = (double)size * (size + 1) / 2;
+
+    if (order == NULL)
+    {
+        fprintf(stderr, RED "Unable to allocate memory for rank selection!\n" RESET);
+        return ERROR;
+    }
+
+    // The least fit has rank 1 and the fittest has rank size
+    gsl_sort_index(order, fitness, 1, size);
+    for (int r = 0; r < size; ++r)
+    {
+        weight[order[r]] = (r + 1) / total;
+    }
+    free(order);
+
+    return SUCCESS;
+}
+
+
+int gen_alias(int size, double weight[size], double accept[size], int alias[size])
+{
+    int *work = (int *)malloc(size * sizeof(int));
+    int n_small = 0,
+        n_large = 0;
+
+    if (work == NULL)
+    {
+        fprintf(stderr, RED "Unable to allocate memory for the alias table!\n" RESET);
+        return ERROR;
+    }
 
+    // Scale the weights to a mean of one, the small are stacked from the front
+    // of the work list and the large from the back
     for (int i = 0; i < size; ++i)
     {
-        if (i == 0)
-        {
-            if (r < probability[i])
-            {
-                idx = i;
-                break;
-            }
-        }
-        else if (r >= probability[i-1] && r < probability[i])
+        accept[i] = weight[i] * size;
+        alias[i] = i;
+        if (accept[i] < 1.0)
+            work[n_small++] = i;
+        else
+            work[size - 1 - n_large++] = i;
+    }
+
+    // Fill the remainder of each small column from a large column
+    while (n_small > 0 && n_large > 0)
+    {
+        int small = work[--n_small],
+            large = work[size - n_large];
+
+        alias[small] = large;
+        accept[large] -= 1.0 - accept[small];
+        if (accept[large] < 1.0)
         {
-            idx = i;
-            break;
+            --n_large;
+            work[n_small++] = large;
         }
     }
+
+    // Any column left over is full up to rounding error
+    for (int i = 0; i < n_small; ++i)
+        accept[work[i]] = 1.0;
+    for (int i = 0; i < n_large; ++i)
+        accept[work[size - 1 - i]] = 1.0;
+    free(work);
+
+    return SUCCESS;
+}
+
+
+int select_parent(int size, double probability[size], pcg32_random_t *rng)
+{
+    int low = 0,
+        high = size - 1;
+    double r = pcg32_random_r(rng) / (double)UINT32_MAX;
+
+    // Binary search for the first cumulative probability above the draw
+    while (low < high)
+    {
+        int mid = low + (high - low) / 2;
+        if (r < probability[mid])
+            high = mid;
+        else
+            low = mid + 1;
+    }
+    return low;
+}
+
+
+int select_alias(int size, double accept[size], int alias[size], pcg32_random_t *rng)
+{
+    int i = (int)pcg32_boundedrand_r(rng, size);
+
+    return ldexp(pcg32_random_r(rng), -32) < accept[i] ? i : alias[i];
+}
+
+
+void select_sus(int size, double probability[size], int n, int selected[n],
+                pcg32_random_t *rng)
+{
+    double step = 1.0 / n,
+           pointer = ldexp(pcg32_random_r(rng), -32) * step;
+
+    // Evenly spaced pointers over the probability numberline
+    for (int i = 0, idx = 0; i < n; ++i, pointer += step)
+    {
+        while (idx < size - 1 && pointer >= probability[idx])
+            ++idx;
+        selected[i] = idx;
+    }
+
+    // Shuffle so that the pairs of parents are not ordered by the population
+    for (int i = n - 1; i > 0; --i)
+    {
+        int j = (int)pcg32_boundedrand_r(rng, i + 1),
+            t = selected[i];
+        selected[i] = selected[j];
+        selected[j] = t;
+    }
+}
+
+
+int select_tournament(int size, double fitness[size], int tournament, pcg32_random_t *rng)
+{
+    int idx = (int)pcg32_boundedrand_r(rng, size);
+
+    for (int i = 1; i < tournament; ++i)
+    {
+        int r = (int)pcg32_boundedrand_r(rng, size);
+        if (fitness[r] > fitness[idx])
+            idx = r;
+    }
     return idx;
 }
@@ -0,0 +1,823 @@
+/*
+ * Evolutionary K-means clustering (E-means) using Genetic Algorithms.
+ *
+ * Copyright (C) 2015, Jonathan Gillett
+ * All rights reserved.
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+#define _DEFAULT_SOURCE
+#include <stdio.h>
+#include <stdlib.h>
+#include <stdint.h>
+#include <stdbool.h>
+#include <stdarg.h>
+#include <stddef.h>
+#include <string.h>
+#include <math.h>
+#include <errno.h>
+#include <signal.h>
+#include <fcntl.h>
+#include <unistd.h>
+#include <poll.h>
+#include <pthread.h>
+#include <confuse.h>
+#include <sys/types.h>
+#include <sys/stat.h>
+#include <sys/mman.h>
+#include <sys/socket.h>
+#include <sys/un.h>
+#include <gsl/gsl_matrix.h>
+#include "utility.h"
+#include "emeans.h"
+#include "io.h"
+#include "stats.h"
+#include "server.h"
+
+// Define the configuration parameters
+int64_t workers = 2,
+        threads = 0,
+        max_queue = 64;
+char    *socket_path = NULL,
+        *mmap_dir = NULL;
+
+// The configuration file parsing mappings, the dataset lists are parallel
+cfg_opt_t opts[] = {
+    CFG_STR_LIST("datasets", 0, CFGF_NONE),
+    CFG_STR_LIST("dataset_files", 0, CFGF_NONE),
+    CFG_INT_LIST("dataset_rows", 0, CFGF_NONE),
+    CFG_INT_LIST("dataset_cols", 0, CFGF_NONE),
+    CFG_SIMPLE_INT("workers", &workers),
+    CFG_SIMPLE_INT("threads", &threads),
+    CFG_SIMPLE_INT("max_queue", &max_queue),
+    CFG_SIMPLE_STR("socket", &socket_path),
+    CFG_SIMPLE_STR("mmap_dir", &mmap_dir),
+    CFG_END()
+};
+cfg_t *cfg;
+
+// The short names of the reasons E-means terminated, sent in the RESULT line
+static const char *term_names[] = {
+    "running", "max_iter", "plateau", "collapsed", "target", "deadline", "stopped"
+};
+
+/**
+ * @struct job_key
+ * @brief A parameter of the E-means configuration that a job may set
+ */
+typedef struct
+{
+    const char *name;   /**< The key, as in emeans.conf */
+    size_t offset;      /**< The offset of the parameter in emeans_config */
+    bool real;          /**< True if the parameter is a double, else an int64_t */
+} job_key;
+
+#define JOB_KEY(key, real) { #key, offsetof(emeans_config, key), real }
+
+static const job_key job_keys[] = {
+    JOB_KEY(n_clusters, false), JOB_KEY(k_min, false), JOB_KEY(k_max, false),
+    JOB_KEY(trials, false), JOB_KEY(trials_select, false), JOB_KEY(init_method, false),
+    JOB_KEY(init_rounds, false), JOB_KEY(mutate_method, false),
+    JOB_KEY(crossover_method, false), JOB_KEY(size, false), JOB_KEY(max_iter, false),
+    JOB_KEY(seed, false), JOB_KEY(threads, false), JOB_KEY(batch_kb, false),
+    JOB_KEY(kdtree, false), JOB_KEY(pds, false), JOB_KEY(steady_state, false),
+    JOB_KEY(selection, false), JOB_KEY(tournament, false), JOB_KEY(elitism, false),
+    JOB_KEY(plateau, false), JOB_KEY(lloyd_max_iter, false), JOB_KEY(lloyd_min_iter, false),
+    JOB_KEY(lloyd_adaptive, false), JOB_KEY(dup_tol, true), JOB_KEY(min_diversity, true),
+    JOB_KEY(target_fitness, true), JOB_KEY(time_limit, true), JOB_KEY(lloyd_tol, true),
+    JOB_KEY(lloyd_min_changed, true), JOB_KEY(m_rate, true), JOB_KEY(c_rate, true),
+    JOB_KEY(k_rate, true)
+};
+
+/**
+ * @struct dataset
+ * @brief A named dataset kept resident by the server
+ */
+typedef struct
+{
+    char *name;             /**< The name jobs refer to the dataset by */
+    gsl_matrix *data;       /**< The data, points to view when mapped */
+    gsl_matrix_view view;   /**< The matrix over the mapped cache file */
+    void *map;              /**< The mapping of the cache file, NULL if loaded */
+    size_t map_size;        /**< The size of the mapping in bytes */
+} dataset;
+
+/**
+ * @struct job
+ * @brief A clustering job submitted by a client
+ */
+typedef struct
+{
+    uint64_t id;            /**< The sequence number of the job */
+    int64_t priority;       /**< Jobs with a higher priority are started first */
+    int set;                /**< The dataset to cluster */
+    bool labels;            /**< True to send the cluster of each row */
+    emeans_config config;   /**< The configuration of the job */
+    FILE *out;              /**< The connection to the client */
+} job;
+
+/**
+ * @struct pending
+ * @brief A new connection whose request line has not been received yet
+ */
+typedef struct
+{
+    int fd;                 /**< The connection */
+    size_t len;             /**< The bytes of the request received so far */
+    double deadline;        /**< When the connection is closed without a request */
+    char request[SERVER_MAX_REQUEST]; /**< The request line */
+} pending;
+
+/**
+ * @struct worker
+ * @brief A thread of the pool, executing a single job at a time
+ */
+typedef struct
+{
+    pthread_t thread;       /**< The thread */
+    emeans_ctx **ctx;       /**< The context of each dataset, created by its first job */
+    emeans_ctx *running;    /**< The context of the running job, NULL if idle */
+} worker;
+
+// The datasets, the queue and the pool, the queue is guarded by lock
+static dataset *sets = NULL;
+static int n_sets = 0;
+static worker *pool = NULL;
+static job **queue = NULL;
+static int n_queued = 0,
+           n_running = 0;
+static uint64_t next_id = 1;
+static bool shutting_down = false;
+static pthread_mutex_t lock = PTHREAD_MUTEX_INITIALIZER;
+static pthread_cond_t queued = PTHREAD_COND_INITIALIZER;
+static volatile sig_atomic_t stop_requested = 0;
+
+
+/**
+ * Requests that the server shuts down, the accept loop is interrupted.
+ *
+ * @param signum The signal number
+ */
+static void handle_signal(int signum)
+{
+    (void)signum;
+    stop_requested = 1;
+}
+
+
+/**
+ * Sends a reply line to the client of a job.
+ *
+ * @param out    The connection to the client
+ * @param format The format of the line, without the newline
+ *
+ * @return       The status code, 0 for SUCCESS, 1 for ERROR if the client has
+ *               disconnected
+ */
+static int send_line(FILE *out, const char *format, ...)
+{
+    va_list args;
+
+    va_start(args, format);
+    vfprintf(out, format, args);
+    va_end(args);
+    fputc('\n', out);
+
+    return fflush(out) == 0 && !ferror(out) ? SUCCESS : ERROR;
+}
+
+
+/**
+ * Loads a dataset, if mmap_dir is set the dataset is mapped from a binary
+ * cache file of the rows of doubles that is written on the first load.
+ *
+ * @param set  Pointer to the dataset, populated by function
+ * @param file The path to the CSV data file
+ * @param rows The number of rows in the data file
+ * @param cols The number of columns in the data file
+ *
+ * @return     The status code, 0 for SUCCESS, 1 for ERROR
+ */
+static int load_dataset(dataset *set, char *file, int64_t rows, int64_t cols)
+{
+    char cache[512];
+    size_t size = (size_t)rows * cols * sizeof(double);
+    struct stat info;
+    FILE *ofp;
+    int fd = -1;
+
+    if (rows < 1 || cols < 1)
+    {
+        fprintf(stderr, RED "Dataset %s requires rows and cols of at least 1!\n" RESET, set->name);
+        return ERROR;
+    }
+    snprintf(cache, sizeof(cache), "%s/%s.bin", mmap_dir != NULL ? mmap_dir : ".", set->name);
+
+    // Write the cache file from the data file unless it is already cached
+    if (mmap_dir != NULL && (stat(cache, &info) != 0 || (size_t)info.st_size != size))
+    {
+        gsl_matrix *data = gsl_matrix_alloc(rows, cols);
+
+        if (load_data(file, data) != SUCCESS || (ofp = fopen(cache, "wb")) == NULL)
+        {
+            fprintf(stderr, RED "Unable to cache dataset %s in %s!\n" RESET, set->name, cache);
+            gsl_matrix_free(data);
+            return ERROR;
+        }
+        fwrite(data->data, sizeof(double), (size_t)rows * cols, ofp);
+        fclose(ofp);
+        gsl_matrix_free(data);
+    }
+
+    // Map the cache file privately, the pages are shared until written
+    if (mmap_dir != NULL)
+    {
+        if ((fd = open(cache, O_RDONLY)) < 0
+            || (set->map = mmap(NULL, size, PROT_READ | PROT_WRITE, MAP_PRIVATE, fd, 0)) == MAP_FAILED)
+        {
+            fprintf(stderr, RED "Unable to map dataset %s from %s!\n" RESET, set->name, cache);
+            set->map = NULL;
+            if (fd >= 0)
+                close(fd);
+            return ERROR;
+        }
+        close(fd);
+        set->map_size = size;
+        set->view = gsl_matrix_view_array((double *)set->map, rows, cols);
+        set->data = &set->view.matrix;
+        printf(CYAN "Mapped dataset %s from %s\n" RESET, set->name, cache);
+        return SUCCESS;
+    }
+
+    set->data = gsl_matrix_alloc(rows, cols);
+    if (load_data(file, set->data) != SUCCESS)
+    {
+        fprintf(stderr, RED "Unable to load dataset %s!\n" RESET, set->name);
+        return ERROR;
+    }
+    return SUCCESS;
+}
+
+
+/**
+ * Frees a dataset, unmapping it if mapped.
+ *
+ * @param set Pointer to the dataset
+ */
+static void free_dataset(dataset *set)
+{
+    if (set->map != NULL)
+        munmap(set->map, set->map_size);
+    else
+        gsl_matrix_free(set->data);
+    free(set->name);
+}
+
+
+/**
+ * Parses a JOB request, each key=value pair overrides the default
+ * configuration.
+ *
+ * @param request The request line after JOB, modified by function
+ * @param job     Pointer to the job, populated by function
+ * @param error   Buffer for the reason the request is invalid
+ * @param len     The length of the buffer
+ *
+ * @return        The status code, 0 for SUCCESS, 1 for ERROR
+ */
+static int parse_job(char *request, job *job, char *error, size_t len)
+{
+    char *save = NULL,
+         *name = strtok_r(request, " \t\r\n", &save),
+         *token = NULL;
+
+    job->set = -1;
+    for (int s = 0; name != NULL && s < n_sets; ++s)
+    {
+        if (strcmp(sets[s].name, name) == 0)
+            job->set = s;
+    }
+    if (job->set < 0)
+    {
+        snprintf(error, len, "unknown dataset %s", name != NULL ? name : "");
+        return ERROR;
+    }
+
+    emeans_defaults(&job->config);
+    job->config.threads = threads;
+    while ((token = strtok_r(NULL, " \t\r\n", &save)) != NULL)
+    {
+        char *value = strchr(token, '='),
+             *end = NULL;
+        bool found = false;
+
+        if (value == NULL)
+        {
+            snprintf(error, len, "expected key=value, got %s", token);
+            return ERROR;
+        }
+        *value++ = '\0';
+        if (strcmp(token, "priority") == 0)
+        {
+            job->priority = strtol(value, &end, 10);
+            found = true;
+        }
+        else if (strcmp(token, "labels") == 0)
+        {
+            job->labels = strtol(value, &end, 10) != 0;
+            found = true;
+        }
+        for (size_t k = 0; !found && k < sizeof(job_keys) / sizeof(job_keys[0]); ++k)
+        {
+            char *field = (char *)&job->config + job_keys[k].offset;
+
+            if (strcmp(token, job_keys[k].name) != 0)
+                continue;
+            if (job_keys[k].real)
+                *(double *)field = strtod(value, &end);
+            else
+                *(int64_t *)field = strtoll(value, &end, 10);
+            found = true;
+        }
+        if (!found || end == value || *end != '\0')
+        {
+            snprintf(error, len, found ? "invalid value for %s" : "unknown key %s", token);
+            return ERROR;
+        }
+    }
+    return SUCCESS;
+}
+
+
+/**
+ * Removes the job with the highest priority from the queue, the earliest
+ * submitted of equal priorities, the lock must be held.
+ *
+ * @return Pointer to the job
+ */
+static job *pop_job(void)
+{
+    int best = 0;
+    job *next = NULL;
+
+    for (int i = 1; i < n_queued; ++i)
+    {
+        if (queue[i]->priority > queue[best]->priority
+            || (queue[i]->priority == queue[best]->priority && queue[i]->id < queue[best]->id))
+            best = i;
+    }
+    next = queue[best];
+    queue[best] = queue[--n_queued];
+
+    return next;
+}
+
+
+/**
+ * Executes a job, streaming each new best solution to the client. The
+ * context of the dataset is reused by later jobs of the worker, a job whose
+ * client has disconnected is stopped once its current generation completes.
+ *
+ * @param self Pointer to the worker
+ * @param job  Pointer to the job
+ *
+ * @return     The status code, 0 for SUCCESS, 1 for ERROR
+ */
+static int run_job(worker *self, job *job)
+{
+    emeans_ctx **ctx = &self->ctx[job->set];
+    emeans_result result;
+    int status = SUCCESS;
+
+    if (send_line(job->out, "RUNNING %lu", (unsigned long)job->id) != SUCCESS)
+    {
+        return ERROR;
+    }
+
+    // Reuse the context of the dataset, the data is shared by every worker
+    if (*ctx != NULL && emeans_reset(*ctx, &job->config) != SUCCESS)
+    {
+        emeans_free(*ctx);
+        *ctx = NULL;
+        status = ERROR;
+    }
+    else if (*ctx == NULL && (*ctx = emeans_create(&job->config, sets[job->set].data, NULL)) == NULL)
+    {
+        status = ERROR;
+    }
+    if (status != SUCCESS)
+    {
+        send_line(job->out, "ERROR invalid configuration");
+        return ERROR;
+    }
+
+    pthread_mutex_lock(&lock);
+    self->running = *ctx;
+    if (shutting_down)
+        emeans_stop(*ctx);
+    pthread_mutex_unlock(&lock);
+
+    memset(&result, 0, sizeof(result));
+    while (status == SUCCESS && !emeans_done(*ctx, &result))
+    {
+        status = emeans_step(*ctx, &result);
+        if (status == SUCCESS && result.improved 
+            && send_line(job->out, "PROGRESS %lu %ld %.6f", (unsigned long)job->id,
+                         (long)result.generations, result.fitness) != SUCCESS)
+        {
+            emeans_stop(*ctx);
+        }
+    }
+
+    pthread_mutex_lock(&lock);
+    self->running = NULL;
+    pthread_mutex_unlock(&lock);
+
+    if (status != SUCCESS || result.centroids == NULL)
+    {
+        send_line(job->out, "ERROR E-means failed");
+        return ERROR;
+    }
+
+    // Send the best solution
+    send_line(job->out, "RESULT %lu %.6f %ld %s", (unsigned long)job->id, result.fitness,
+              (long)result.generations, term_names[result.term]);
+    for (size_t i = 0; i < result.centroids->size1; ++i)
+    {
+        fprintf(job->out, "CENTROID ");
+        for (size_t j = 0; j < result.centroids->size2; ++j)
+            fprintf(job->out, j == 0 ? "%10.6f" : ",%10.6f", gsl_matrix_get(result.centroids, i, j));
+        fputc('\n', job->out);
+    }
+    for (size_t i = 0; job->labels && i < sets[job->set].data->size1; ++i)
+        fprintf(job->out, "LABEL %u\n", result.labels[i]);
+
+    return send_line(job->out, "DONE %lu", (unsigned long)job->id);
+}
+
+
+/**
+ * The loop of each worker of the pool, executing the queued jobs until the
+ * server shuts down.
+ *
+ * @param arg Pointer to the worker
+ *
+ * @return    NULL
+ */
+static void *work(void *arg)
+{
+    worker *self = (worker *)arg;
+    job *next = NULL;
+
+    while (true)
+    {
+        pthread_mutex_lock(&lock);
+        while (n_queued == 0 && !shutting_down)
+            pthread_cond_wait(&queued, &lock);
+        if (shutting_down)
+        {
+            pthread_mutex_unlock(&lock);
+            break;
+        }
+        next = pop_job();
+        ++n_running;
+        pthread_mutex_unlock(&lock);
+
+        if (VERBOSE == 1)
+            printf(CYAN "Starting job %lu on dataset %s\n" RESET, (unsigned long)next->id, 
+                   sets[next->set].name);
+        run_job(self, next);
+        fclose(next->out);
+        free(next);
+
+        pthread_mutex_lock(&lock);
+        --n_running;
+        pthread_mutex_unlock(&lock);
+    }
+    return NULL;
+}
+
+
+/**
+ * Reads what has arrived of the request line of a new connection without
+ * blocking, the request is complete once its newline is received or the
+ * buffer is full.
+ *
+ * @param conn     Pointer to the connection
+ * @param complete True if the request line is complete, populated by function
+ *
+ * @return         The status code, 0 for SUCCESS, 1 for ERROR if the client
+ *                 closed the connection or failed
+ */
+static int read_request(pending *conn, bool *complete)
+{
+    ssize_t got = recv(conn->fd, conn->request + conn->len, SERVER_MAX_REQUEST - 1 - conn->len,
+                       MSG_DONTWAIT);
+    char *newline = NULL;
+
+    *complete = false;
+    if (got < 0 && (errno == EAGAIN || errno == EWOULDBLOCK || errno == EINTR))
+        return SUCCESS;
+    if (got <= 0)
+        return ERROR;
+
+    // Anything after the request line is ignored
+    newline = memchr(conn->request + conn->len, '\n', got);
+    conn->len += got;
+    if (newline != NULL)
+        conn->len = newline - conn->request;
+    if (newline != NULL || conn->len == SERVER_MAX_REQUEST - 1)
+    {
+        conn->request[conn->len] = '\0';
+        *complete = true;
+    }
+
+    return SUCCESS;
+}
+
+
+/**
+ * Handles the request line of a connection, LIST is answered directly and a
+ * JOB is queued for the pool which then owns the connection.
+ *
+ * @param fd      The connection
+ * @param request The request line
+ */
+static void handle_client(int fd, char *request)
+{
+    char error[256];
+    FILE *out = NULL;
+    job *next = NULL;
+
+    if ((out = fdopen(fd, "w")) == NULL)
+    {
+        close(fd);
+        return;
+    }
+
+    if (strcmp(request, "LIST") == 0)
+    {
+        for (int s = 0; s < n_sets; ++s)
+            send_line(out, "DATASET %s %lu %lu %d", sets[s].name, (unsigned long)sets[s].data->size1,
+                      (unsigned long)sets[s].data->size2, sets[s].map != NULL);
+        pthread_mutex_lock(&lock);
+        send_line(out, "QUEUE %d %d", n_queued, n_running);
+        pthread_mutex_unlock(&lock);
+        send_line(out, "DONE 0");
+        fclose(out);
+        return;
+    }
+    if (strncmp(request, "JOB ", 4) != 0)
+    {
+        send_line(out, "ERROR unknown request");
+        fclose(out);
+        return;
+    }
+
+    if ((next = (job *)calloc(1, sizeof(job))) == NULL 
+        || parse_job(request + 4, next, error, sizeof(error)) != SUCCESS)
+    {
+        send_line(out, "ERROR %s", next != NULL ? error : "out of memory");
+        fclose(out);
+        free(next);
+        return;
+    }
+
+    pthread_mutex_lock(&lock);
+    if (n_queued >= max_queue)
+    {
+        pthread_mutex_unlock(&lock);
+        send_line(out, "ERROR queue full");
+        fclose(out);
+        free(next);
+        return;
+    }
+    next->id = next_id++;
+    next->out = out;
+    send_line(out, "QUEUED %lu %d", (unsigned long)next->id, n_queued);
+    queue[n_queued++] = next;
+    pthread_cond_signal(&queued);
+    pthread_mutex_unlock(&lock);
+}
+
+
+int main(int argc, char *argv[])
+{
+    int status = SUCCESS,
+        listener = -1,
+        started = 0,
+        n_pending = 0;
+    char conf_file[100] = "./conf/server.conf";
+    pending *conns = NULL;
+    struct pollfd fds[SERVER_MAX_PENDING + 1];
+    struct sockaddr_un addr;
+    struct sigaction action;
+
+    if (argc < 2 || argc > 3)
+    {
+        fprintf(stderr, RED "Incorrect parameters!\n" RESET);
+        fprintf(stderr, RED "Correct usage:\n" RESET);
+        fprintf(stderr, RED "%s <VERBOSE> (1=YES 0=NO) <CONFIG> (DEFAULT ./conf/server.conf)\n\n" RESET, argv[0]);
+        exit(ERROR);
+    }
+    VERBOSE = atoi(argv[1]);
+    if (argc > 2)
+    {
+        strncpy(conf_file, argv[2], sizeof(conf_file) - 1);
+    }
+
+    cfg = cfg_init(opts, 0);
+    if (cfg_parse(cfg, conf_file) != CFG_SUCCESS)
+    {
+        fprintf(stderr, RED "Unable to parse %s\n" RESET, conf_file);
+        status = ERROR;
+        goto free;
+    }
+    if (workers < 1 || max_queue < 1)
+    {
+        fprintf(stderr, RED "Require workers >= 1 and max_queue >= 1!\n" RESET);
+        status = ERROR;
+        goto free;
+    }
+
+    // Load each of the datasets
+    n_sets = (int)cfg_size(cfg, "datasets");
+    if (n_sets == 0 || cfg_size(cfg, "dataset_files") != (unsigned int)n_sets 
+        || cfg_size(cfg, "dataset_rows") != (unsigned int)n_sets 
+        || cfg_size(cfg, "dataset_cols") != (unsigned int)n_sets)
+    {
+        fprintf(stderr, RED "Require the same number of datasets, dataset_files, dataset_rows "
+                            "and dataset_cols!\n" RESET);
+        status = ERROR;
+        goto free;
+    }
+    if ((sets = (dataset *)calloc(n_sets, sizeof(dataset))) == NULL)
+    {
+        status = ERROR;
+        goto free;
+    }
+    for (int s = 0; s < n_sets; ++s)
+    {
+        sets[s].name = strdup(cfg_getnstr(cfg, "datasets", s));
+        if ((status = load_dataset(&sets[s], cfg_getnstr(cfg, "dataset_files", s), 
+                                   cfg_getnint(cfg, "dataset_rows", s),
+                                   cfg_getnint(cfg, "dataset_cols", s))) != SUCCESS)
+        {
+            goto free;
+        }
+    }
+
+    // Listen on the socket, replacing a stale socket of a previous server
+    memset(&addr, 0, sizeof(addr));
+    addr.sun_family = AF_UNIX;
+    strncpy(addr.sun_path, socket_path != NULL ? socket_path : SERVER_SOCKET, sizeof(addr.sun_path) - 1);
+    unlink(addr.sun_path);
+    if ((listener = socket(AF_UNIX, SOCK_STREAM, 0)) < 0
+        || bind(listener, (struct sockaddr *)&addr, sizeof(addr)) != 0
+        || listen(listener, (int)max_queue) != 0)
+    {
+        fprintf(stderr, RED "Unable to listen on %s: %s\n" RESET, addr.sun_path, strerror(errno));
+        status = ERROR;
+        goto free;
+    }
+
+    // Start the pool, the queue holds at most max_queue jobs
+    queue = (job **)malloc(max_queue * sizeof(job *));
+    pool = (worker *)calloc(workers, sizeof(worker));
+    conns = (pending *)malloc(SERVER_MAX_PENDING * sizeof(pending));
+    if (queue == NULL || pool == NULL || conns == NULL)
+    {
+        status = ERROR;
+        goto free;
+    }
+    for (started = 0; started < workers; ++started)
+    {
+        if ((pool[started].ctx = (emeans_ctx **)calloc(n_sets, sizeof(emeans_ctx *))) == NULL
+            || pthread_create(&pool[started].thread, NULL, work, &pool[started]) != 0)
+        {
+            free(pool[started].ctx);
+            status = ERROR;
+            goto stop;
+        }
+    }
+
+    // Shut down gracefully on SIGINT and SIGTERM, a client that disconnects
+    // is detected by the failed write instead of SIGPIPE
+    memset(&action, 0, sizeof(action));
+    action.sa_handler = handle_signal;
+    sigemptyset(&action.sa_mask);
+    sigaction(SIGINT, &action, NULL);
+    sigaction(SIGTERM, &action, NULL);
+    signal(SIGPIPE, SIG_IGN);
+    printf(GREEN "Listening on %s with %ld workers\n" RESET, addr.sun_path, (long)workers);
+
+    // The request lines of new connections are read as they arrive, so a
+    // client that sends nothing only holds its own connection until the timeout
+    while (!stop_requested)
+    {
+        double now = stats_now(),
+               wait = SERVER_TIMEOUT;
+
+        for (int p = 0; p < n_pending; ++p)
+        {
+            wait = fmin(wait, conns[p].deadline - now);
+            fds[p + 1].fd = conns[p].fd;
+            fds[p + 1].events = POLLIN;
+        }
+        fds[0].fd = listener;
+        fds[0].events = n_pending < SERVER_MAX_PENDING ? POLLIN : 0;
+        if (poll(fds, n_pending + 1, wait > 0 ? (int)(wait * 1000) + 1 : 0) < 0)
+        {
+            if (errno != EINTR)
+                fprintf(stderr, RED "Unable to poll the connections: %s\n" RESET, strerror(errno));
+            continue;
+        }
+
+        // From the last so that a finished connection is replaced by one already polled
+        now = stats_now();
+        for (int p = n_pending - 1; p >= 0; --p)
+        {
+            bool complete = false;
+
+            if (fds[p + 1].revents == 0 && now < conns[p].deadline)
+                continue;
+            if (fds[p + 1].revents == 0 || read_request(&conns[p], &complete) != SUCCESS)
+                close(conns[p].fd);
+            else if (complete)
+                handle_client(conns[p].fd, conns[p].request);
+            else
+                continue;
+            conns[p] = conns[--n_pending];
+        }
+
+        if (fds[0].revents & POLLIN)
+        {
+            int fd = accept(listener, NULL, NULL);
+
+            if (fd >= 0)
+            {
+                conns[n_pending].fd = fd;
+                conns[n_pending].len = 0;
+                conns[n_pending].deadline = now + SERVER_TIMEOUT;
+                ++n_pending;
+            }
+            else if (errno != EINTR)
+                fprintf(stderr, RED "Unable to accept a connection: %s\n" RESET, strerror(errno));
+        }
+    }
+    for (int p = 0; p < n_pending; ++p)
+        close(conns[p].fd);
+    printf(YELLOW "Shutting down, stopping the running jobs...\n" RESET);
+
+stop:
+    // Stop the running jobs, which still reply with their best solution
+    pthread_mutex_lock(&lock);
+    shutting_down = true;
+    for (int w = 0; w < started; ++w)
+    {
+        if (pool[w].running != NULL)
+            emeans_stop(pool[w].running);
+    }
+    pthread_cond_broadcast(&queued);
+    pthread_mutex_unlock(&lock);
+    for (int w = 0; w < started; ++w)
+    {
+        pthread_join(pool[w].thread, NULL);
+        for (int s = 0; s < n_sets; ++s)
+            emeans_free(pool[w].ctx[s]);
+        free(pool[w].ctx);
+    }
+    for (int i = 0; i < n_queued; ++i)
+    {
+        send_line(queue[i]->out, "ERROR server shutting down");
+        fclose(queue[i]->out);
+        free(queue[i]);
+    }
+    unlink(addr.sun_path);
+
+free:
+    if (listener >= 0)
+        close(listener);
+    for (int s = 0; sets != NULL && s < n_sets; ++s)
+        free_dataset(&sets[s]);
+    free(sets);
+    free(queue);
+    free(pool);
+    free(conns);
+    cfg_free(cfg);
+    free(socket_path);
+    free(mmap_dir);
+
+    exit(status);
+}
@@ -0,0 +1,270 @@
+/*
+ * Evolutionary K-means clustering (E-means) using Genetic Algorithms.
+ *
+ * Copyright (C) 2015, Jonathan Gillett
+ * All rights reserved.
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+#define _POSIX_C_SOURCE 199309L
+#include <stdio.h>
+#include <stdlib.h>
+#include <stdint.h>
+#include <string.h>
+#include <math.h>
+#include <time.h>
+#include "utility.h"
+#include "stats.h"
+
+// Upper bounds of the Lloyd's iterations histogram buckets, excluding +Inf
+#define N_BUCKETS 10
+static const uint64_t lloyd_buckets[N_BUCKETS] = {1, 2, 5, 10, 20, 50, 100, 200, 500, 1000};
+
+static const char *stop_names[N_LLOYD_STOPS] = {"converged", "tolerance", "changed", "capped"};
+static const char *phase_names[N_PHASES] = {"load", "lloyd", "fitness", "operators", "io"};
+static const char *stat_names[N_STATS] = {
+    "generations", "evaluations", "lloyd_iterations",
+    "distance_evaluations", "empty_clusters", "allocations", "duplicates",
+    "pds_distances", "pds_dimensions"
+};
+static const char *stat_help[N_STATS] = {
+    "Generations of the genetic algorithm completed.",
+    "Chromosomes evaluated.",
+    "Iterations of Lloyd's algorithm over all chromosomes.",
+    "Point to centroid and point to point distances evaluated.",
+    "Empty clusters remaining after Lloyd's algorithm.",
+    "Matrices and vectors allocated in the clustering and fitness code.",
+    "Duplicate offspring replaced with new chromosomes before evaluation.",
+    "Point to centroid distances evaluated with a partial distance search.",
+    "Dimensions summed by the partial distance search before abandoning a centroid."
+};
+
+static double start_time = 0,
+              run_time = 0,
+              phase_time[N_PHASES],
+              best_fitness = NAN;
+static uint64_t counters[N_STATS],
+                lloyd_hist[N_LLOYD_STOPS][N_BUCKETS + 1],
+                lloyd_sum[N_LLOYD_STOPS],
+                lloyd_max = 0;
+
+
+void stats_reset(void)
+{
+    memset(phase_time, 0, sizeof(phase_time));
+    memset(counters, 0, sizeof(counters));
+    memset(lloyd_hist, 0, sizeof(lloyd_hist));
+    memset(lloyd_sum, 0, sizeof(lloyd_sum));
+    lloyd_max = 0;
+    run_time = 0;
+    best_fitness = NAN;
+    start_time = stats_now();
+}
+
+
+double stats_now(void)
+{
+    struct timespec now;
+
+    clock_gettime(CLOCK_MONOTONIC, &now);
+    return now.tv_sec + now.tv_nsec * 1e-9;
+}
+
+
+void stats_time(phase_code phase, double start)
+{
+    double elapsed = stats_now() - start;
+
+    #pragma omp atomic
+    phase_time[phase] += elapsed;
+}
+
+
+void stats_add(stat_code stat, uint64_t value)
+{
+    #pragma omp atomic
+    counters[stat] += value;
+}
+
+
+void stats_lloyd(uint64_t iters, lloyd_stop stop)
+{
+    int b = 0;
+
+    while (b < N_BUCKETS && iters > lloyd_buckets[b])
+        ++b;
+
+    #pragma omp atomic
+    lloyd_hist[stop][b] += 1;
+    #pragma omp atomic
+    lloyd_sum[stop] += iters;
+
+    #pragma omp critical (stats_lloyd_max)
+    {
+        if (iters > lloyd_max)
+            lloyd_max = iters;
+    }
+    stats_add(STAT_LLOYD_ITERS, iters);
+}
+
+
+void stats_run_time(double seconds)
+{
+    run_time = seconds;
+}
+
+
+void stats_fitness(double fitness)
+{
+    if (isnan(best_fitness) || fitness > best_fitness)
+        best_fitness = fitness;
+}
+
+
+int stats_write(char *output)
+{
+    char temp[1024];
+    FILE *ofp;
+
+    // Write to a temporary file and rename it over the stats file
+    snprintf(temp, sizeof(temp), "%s.tmp", output);
+    if ((ofp = fopen(temp, "w")) == NULL)
+    {
+        fprintf(stderr, RED "Can't open output file %s!\n" RESET, temp);
+        return ERROR;
+    }
+
+    fprintf(ofp, "# HELP emeans_uptime_seconds Wall clock time since E-means started.\n");
+    fprintf(ofp, "# TYPE emeans_uptime_seconds gauge\n");
+    fprintf(ofp, "emeans_uptime_seconds %.6f\n", stats_now() - start_time);
+
+    fprintf(ofp, "# HELP emeans_run_seconds Time spent executing generations.\n");
+    fprintf(ofp, "# TYPE emeans_run_seconds gauge\n");
+    fprintf(ofp, "emeans_run_seconds %.6f\n", run_time);
+
+    fprintf(ofp, "# HELP emeans_phase_seconds_total Time spent in each phase, summed over threads.\n");
+    fprintf(ofp, "# TYPE emeans_phase_seconds_total counter\n");
+    for (int p = 0; p < N_PHASES; ++p)
+    {
+        fprintf(ofp, "emeans_phase_seconds_total{phase=\"%s\"} %.6f\n", phase_names[p], phase_time[p]);
+    }
+
+    for (int s = 0; s < N_STATS; ++s)
+    {
+        fprintf(ofp, "# HELP emeans_%s_total %s\n", stat_names[s], stat_help[s]);
+        fprintf(ofp, "# TYPE emeans_%s_total counter\n", stat_names[s]);
+        fprintf(ofp, "emeans_%s_total %lu\n", stat_names[s], (unsigned long)counters[s]);
+    }
+
+    fprintf(ofp, "# HELP emeans_lloyd_iterations_per_chromosome Iterations of Lloyd's algorithm per chromosome.\n");
+    fprintf(ofp, "# TYPE emeans_lloyd_iterations_per_chromosome histogram\n");
+    for (int s = 0; s < N_LLOYD_STOPS; ++s)
+    {
+        uint64_t cumulative = 0;
+
+        for (int b = 0; b < N_BUCKETS; ++b)
+        {
+            cumulative += lloyd_hist[s][b];
+            fprintf(ofp, "emeans_lloyd_iterations_per_chromosome_bucket{stop=\"%s\",le=\"%lu\"} %lu\n",
+                    stop_names[s], (unsigned long)lloyd_buckets[b], (unsigned long)cumulative);
+        }
+        cumulative += lloyd_hist[s][N_BUCKETS];
+        fprintf(ofp, "emeans_lloyd_iterations_per_chromosome_bucket{stop=\"%s\",le=\"+Inf\"} %lu\n",
+                stop_names[s], (unsigned long)cumulative);
+        fprintf(ofp, "emeans_lloyd_iterations_per_chromosome_sum{stop=\"%s\"} %lu\n",
+                stop_names[s], (unsigned long)lloyd_sum[s]);
+        fprintf(ofp, "emeans_lloyd_iterations_per_chromosome_count{stop=\"%s\"} %lu\n",
+                stop_names[s], (unsigned long)cumulative);
+    }
+
+    if (!isnan(best_fitness))
+    {
+        fprintf(ofp, "# HELP emeans_best_fitness Best fitness found so far.\n");
+        fprintf(ofp, "# TYPE emeans_best_fitness gauge\n");
+        fprintf(ofp, "emeans_best_fitness %.6f\n", best_fitness);
+    }
+    fclose(ofp);
+
+    if (rename(temp, output) != 0)
+    {
+        fprintf(stderr, RED "Can't replace output file %s!\n" RESET, output);
+        return ERROR;
+    }
+
+    return SUCCESS;
+}
+
+
+void stats_summary(void)
+{
+    double total = 0,
+           wall = stats_now() - start_time,
+           rate = run_time > 0 ? run_time : wall;
+    uint64_t evals = counters[STAT_EVALUATIONS];
+
+    for (int p = 0; p < N_PHASES; ++p)
+        total += phase_time[p];
+
+    printf(YELLOW "\n============================================================\n" RESET);
+    printf(YELLOW "= PERFORMANCE SUMMARY\n" RESET);
+    printf(YELLOW "============================================================\n" RESET);
+    printf(YELLOW "%-16s %14s %10s\n" RESET, "PHASE", "SECONDS", "SHARE");
+    for (int p = 0; p < N_PHASES; ++p)
+    {
+        printf(YELLOW "%-16s %14.6f %9.2f%%\n" RESET, phase_names[p], phase_time[p],
+               total > 0 ? 100.0 * phase_time[p] / total : 0.0);
+    }
+    printf(YELLOW "%-16s %14.6f\n" RESET, "wall clock", wall);
+    printf(YELLOW "%-16s %14.6f\n" RESET, "run time", run_time);
+    printf(YELLOW "------------------------------------------------------------\n" RESET);
+    for (int s = 0; s < N_STATS; ++s)
+    {
+        printf(YELLOW "%-24s %14lu\n" RESET, stat_names[s], (unsigned long)counters[s]);
+    }
+    printf(YELLOW "%-24s %14.2f\n" RESET, "lloyd_iterations_mean",
+           evals > 0 ? (double)counters[STAT_LLOYD_ITERS] / evals : 0.0);
+    printf(YELLOW "%-24s %14lu\n" RESET, "lloyd_iterations_max", (unsigned long)lloyd_max);
+    if (counters[STAT_PDS_DISTANCES] > 0)
+    {
+        printf(YELLOW "%-24s %14.2f\n" RESET, "pds_dimensions_mean",
+               (double)counters[STAT_PDS_DIMS] / counters[STAT_PDS_DISTANCES]);
+    }
+    if (counters[STAT_DUPLICATES] > 0)
+    {
+        printf(YELLOW "%-24s %13.2f%%\n" RESET, "duplicates_share",
+               evals > 0 ? 100.0 * counters[STAT_DUPLICATES] / evals : 0.0);
+    }
+    printf(YELLOW "------------------------------------------------------------\n" RESET);
+    printf(YELLOW "%-16s" RESET, "LLOYD ITERS <=");
+    for (int b = 0; b < N_BUCKETS; ++b)
+        printf(YELLOW "%6lu" RESET, (unsigned long)lloyd_buckets[b]);
+    printf(YELLOW "%6s\n" RESET, "more");
+    for (int s = 0; s < N_LLOYD_STOPS; ++s)
+    {
+        printf(YELLOW "%-16s" RESET, stop_names[s]);
+        for (int b = 0; b <= N_BUCKETS; ++b)
+            printf(YELLOW "%6lu" RESET, (unsigned long)lloyd_hist[s][b]);
+        printf("\n");
+    }
+    if (counters[STAT_GENERATIONS] > 0)
+    {
+        printf(YELLOW "%-24s %14.3f\n" RESET, "generations_per_sec",
+               counters[STAT_GENERATIONS] / rate);
+    }
+    if (counters[STAT_EVALUATIONS] > 0)
+    {
+        printf(YELLOW "%-24s %14.3f\n" RESET, "evaluations_per_sec",
+               counters[STAT_EVALUATIONS] / rate);
+    }
+}
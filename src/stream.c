@@ -0,0 +1,553 @@
+/*
+ * Evolutionary K-means clustering (E-means) using Genetic Algorithms.
+ *
+ * Copyright (C) 2015, Jonathan Gillett
+ * All rights reserved.
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+#define _DEFAULT_SOURCE
+#include <stdio.h>
+#include <stdlib.h>
+#include <stdint.h>
+#include <stdbool.h>
+#include <string.h>
+#include <math.h>
+#include <errno.h>
+#include <fcntl.h>
+#include <signal.h>
+#include <unistd.h>
+#include <time.h>
+#include <pthread.h>
+#include <stdatomic.h>
+#include <confuse.h>
+#include <gsl/gsl_matrix.h>
+#include "utility.h"
+#include "emeans.h"
+#include "cluster.h"
+#include "fitness.h"
+#include "online.h"
+#include "stats.h"
+
+// Bytes of input buffered, the longest line of input
+#define STREAM_BUFFER 65536
+
+// Buckets of the update latency histogram, powers of two nanoseconds
+#define LATENCY_BUCKETS 40
+
+// Define the configuration parameters
+int64_t n_clusters = 3,
+        cols = 4,
+        reservoir = 10000,
+        refresh_min = 1000,
+        refresh_iter = 10,
+        size = 10,
+        threads = 1,
+        seed = 0,
+        labels = 1;
+double  decay = 0.999,
+        refresh_interval = 10.0;
+char    *input = NULL,
+        *centroids_file = NULL;
+
+// The configuration file parsing mappings
+cfg_opt_t opts[] = {
+    CFG_SIMPLE_INT("n_clusters", &n_clusters),
+    CFG_SIMPLE_INT("cols", &cols),
+    CFG_SIMPLE_INT("reservoir", &reservoir),
+    CFG_SIMPLE_INT("refresh_min", &refresh_min),
+    CFG_SIMPLE_INT("refresh_iter", &refresh_iter),
+    CFG_SIMPLE_INT("size", &size),
+    CFG_SIMPLE_INT("threads", &threads),
+    CFG_SIMPLE_INT("seed", &seed),
+    CFG_SIMPLE_INT("labels", &labels),
+    CFG_SIMPLE_FLOAT("decay", &decay),
+    CFG_SIMPLE_FLOAT("refresh_interval", &refresh_interval),
+    CFG_SIMPLE_STR("input", &input),
+    CFG_SIMPLE_STR("centroids_file", &centroids_file),
+    CFG_END()
+};
+cfg_t *cfg;
+
+/**
+ * @struct line_reader
+ * @brief Reads the input a line at a time, flushing the labels before each
+ *        read that may block
+ */
+typedef struct
+{
+    int fd;                         /**< The input file descriptor */
+    char buf[STREAM_BUFFER];        /**< The buffered input */
+    size_t start;                   /**< The start of the next line in buf */
+    size_t end;                     /**< The end of the input in buf */
+    bool eof;                       /**< True once the input has ended */
+} line_reader;
+
+/**
+ * @struct refresh_job
+ * @brief A refresh of the centroids by E-means on a copy of the reservoir,
+ *        executed in the background
+ */
+typedef struct
+{
+    pthread_t thread;               /**< The background thread */
+    gsl_matrix *sample;             /**< The copy of the reservoir */
+    gsl_matrix *current;            /**< The centroids when the refresh started */
+    gsl_matrix *best;               /**< The centroids found by E-means, NULL unless
+                                         fitter than the current centroids */
+    double *counts;                 /**< The rows of the sample in each cluster of best */
+    double fitness;                 /**< The fitness of the centroids found by E-means */
+    double current_fitness;         /**< The fitness of the current centroids on the sample */
+    int64_t seed;                   /**< The seed of the refresh, 0 for the current time */
+    int64_t refreshes;              /**< The number of refreshes started */
+    bool running;                   /**< True from the start until the thread is joined */
+    atomic_int done;                /**< Set by the thread once finished */
+} refresh_job;
+
+static volatile sig_atomic_t stop_requested = 0;
+
+
+/**
+ * Requests that the stream stops, the pending read is interrupted.
+ *
+ * @param signum The signal number
+ */
+static void handle_signal(int signum)
+{
+    (void)signum;
+    stop_requested = 1;
+}
+
+
+/**
+ * Returns the next line of input, the labels are flushed before blocking for
+ * more input so each label is written once its row is processed.
+ *
+ * @param reader Pointer to the reader
+ * @param out    The labels output
+ *
+ * @return       The line without the newline, NULL at the end of the input
+ */
+static char *next_line(line_reader *reader, FILE *out)
+{
+    while (!stop_requested)
+    {
+        char *line = reader->buf + reader->start,
+             *newline = (char *)memchr(line, '\n', reader->end - reader->start);
+        ssize_t got = 0;
+
+        if (newline != NULL)
+        {
+            *newline = '\0';
+            reader->start = newline - reader->buf + 1;
+            return line;
+        }
+
+        // The last line of input may not end with a newline
+        if (reader->eof)
+        {
+            if (reader->start == reader->end)
+                return NULL;
+            reader->buf[reader->end] = '\0';
+            reader->start = reader->end;
+            return line;
+        }
+
+        memmove(reader->buf, line, reader->end - reader->start);
+        reader->end -= reader->start;
+        reader->start = 0;
+        if (reader->end == STREAM_BUFFER - 1)
+        {
+            fprintf(stderr, RED "A line of input is longer than %d characters!\n" RESET, STREAM_BUFFER);
+            return NULL;
+        }
+
+        fflush(out);
+        got = read(reader->fd, reader->buf + reader->end, STREAM_BUFFER - 1 - reader->end);
+        if (got > 0)
+            reader->end += got;
+        else if (got == 0 || errno != EINTR)
+            reader->eof = true;
+    }
+    return NULL;
+}
+
+
+/**
+ * Parses a CSV row of input.
+ *
+ * @param line The line of input
+ * @param row  The row, populated by function
+ *
+ * @return     The status code, 0 for SUCCESS, 1 for ERROR
+ */
+static int parse_row(char *line, double *row)
+{
+    char *end = NULL;
+
+    for (int64_t j = 0; j < cols; ++j)
+    {
+        row[j] = strtod(line, &end);
+        if (end == line)
+            return ERROR;
+        for (line = end; *line == ' ' || *line == '\t' || *line == '\r'; ++line);
+        if (*line == ',')
+            ++line;
+    }
+    return SUCCESS;
+}
+
+
+/**
+ * Saves the centroids in the format of the centroids file of E-means.
+ *
+ * @param output    Path to the centroids file
+ * @param centroids Pointer to matrix containing the centroids
+ *
+ * @return          The status code, 0 for SUCCESS, 1 for ERROR
+ */
+static int save_centroids(char *output, gsl_matrix *centroids)
+{
+    FILE *ofp;
+
+    if ((ofp = fopen(output, "w")) == NULL)
+    {
+        fprintf(stderr, RED "Can't open output file %s!\n" RESET, output);
+        return ERROR;
+    }
+    for (size_t i = 0; i < centroids->size1; ++i)
+    {
+        for (size_t j = 0; j < centroids->size2; ++j)
+            fprintf(ofp, j == 0 ? "%10.6f" : ",%10.6f", gsl_matrix_get(centroids, i, j));
+        fprintf(ofp, "\n");
+    }
+    fclose(ofp);
+
+    return SUCCESS;
+}
+
+
+/**
+ * Executes E-means on the copy of the reservoir and compares the best
+ * clustering with the fitness of the current centroids on the same rows.
+ *
+ * @param arg Pointer to the refresh job
+ *
+ * @return    NULL
+ */
+static void *refresh(void *arg)
+{
+    refresh_job *job = (refresh_job *)arg;
+    uint32_t n_current = job->current->size1;
+    gsl_matrix **clusters = (gsl_matrix **)calloc(n_current, sizeof(gsl_matrix *));
+    emeans_config config;
+    emeans_result result;
+    emeans_ctx *ctx = NULL;
+
+    emeans_defaults(&config);
+    config.n_clusters = n_clusters;
+    config.size = size;
+    config.max_iter = refresh_iter;
+    config.threads = threads;
+    config.seed = job->seed;
+
+    if (clusters == NULL || build_clusters(job->current, job->sample, n_current, clusters) != SUCCESS)
+    {
+        goto free;
+    }
+    job->current_fitness = dunn_index(job->current, n_current, clusters);
+    if ((ctx = emeans_create(&config, job->sample, NULL)) == NULL 
+        || emeans_run(ctx, &result) != SUCCESS || result.centroids == NULL)
+    {
+        goto free;
+    }
+    job->fitness = result.fitness;
+
+    if (result.fitness > job->current_fitness)
+    {
+        job->best = gsl_matrix_alloc(result.centroids->size1, result.centroids->size2);
+        job->counts = (double *)calloc(result.centroids->size1, sizeof(double));
+        if (job->best == NULL || job->counts == NULL)
+        {
+            gsl_matrix_free(job->best);
+            job->best = NULL;
+            goto free;
+        }
+        gsl_matrix_memcpy(job->best, result.centroids);
+        for (size_t i = 0; i < job->sample->size1; ++i)
+            job->counts[result.labels[i]] += 1;
+    }
+
+free:
+    for (uint32_t n = 0; clusters != NULL && n < n_current; ++n)
+        gsl_matrix_free(clusters[n]);
+    free(clusters);
+    emeans_free(ctx);
+    atomic_store(&job->done, 1);
+
+    return NULL;
+}
+
+
+/**
+ * Starts a refresh in the background with copies of the filled rows of the
+ * reservoir and of the current centroids.
+ *
+ * @param job   Pointer to the refresh job
+ * @param model Pointer to the online model
+ *
+ * @return      The status code, 0 for SUCCESS, 1 for ERROR
+ */
+static int start_refresh(refresh_job *job, online_model *model)
+{
+    gsl_matrix_view filled = gsl_matrix_submatrix(model->reservoir, 0, 0, model->filled, cols);
+
+    job->sample = gsl_matrix_alloc(model->filled, cols);
+    job->current = gsl_matrix_alloc(model->centroids->size1, cols);
+    if (job->sample == NULL || job->current == NULL)
+    {
+        gsl_matrix_free(job->sample);
+        gsl_matrix_free(job->current);
+        return ERROR;
+    }
+    gsl_matrix_memcpy(job->sample, &filled.matrix);
+    gsl_matrix_memcpy(job->current, model->centroids);
+    job->best = NULL;
+    job->counts = NULL;
+    job->seed = seed != 0 ? seed + job->refreshes : 0;
+    atomic_store(&job->done, 0);
+    if (pthread_create(&job->thread, NULL, refresh, job) != 0)
+    {
+        fprintf(stderr, RED "Unable to start the refresh!\n" RESET);
+        gsl_matrix_free(job->sample);
+        gsl_matrix_free(job->current);
+        return ERROR;
+    }
+    job->running = true;
+    ++job->refreshes;
+
+    return SUCCESS;
+}
+
+
+/**
+ * Waits for a refresh to finish and swaps in its centroids if they are
+ * fitter, the counts are capped at the steady state of the decay.
+ *
+ * @param job   Pointer to the refresh job
+ * @param model Pointer to the online model
+ * @param log   The stream to log to
+ *
+ * @return      The status code, 0 for SUCCESS, 1 for ERROR
+ */
+static int finish_refresh(refresh_job *job, online_model *model, FILE *log)
+{
+    int status = SUCCESS;
+
+    pthread_join(job->thread, NULL);
+    job->running = false;
+    if (job->best != NULL)
+    {
+        for (size_t n = 0; decay < 1 && n < job->best->size1; ++n)
+            job->counts[n] = fmin(job->counts[n], 1.0 / (1.0 - decay));
+        status = online_replace(model, job->best, job->counts);
+        fprintf(log, GREEN "Refresh %ld swapped in centroids of fitness %10.6f over %10.6f\n" RESET,
+                (long)job->refreshes, job->fitness, job->current_fitness);
+        if (status == SUCCESS && centroids_file != NULL)
+            status = save_centroids(centroids_file, model->centroids);
+    }
+    else
+    {
+        fprintf(log, CYAN "Refresh %ld kept the current centroids of fitness %10.6f\n" RESET,
+                (long)job->refreshes, job->current_fitness);
+    }
+    gsl_matrix_free(job->sample);
+    gsl_matrix_free(job->current);
+    gsl_matrix_free(job->best);
+    free(job->counts);
+    job->best = NULL;
+    job->counts = NULL;
+
+    return status;
+}
+
+
+int main(int argc, char *argv[])
+{
+    int status = SUCCESS;
+    char conf_file[100] = "./conf/stream.conf",
+         *line = NULL;
+    uint64_t rows = 0,
+             skipped = 0,
+             latency[LATENCY_BUCKETS];
+    double start = 0,
+           now = 0,
+           last_refresh = 0,
+           total = 0,
+           slowest = 0;
+    double *row = NULL;
+    line_reader *reader = NULL;
+    online_model *model = NULL;
+    refresh_job job;
+    struct sigaction action;
+    FILE *out = stdout,
+         *log = stdout;
+
+    if (argc > 2)
+    {
+        fprintf(stderr, RED "Incorrect parameters!\n" RESET);
+        fprintf(stderr, RED "Correct usage:\n" RESET);
+        fprintf(stderr, RED "%s <CONFIG> (DEFAULT ./conf/stream.conf)\n\n" RESET, argv[0]);
+        exit(ERROR);
+    }
+    if (argc > 1)
+    {
+        strncpy(conf_file, argv[1], sizeof(conf_file) - 1);
+    }
+    memset(&job, 0, sizeof(job));
+    memset(latency, 0, sizeof(latency));
+
+    cfg = cfg_init(opts, 0);
+    if (cfg_parse(cfg, conf_file) != CFG_SUCCESS)
+    {
+        fprintf(stderr, RED "Unable to parse %s\n" RESET, conf_file);
+        status = ERROR;
+        goto free;
+    }
+    if (n_clusters < 2 || cols < 1 || reservoir < n_clusters || refresh_min < n_clusters 
+        || decay <= 0 || decay > 1)
+    {
+        fprintf(stderr, RED "Require n_clusters >= 2, cols >= 1, reservoir and refresh_min >= "
+                            "n_clusters and 0 < decay <= 1!\n" RESET);
+        status = ERROR;
+        goto free;
+    }
+
+    // The labels are written to stdout, so log to stderr
+    log = labels ? stderr : stdout;
+    reader = (line_reader *)calloc(1, sizeof(line_reader));
+    row = (double *)malloc(cols * sizeof(double));
+    model = online_create(n_clusters, cols, decay, reservoir, 
+                          seed != 0 ? (uint64_t)seed : (uint64_t)time(NULL));
+    if (reader == NULL || row == NULL || model == NULL)
+    {
+        status = ERROR;
+        goto free;
+    }
+    reader->fd = input == NULL || strcmp(input, "-") == 0 ? STDIN_FILENO : open(input, O_RDONLY);
+    if (reader->fd < 0)
+    {
+        fprintf(stderr, RED "Can't open input file %s!\n" RESET, input);
+        status = ERROR;
+        goto free;
+    }
+
+    // Stop gracefully on SIGINT and SIGTERM, interrupting the pending read
+    memset(&action, 0, sizeof(action));
+    action.sa_handler = handle_signal;
+    sigemptyset(&action.sa_mask);
+    sigaction(SIGINT, &action, NULL);
+    sigaction(SIGTERM, &action, NULL);
+
+    fprintf(log, CYAN "Streaming rows of %ld columns into %ld clusters...\n" RESET, 
+            (long)cols, (long)n_clusters);
+    last_refresh = stats_now();
+    while ((line = next_line(reader, out)) != NULL)
+    {
+        uint32_t label = 0;
+        int bucket = 0;
+
+        if (line[strspn(line, " \t\r")] == '\0')
+            continue;
+        if (parse_row(line, row) != SUCCESS)
+        {
+            if (skipped++ == 0)
+                fprintf(stderr, RED "Skipping rows without %ld columns!\n" RESET, (long)cols);
+            continue;
+        }
+
+        // Time the update of the centroids and the reservoir alone
+        start = stats_now();
+        label = online_update(model, row);
+        now = stats_now();
+        total += now - start;
+        slowest = fmax(slowest, now - start);
+        for (double ns = (now - start) * 1e9; ns >= 2 && bucket < LATENCY_BUCKETS - 1; ns /= 2)
+            ++bucket;
+        ++latency[bucket];
+        ++rows;
+        if (labels)
+            fprintf(out, "%u\n", label);
+
+        // Swap in the centroids of a finished refresh, or start the next once
+        // every centroid has been initialized from a distinct row
+        if (job.running && atomic_load(&job.done)
+            && (status = finish_refresh(&job, model, log)) != SUCCESS)
+        {
+            goto free;
+        }
+        if (!job.running && model->n_init == model->centroids->size1
+            && model->filled >= refresh_min && now - last_refresh >= refresh_interval)
+        {
+            if ((status = start_refresh(&job, model)) != SUCCESS)
+                goto free;
+            last_refresh = now;
+        }
+    }
+    fflush(out);
+
+    // Wait for the last refresh and save the final centroids
+    if (job.running && (status = finish_refresh(&job, model, log)) != SUCCESS)
+    {
+        goto free;
+    }
+    if (centroids_file != NULL && model->n_init == model->centroids->size1)
+    {
+        status = save_centroids(centroids_file, model->centroids);
+    }
+
+    // The update latency, the 99th percentile is the upper bound of its bucket
+    if (rows > 0)
+    {
+        uint64_t below = 0;
+        int p99 = 0;
+
+        while (p99 < LATENCY_BUCKETS - 1 && (below += latency[p99]) < rows - rows / 100)
+            ++p99;
+        fprintf(log, GREEN "Streamed %lu rows, %lu skipped, %ld refreshes\n" RESET, 
+                (unsigned long)rows, (unsigned long)skipped, (long)job.refreshes);
+        fprintf(log, GREEN "Update latency mean %.3f us, p99 <= %.3f us, max %.3f us\n" RESET,
+                total / rows * 1e6, fmin(ldexp(1.0, p99 + 1) / 1e3, slowest * 1e6), slowest * 1e6);
+    }
+
+free:
+    if (job.running)
+    {
+        pthread_join(job.thread, NULL);
+        gsl_matrix_free(job.sample);
+        gsl_matrix_free(job.current);
+        gsl_matrix_free(job.best);
+        free(job.counts);
+    }
+    if (reader != NULL && reader->fd > STDIN_FILENO)
+        close(reader->fd);
+    free(reader);
+    free(row);
+    online_free(model);
+    cfg_free(cfg);
+    free(input);
+    free(centroids_file);
+
+    exit(status);
+}
@@ -0,0 +1,147 @@
+/*
+ * Evolutionary K-means clustering (E-means) using Genetic Algorithms.
+ *
+ * Copyright (C) 2015, Jonathan Gillett
+ * All rights reserved.
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+#include <stdio.h>
+#include <stdlib.h>
+#include <stdint.h>
+#include <math.h>
+#include <gsl/gsl_matrix.h>
+#include "utility.h"
+#include "pcg_basic.h"
+#include "synth.h"
+
+#ifndef M_PI
+#define M_PI 3.14159265358979323846
+#endif
+
+
+/**
+ * Draws a standard normal random variate using the Box-Muller transform.
+ *
+ * @param  rng Pointer to the random number generator
+ *
+ * @return     A normally distributed value with mean 0 and variance 1
+ */
+static double gaussian(pcg32_random_t *rng)
+{
+    // Shift the first uniform into (0, 1] so that the log is always defined
+    double u1 = ldexp(pcg32_random_r(rng) + 1.0, -32),
+           u2 = ldexp(pcg32_random_r(rng), -32);
+
+    return sqrt(-2.0 * log(u1)) * cos(2.0 * M_PI * u2);
+}
+
+
+/**
+ * Places the centre of each blob uniformly within the separation box.
+ *
+ * @param centres    Array of k x cols blob centres, populated by function
+ * @param k          The number of Gaussian blobs
+ * @param cols       The number of dimensions of each centre
+ * @param separation The half width of the box containing the centres
+ * @param rng        Pointer to the random number generator
+ */
+static void blob_centres(double *centres, uint32_t k, uint32_t cols, double separation,
+                         pcg32_random_t *rng)
+{
+    for (uint32_t n = 0; n < k; ++n)
+    {
+        for (uint32_t j = 0; j < cols; ++j)
+        {
+            centres[n * cols + j] = (ldexp(pcg32_random_r(rng), -32) * 2.0 - 1.0) * separation;
+        }
+    }
+}
+
+
+int synth_blobs(char *output, uint64_t rows, uint32_t cols, uint32_t k,
+                double separation, uint64_t seed)
+{
+    FILE *ofp;
+    double *centres = NULL;
+    pcg32_random_t rng;
+
+    pcg32_srandom_r(&rng, seed, 54u);
+
+    if ((centres = (double *)malloc((size_t)k * cols * sizeof(double))) == NULL)
+    {
+        fprintf(stderr, RED "Unable to allocate %u blob centres!\n" RESET, k);
+        return ERROR;
+    }
+    if ((ofp = fopen(output, "w")) == NULL)
+    {
+        fprintf(stderr, RED "Can't open output file %s!\n" RESET, output);
+        free(centres);
+        return ERROR;
+    }
+
+    blob_centres(centres, k, cols, separation, &rng);
+
+    // Stream each point from a randomly selected blob to the file
+    for (uint64_t i = 0; i < rows; ++i)
+    {
+        uint32_t n = pcg32_boundedrand_r(&rng, k);
+
+        for (uint32_t j = 0; j < cols; ++j)
+        {
+            if (j == 0)
+                fprintf(ofp, "%.6f", centres[n * cols + j] + gaussian(&rng));
+            else
+                fprintf(ofp, ",%.6f", centres[n * cols + j] + gaussian(&rng));
+        }
+        fprintf(ofp, "\n");
+    }
+
+    fclose(ofp);
+    free(centres);
+
+    return SUCCESS;
+}
+
+
+int synth_fill(gsl_matrix *data, uint32_t k, double separation, uint64_t seed)
+{
+    uint32_t rows = data->size1,
+             cols = data->size2;
+    double *centres = NULL;
+    pcg32_random_t rng;
+
+    pcg32_srandom_r(&rng, seed, 54u);
+
+    if ((centres = (double *)malloc((size_t)k * cols * sizeof(double))) == NULL)
+    {
+        fprintf(stderr, RED "Unable to allocate %u blob centres!\n" RESET, k);
+        return ERROR;
+    }
+    blob_centres(centres, k, cols, separation, &rng);
+
+    // Draw each point from a randomly selected blob
+    for (uint32_t i = 0; i < rows; ++i)
+    {
+        uint32_t n = pcg32_boundedrand_r(&rng, k);
+
+        for (uint32_t j = 0; j < cols; ++j)
+        {
+            gsl_matrix_set(data, i, j, centres[n * cols + j] + gaussian(&rng));
+        }
+    }
+    free(centres);
+
+    return SUCCESS;
+}
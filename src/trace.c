@@ -0,0 +1,260 @@
+/*
+ * Evolutionary K-means clustering (E-means) using Genetic Algorithms.
+ *
+ * Copyright (C) 2015, Jonathan Gillett
+ * All rights reserved.
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+#define _POSIX_C_SOURCE 199309L
+#include <stdio.h>
+#include <stdlib.h>
+#include <stdint.h>
+#include <stdbool.h>
+#include <string.h>
+#include <unistd.h>
+#include <pthread.h>
+#include <stdatomic.h>
+#include "utility.h"
+#include "stats.h"
+#include "trace.h"
+
+// Initial number of events in each thread's buffer
+#define TRACE_INITIAL_CAP 4096
+
+/**
+ * @struct trace_event
+ * @brief A single begin or end event
+ */
+typedef struct
+{
+    const char *name;   /**< Name of the event */
+    int64_t id;         /**< Generation, chromosome or iteration of the event */
+    double ts;          /**< Timestamp in microseconds since tracing started */
+    char ph;            /**< Phase of the event, 'B' for begin or 'E' for end */
+} trace_event;
+
+/**
+ * @struct trace_buffer
+ * @brief The events of one thread, padded to a cache line so that threads
+ *        recording events never share a cache line
+ */
+typedef struct
+{
+    trace_event *events;
+    size_t len;
+    size_t cap;
+    char pad[40];
+} trace_buffer;
+
+static bool tracing = false;
+static int n_buffers = 0,
+           max_buffers = 0,
+           session = 0;
+static double start_time = 0;
+static trace_buffer **buffers = NULL;
+static pthread_mutex_t buffers_lock = PTHREAD_MUTEX_INITIALIZER;
+
+// The next thread id, and the events that could not be recorded
+static atomic_int next_tid;
+static atomic_ulong dropped;
+
+// The buffer of the calling thread and the tracing session it belongs to
+static _Thread_local trace_buffer *own = NULL;
+static _Thread_local int own_session = 0;
+
+
+int trace_init(int threads)
+{
+    if ((buffers = (trace_buffer **)calloc(threads, sizeof(trace_buffer *))) == NULL)
+    {
+        fprintf(stderr, RED "Unable to allocate trace buffers!\n" RESET);
+        return ERROR;
+    }
+    n_buffers = 0;
+    max_buffers = threads;
+    atomic_store(&next_tid, 0);
+    atomic_store(&dropped, 0);
+    ++session;
+    start_time = stats_now();
+    tracing = true;
+
+    return SUCCESS;
+}
+
+
+/**
+ * Allocates the buffer of the calling thread on its first event, the thread
+ * takes the next id and the table of buffers grows if the thread is beyond
+ * the threads it was sized for. The lock is only taken once by each thread.
+ *
+ * @return The buffer of the calling thread, NULL if it can not be allocated
+ */
+static trace_buffer *trace_register(void)
+{
+    int tid = atomic_fetch_add(&next_tid, 1);
+    trace_buffer *buf = (trace_buffer *)calloc(1, sizeof(trace_buffer));
+
+    if (buf == NULL)
+    {
+        return NULL;
+    }
+
+    pthread_mutex_lock(&buffers_lock);
+    if (tid >= max_buffers)
+    {
+        int max = tid + 1 > 2 * max_buffers ? tid + 1 : 2 * max_buffers;
+        trace_buffer **grown = (trace_buffer **)realloc(buffers, max * sizeof(trace_buffer *));
+
+        if (grown == NULL)
+        {
+            pthread_mutex_unlock(&buffers_lock);
+            free(buf);
+            return NULL;
+        }
+        memset(grown + max_buffers, 0, (max - max_buffers) * sizeof(trace_buffer *));
+        buffers = grown;
+        max_buffers = max;
+    }
+    buffers[tid] = buf;
+    if (tid >= n_buffers)
+        n_buffers = tid + 1;
+    pthread_mutex_unlock(&buffers_lock);
+
+    own = buf;
+    own_session = session;
+
+    return buf;
+}
+
+
+/**
+ * Appends an event to the buffer of the calling thread, growing the buffer
+ * if it is full. Only the owning thread ever touches its buffer, events that
+ * can not be stored are counted and reported by trace_write().
+ */
+static void trace_record(const char *name, int64_t id, char ph)
+{
+    double ts = (stats_now() - start_time) * 1e6;
+    trace_buffer *buf = own;
+
+    if (buf == NULL || own_session != session)
+    {
+        buf = trace_register();
+    }
+    if (buf == NULL)
+    {
+        atomic_fetch_add(&dropped, 1);
+        return;
+    }
+
+    if (buf->len == buf->cap)
+    {
+        size_t cap = buf->cap == 0 ? TRACE_INITIAL_CAP : buf->cap * 2;
+        trace_event *events = (trace_event *)realloc(buf->events, cap * sizeof(trace_event));
+
+        if (events == NULL)
+        {
+            atomic_fetch_add(&dropped, 1);
+            return;
+        }
+        buf->events = events;
+        buf->cap = cap;
+    }
+    buf->events[buf->len].name = name;
+    buf->events[buf->len].id = id;
+    buf->events[buf->len].ts = ts;
+    buf->events[buf->len].ph = ph;
+    buf->len += 1;
+}
+
+
+void trace_begin(const char *name, int64_t id)
+{
+    if (tracing)
+        trace_record(name, id, 'B');
+}
+
+
+void trace_end(const char *name, int64_t id)
+{
+    if (tracing)
+        trace_record(name, id, 'E');
+}
+
+
+int trace_write(char *output)
+{
+    int status = SUCCESS;
+    long pid = (long)getpid();
+    bool first = true;
+    FILE *ofp;
+
+    if (!tracing)
+    {
+        return SUCCESS;
+    }
+    tracing = false;
+    pthread_mutex_lock(&buffers_lock);
+    if (atomic_load(&dropped) > 0)
+    {
+        fprintf(stderr, YELLOW "Dropped %lu trace events, unable to allocate the trace buffers!\n" RESET,
+                atomic_load(&dropped));
+    }
+
+    if ((ofp = fopen(output, "w")) == NULL)
+    {
+        fprintf(stderr, RED "Can't open output file %s!\n" RESET, output);
+        status = ERROR;
+        goto free;
+    }
+
+    printf(GREEN "Saving trace events to %s\n" RESET, output);
+    fprintf(ofp, "{\"displayTimeUnit\": \"ms\", \"traceEvents\": [");
+    for (int t = 0; t < n_buffers; ++t)
+    {
+        if (buffers[t] == NULL || buffers[t]->len == 0)
+            continue;
+
+        fprintf(ofp, "%s\n{\"name\": \"thread_name\", \"ph\": \"M\", \"pid\": %ld, "
+                "\"tid\": %d, \"args\": {\"name\": \"thread %d\"}}",
+                first ? "" : ",", pid, t, t);
+        first = false;
+
+        for (size_t i = 0; i < buffers[t]->len; ++i)
+        {
+            trace_event *e = &buffers[t]->events[i];
+            fprintf(ofp, ",\n{\"name\": \"%s\", \"cat\": \"emeans\", \"ph\": \"%c\", "
+                    "\"ts\": %.3f, \"pid\": %ld, \"tid\": %d, \"args\": {\"id\": %ld}}",
+                    e->name, e->ph, e->ts, pid, t, (long)e->id);
+        }
+    }
+    fprintf(ofp, "\n]}\n");
+    fclose(ofp);
+
+free:
+    for (int t = 0; t < n_buffers; ++t)
+    {
+        if (buffers[t] != NULL)
+            free(buffers[t]->events);
+        free(buffers[t]);
+    }
+    free(buffers);
+    buffers = NULL;
+    n_buffers = 0;
+    max_buffers = 0;
+    pthread_mutex_unlock(&buffers_lock);
+
+    return status;
+}